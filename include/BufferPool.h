@@ -0,0 +1,45 @@
+#pragma once
+#include <CL/cl.h>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+
+namespace kumo {
+
+// Keeps one cl_mem per named slot and hands the same object back as long as
+// the requested size and flags stay the same. Per-frame callers only pay for
+// clCreateBuffer on the first frame and whenever the resolution changes.
+class BufferPool {
+public:
+  explicit BufferPool(cl_context context = nullptr);
+  ~BufferPool();
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  // Drops every pooled buffer and binds the pool to another context.
+  void setContext(cl_context context);
+
+  // host_ptr is only meaningful together with CL_MEM_USE_HOST_PTR, a slot
+  // wrapping host memory is reused while the caller keeps the same storage
+  cl_mem acquire(const std::string& slot, size_t size, cl_mem_flags flags,
+                 void* host_ptr = nullptr);
+  void clear();
+
+  // Number of clCreateBuffer calls issued since construction.
+  size_t allocationCount() const;
+
+private:
+  struct Entry {
+    cl_mem mem;
+    size_t size;
+    cl_mem_flags flags;
+    void* host_ptr;
+  };
+
+  cl_context context_;
+  std::unordered_map<std::string, Entry> slots_;
+  size_t allocations_;
+};
+
+}
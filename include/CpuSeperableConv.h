@@ -0,0 +1,71 @@
+#pragma once
+#include "GaussianKernel.h"
+#include "ThreadPool.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace kumo {
+
+// kFolded adds mirrored samples before multiplying, (p[-k] + p[k]) * w[k],
+// which halves the multiplies of kFloat. kFixedPoint folds as well and
+// stays in integers, see quantizeKernelQ16: Q0.16 weights, a Q8.8 uint16
+// intermediate and 32-bit accumulators, so its AVX2 row pass works on 16
+// elements per register instead of 8.
+enum class CpuArithmetic { kFloat, kFolded, kFixedPoint };
+
+// Separable convolution of interleaved 8-bit images on the host, used where
+// no usable OpenCL device exists. Rows are split into bands that run on a
+// thread pool. Each band row-filters its rows plus the apron into a float
+// scratch, then column-filters from there. Interior pixels use AVX-512, AVX2
+// or scalar code picked at runtime. The border strips, where taps are
+// clamped to the image, are handled separately.
+class CpuSeperableConv {
+public:
+  // num_threads == 0 uses every hardware thread
+  explicit CpuSeperableConv(size_t num_threads = 0);
+
+  // Borders replicate the edge pixel like the OpenCL kernels. src and dst
+  // may not alias, pitches are in bytes.
+  bool run(const uint8_t* src, size_t src_pitch, uint8_t* dst, size_t dst_pitch,
+           int width, int height, int channels, const std::vector<float>& kernel);
+
+  // Young-van Vliet recursive Gaussian, the cost per pixel does not depend
+  // on sigma. The row pass runs rows in parallel, the column pass runs
+  // strips of columns in parallel and walks them top to bottom, so every
+  // recursion step is a contiguous row segment. Borders replicate.
+  bool runRecursive(const uint8_t* src, size_t src_pitch, uint8_t* dst, size_t dst_pitch,
+                    int width, int height, int channels, float sigma);
+
+  // Picks runRecursive from the recursive sigma threshold on, the FIR
+  // passes with a 3 sigma kernel below it.
+  bool runGaussian(const uint8_t* src, size_t src_pitch, uint8_t* dst, size_t dst_pitch,
+                   int width, int height, int channels, float sigma);
+  void setRecursiveSigmaThreshold(float sigma);
+  float recursiveSigmaThreshold() const;
+
+  // Kernels that are not symmetric run with kFloat, kFixedPoint falls back
+  // to kFolded for kernels quantizeKernelQ16 rejects.
+  void setArithmetic(CpuArithmetic arithmetic);
+  CpuArithmetic arithmetic() const;
+
+  size_t threadCount() const;
+
+  // Name of the SIMD path interior pixels take on this machine.
+  static const char* simdPath();
+
+private:
+  void runBand(const uint8_t* src, size_t src_pitch, uint8_t* dst, size_t dst_pitch,
+               int width, int height, int channels, const std::vector<float>& kernel,
+               bool folded, int y0, int y1);
+  void runBandFixed(const uint8_t* src, size_t src_pitch, uint8_t* dst, size_t dst_pitch,
+                    int width, int height, int channels, const std::vector<uint16_t>& q,
+                    int y0, int y1);
+
+  ThreadPool pool_;
+  float recursive_threshold_;
+  CpuArithmetic arithmetic_;
+  std::vector<float> recursive_scratch_;
+};
+
+}
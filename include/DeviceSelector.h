@@ -0,0 +1,70 @@
+#pragma once
+#include <CL/cl.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace kumo {
+
+// Which OpenCL device the runtime should open. Every platform is searched,
+// filter is matched case-insensitively against the platform name, the
+// device vendor and the device name. With fallback set a machine without a
+// matching GPU gets a CPU device (e.g. POCL) instead of failing.
+struct DeviceSelector {
+  cl_device_type type = CL_DEVICE_TYPE_GPU;
+  std::string filter;
+  bool fallback = true;
+
+  // Parses KUMO_CL_DEVICE=[gpu|cpu|accelerator|all][:filter], e.g. "cpu",
+  // "gpu:nvidia" or "all:pocl". A value without a known type is taken as
+  // the filter of a GPU selection. Unset gives the defaults.
+  static DeviceSelector fromEnv();
+  static DeviceSelector parse(const std::string& spec);
+};
+
+// Capabilities used to size launches per device.
+struct DeviceInfo {
+  std::string platform_name;
+  std::string name;
+  std::string vendor;
+  std::string version;
+  std::string driver_version;
+  cl_device_type type = 0;
+  cl_uint compute_units = 0;
+  size_t max_work_group_size = 0;
+  cl_ulong local_mem_size = 0;
+  cl_ulong global_mem_size = 0;
+  cl_uint preferred_vector_width_char = 0;
+  cl_uint preferred_vector_width_float = 0;
+  bool image_support = false;
+  bool host_unified_memory = false;
+
+  bool isGpu() const;
+  bool isCpu() const;
+};
+
+DeviceInfo queryDeviceInfo(cl_device_id device);
+
+// String valued clGetDeviceInfo query, empty on failure.
+std::string deviceString(cl_device_id device, cl_device_info param);
+
+struct DeviceHandle {
+  cl_platform_id platform;
+  cl_device_id device;
+};
+
+// Every device matching type and filter, in platform order. fallback is
+// ignored here.
+std::vector<DeviceHandle> listDevices(const DeviceSelector& selector);
+
+// Splits device into sub-devices of compute_units each with
+// CL_DEVICE_PARTITION_EQUALLY. Empty when the device cannot be partitioned.
+// The caller releases the sub-devices with clReleaseDevice.
+std::vector<cl_device_id> partitionDevice(cl_device_id device, cl_uint compute_units);
+
+// Picks the first device matching selector, then retries with
+// CL_DEVICE_TYPE_CPU when fallback is enabled.
+bool selectDevice(const DeviceSelector& selector,
+                  cl_platform_id* platform, cl_device_id* device);
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace kumo {
+
+// Normalized 1D Gaussian of 2 * radius + 1 taps. radius < 0 picks
+// ceil(3 * sigma), which keeps more than 99.7% of the weight.
+std::vector<float> gaussianKernel1D(float sigma, int radius = -1);
+
+// Third order recursive Gaussian of Young and van Vliet, "Recursive
+// implementation of the Gaussian filter" (1995). A causal pass
+//   w[n] = b * x[n] + a1 * w[n-1] + a2 * w[n-2] + a3 * w[n-3]
+// followed by the same recursion anti-causally over w approximates a
+// Gaussian of the given sigma at a cost that does not depend on sigma.
+struct RecursiveGaussian {
+  float b = 1.0f;
+  float a1 = 0.0f;
+  float a2 = 0.0f;
+  float a3 = 0.0f;
+  // Boundary matrix of Triggs and Sdika, "Boundary conditions for
+  // Young-van Vliet recursive filtering" (2006), times b. With u the last
+  // input sample of a line and d = (w[N-1] - u, w[N-2] - u, w[N-3] - u)
+  // the last causal outputs, row i of boundary * d + u is the anti-causal
+  // output at N - 1 + i of a border replicated to infinity.
+  float boundary[9] = {};
+
+  // Valid for sigma >= 0.5, smaller values are clamped.
+  static RecursiveGaussian fromSigma(float sigma);
+};
+
+// Radii of the successive box filters whose cascade has the variance of
+// a Gaussian of sigma, following Kovesi, "Fast almost-Gaussian filtering"
+// (2010). The widths are odd and differ by at most 2 between passes.
+std::vector<int> boxBlurRadii(float sigma, int passes = 3);
+
+// true when kernel[r - k] == kernel[r + k] within tolerance for every k,
+// the folded passes compute (p[-k] + p[k]) * w[k] and rely on it.
+bool isSymmetric(const std::vector<float>& kernel, float tolerance = 1e-6f);
+
+// Fixed-point passes: Q0.16 weights, a Q8.8 intermediate and 32-bit
+// accumulators, rounded to nearest after each pass.
+constexpr int kWeightFractionBits = 16;
+constexpr int kTempFractionBits = 8;
+
+// Q0.16 weights of the center and one side of a symmetric kernel, q[k] for
+// offsets 0..radius. The rounding error goes into the center tap, so the
+// weights sum to round(sum * 65536) and a flat image stays flat. Empty when
+// a weight is negative, the center does not fit 16 bits or the kernel sums
+// to more than 1, the integer accumulators could overflow then.
+std::vector<uint16_t> quantizeKernelQ16(const std::vector<float>& kernel);
+
+// Above this sigma the recursive filter beats the FIR passes on the
+// devices we measured, below it the error of the approximation is visible.
+constexpr float kRecursiveSigmaThreshold = 8.0f;
+
+inline bool preferRecursive(float sigma, float threshold = kRecursiveSigmaThreshold) {
+  return sigma >= threshold;
+}
+
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+
+namespace kumo {
+
+// One rank-1 term of a 2D kernel, K[y][x] ~= column[y] * row[x].
+struct SeparableTerm {
+  std::vector<float> column;  // kernel rows entries, the vertical pass
+  std::vector<float> row;     // kernel cols entries, the horizontal pass
+};
+
+// Truncated SVD of a 2D kernel, K ~= sum of terms. The singular values
+// are split evenly between the two vectors of a term, terms are ordered by
+// decreasing singular value and every row sums to a non-negative value.
+struct LowRankKernel {
+  std::vector<SeparableTerm> terms;
+  std::vector<float> singular_values;  // all of them, largest first
+  // ||K - sum of terms||_F / ||K||_F, of the max_rank approximation when
+  // no rank met the tolerance
+  float residual = 1.0f;
+};
+
+// Decomposes the row-major rows x cols kernel and keeps the smallest rank
+// up to max_rank whose relative residual is at most tolerance. terms is
+// empty when no rank is good enough, for an all-zero kernel or when the
+// size does not match. A Gaussian comes out as a single term, lines at an
+// angle and discs need several.
+LowRankKernel decomposeKernel2D(const std::vector<float>& kernel, int rows, int cols,
+                                int max_rank, float tolerance);
+
+}
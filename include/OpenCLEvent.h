@@ -0,0 +1,45 @@
+#pragma once
+#include <CL/cl.h>
+#include <vector>
+
+namespace kumo {
+
+// Reference-counted handle to the cl_event of an enqueued command. It works
+// as a future: wait() blocks until the command completes, and the handle
+// can go into the wait list of the next command, so upload, kernel and
+// download chain on the device without stalling the host. A command that
+// could not be enqueued yields a failed event that carries the error code.
+class Event {
+public:
+  Event();
+  // takes over the reference returned by a clEnqueue* call
+  explicit Event(cl_event event);
+  // event of a command that failed to enqueue with error
+  static Event failure(cl_int error);
+  Event(const Event& other);
+  Event(Event&& other) noexcept;
+  Event& operator=(const Event& other);
+  Event& operator=(Event&& other) noexcept;
+  ~Event();
+
+  bool valid() const;
+  bool failed() const;
+  // CL_SUCCESS unless the command failed to enqueue
+  cl_int error() const;
+  // a failed event counts as complete, wait() reports the failure
+  bool isComplete() const;
+  // false when the command failed to enqueue or terminated abnormally
+  bool wait() const;
+  cl_event get() const;
+
+  // Raw handles for the event_wait_list of clEnqueue* calls. Empty events
+  // carry no dependency and are skipped. Returns the error of the first
+  // failed event instead, the dependent command must not be enqueued.
+  static cl_int toWaitList(const std::vector<Event>& events, std::vector<cl_event>* raw);
+
+private:
+  cl_event event_;
+  cl_int error_;
+};
+
+}
@@ -1,34 +1,93 @@
 #pragma once
+#include "BufferPool.h"
+#include "DeviceSelector.h"
+#include "OpenCLEvent.h"
+#include "ProgramCache.h"
 #include <CL/cl.h>
 #include <cstddef>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace kumo {
 
+// Shared OpenCL context, device and in-order profiling queue. Any number of
+// kernels live in it side by side, keyed by kernel name, so several stages
+// (blur, scan, ...) can hold one runtime through a shared_ptr and exchange
+// cl_mem objects directly.
 class OpenCLRuntime {
 public:
   OpenCLRuntime();
   ~OpenCLRuntime();
 
+  OpenCLRuntime(const OpenCLRuntime&) = delete;
+  OpenCLRuntime& operator=(const OpenCLRuntime&) = delete;
+
+  // init() reads the selector from KUMO_CL_DEVICE, see DeviceSelector.
   bool init();
-  bool buildKernelFromFile(const std::string& file_path, const std::string& kernel_name);
+  bool init(const DeviceSelector& selector);
+  // opens the given device, e.g. one of listDevices() or a sub-device
+  bool init(cl_platform_id platform, cl_device_id device);
+  bool isInitialized() const;
+  const DeviceInfo& deviceInfo() const;
+  cl_platform_id platform() const;
+  cl_device_id device() const;
+  cl_context context() const;
+  cl_command_queue queue() const;
+
+  // Adds kernel_name to the runtime, replacing an older kernel of the same
+  // name, and makes it the current kernel of getKernel()/setKernelArg()/
+  // runKernel(). Programs come from the runtime's ProgramCache, building
+  // several kernels of one file compiles it once.
+  bool buildKernelFromFile(const std::string& file_path, const std::string& kernel_name,
+                           const std::string& options = "");
+  bool buildKernelsFromFile(const std::string& file_path,
+                            const std::vector<std::string>& kernel_names,
+                            const std::string& options = "");
+  // nullptr when no kernel of that name was built
+  cl_kernel getKernel(const std::string& kernel_name) const;
+  bool hasKernel(const std::string& kernel_name) const;
+  ProgramCache& programCache();
   cl_kernel getKernel() const;
 
   cl_mem createBuffer(size_t size, cl_mem_flags flags, void* host_ptr = nullptr);
-  void writeBuffer(cl_mem buf, const void* data, size_t size);
-  void readBuffer(cl_mem buf, void* data, size_t size);
-  void runKernel(const std::vector<size_t>& global, const std::vector<size_t>& local);
+  // pooled buffer owned by the runtime, reused until size or flags change
+  cl_mem acquireBuffer(const std::string& slot, size_t size, cl_mem_flags flags);
+  // blocking, false when the command failed to enqueue or to complete
+  bool writeBuffer(cl_mem buf, const void* data, size_t size);
+  bool readBuffer(cl_mem buf, void* data, size_t size);
+  bool runKernel(const std::vector<size_t>& global, const std::vector<size_t>& local);
   void setKernelArg(cl_uint idx, size_t size, const void* value);
 
+  // Non-blocking variants. Each command starts once every event in wait_list
+  // has completed and returns its own event, which is failed() and carries
+  // the error code when the command or one of its dependencies could not be
+  // enqueued.
+  // Host memory passed to the transfers must stay alive until the returned
+  // event completes.
+  Event writeBufferAsync(cl_mem buf, const void* data, size_t size,
+                         const std::vector<Event>& wait_list = {});
+  Event readBufferAsync(cl_mem buf, void* data, size_t size,
+                        const std::vector<Event>& wait_list = {});
+  Event runKernelAsync(const std::vector<size_t>& global, const std::vector<size_t>& local,
+                       const std::vector<Event>& wait_list = {});
+  Event runKernelAsync(cl_kernel kernel,
+                       const std::vector<size_t>& global, const std::vector<size_t>& local,
+                       const std::vector<Event>& wait_list = {});
+  // submits queued commands to the device without waiting for them
+  void flush();
+  void finish();
 
 private:
   cl_platform_id platform_;
   cl_device_id device_;
   cl_context context_;
   cl_command_queue queue_;
-  cl_program program_;
-  cl_kernel kernel_;
+  DeviceInfo device_info_;
+  std::unordered_map<std::string, cl_kernel> kernels_;
+  cl_kernel kernel_;  // current kernel, owned by kernels_
+  BufferPool buffer_pool_;
+  ProgramCache program_cache_;
 };
 
 }
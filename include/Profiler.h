@@ -0,0 +1,62 @@
+#pragma once
+#include "OpenCLEvent.h"
+#include <CL/cl.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace kumo {
+
+// Timestamps of one profiled command, in nanoseconds of the device clock.
+struct ProfiledCommand {
+  std::string stage;  // "upload", "rows", "cols", "download", ...
+  cl_ulong queued = 0;
+  cl_ulong submit = 0;
+  cl_ulong start = 0;
+  cl_ulong end = 0;
+  size_t bytes = 0;   // bytes the command moves, 0 if not meaningful
+};
+
+struct StageStats {
+  size_t count = 0;
+  double total_ms = 0.0;  // sum of END - START
+  size_t bytes = 0;
+
+  double averageMs() const;
+  // bytes over device time, 0 without either
+  double gbPerSecond() const;
+};
+
+// Collects CL_PROFILING_COMMAND_QUEUED/SUBMIT/START/END of the commands
+// handed to record(). The queue must have been created with
+// CL_QUEUE_PROFILING_ENABLE, commands of other queues are dropped on
+// collect(). Not thread safe, one profiler per queue user.
+class Profiler {
+public:
+  // Takes over the reference of event, returned by a clEnqueue* call.
+  void record(const std::string& stage, cl_event event, size_t bytes = 0);
+  // Waits for the recorded commands and reads their timestamps.
+  bool collect();
+  void clear();
+
+  const std::vector<ProfiledCommand>& commands() const;
+  StageStats stage(const std::string& name) const;
+  // First QUEUED to last END over everything collected.
+  double spanMs() const;
+
+  // Chrome trace event format, open in chrome://tracing or Perfetto. One
+  // row per stage, QUEUED and SUBMIT go into the args of every slice.
+  bool writeChromeTrace(const std::string& path) const;
+
+private:
+  struct Pending {
+    std::string stage;
+    Event event;
+    size_t bytes;
+  };
+
+  std::vector<Pending> pending_;
+  std::vector<ProfiledCommand> commands_;
+};
+
+}
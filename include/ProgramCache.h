@@ -0,0 +1,80 @@
+#pragma once
+#include <CL/cl.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace kumo {
+
+// Builds each (source, options) pair once per device and keeps the
+// cl_program around, so callers creating several kernels from one .cl file
+// share a single compile. Built binaries are also written to cache_dir and
+// loaded with clCreateProgramWithBinary on later runs, which skips the
+// front-end compile on the next startup. The key covers the source hash,
+// the build options and the device name and driver version, a driver update
+// invalidates the cached binaries.
+class ProgramCache {
+public:
+  ProgramCache();
+  ~ProgramCache();
+
+  ProgramCache(const ProgramCache&) = delete;
+  ProgramCache& operator=(const ProgramCache&) = delete;
+
+  // Drops every cached program and binds the cache to another device.
+  void setDevice(cl_context context, cl_device_id device);
+  // An empty directory keeps the cache in memory only.
+  void setCacheDir(const std::string& dir);
+  const std::string& cacheDir() const;
+
+  // The returned program is owned by the cache and stays valid until
+  // clear() or setDevice(), retain it to keep it longer.
+  cl_program getProgram(const std::string& source, const std::string& options = "");
+  cl_program getProgramFromFile(const std::string& file_path, const std::string& options = "");
+  // Counted variants for callers that keep their own bounded set of
+  // programs, e.g. specialized variants. key receives the cache key to pass
+  // to releaseProgram. Callers sharing the runtime get the same program for
+  // the same key, it is released once the last of them let go of it and
+  // nobody obtained it through getProgram. The disk copy stays.
+  cl_program acquireProgram(const std::string& source, const std::string& options,
+                            std::string* key);
+  cl_program acquireProgramFromFile(const std::string& file_path, const std::string& options,
+                                    std::string* key);
+  void releaseProgram(const std::string& key);
+  void clear();
+
+  // Number of programs compiled from source and loaded from disk since
+  // construction.
+  size_t compileCount() const;
+  size_t binaryLoadCount() const;
+
+  // $KUMO_CL_CACHE_DIR, else $XDG_CACHE_HOME/kumo_cl, else ~/.cache/kumo_cl.
+  // Setting KUMO_CL_CACHE_DIR to an empty string turns the disk cache off.
+  static std::string defaultCacheDir();
+
+private:
+  struct Entry {
+    cl_program program;
+    size_t holders;  // acquireProgram calls not yet released
+    bool pinned;     // handed out by getProgram, lives until clear()
+  };
+
+  Entry* findOrBuild(const std::string& source, const std::string& options,
+                     const std::string& key);
+  bool readSource(const std::string& file_path, std::string* source);
+  std::string makeKey(const std::string& source, const std::string& options) const;
+  cl_program loadBinary(const std::string& path, const std::string& options);
+  void storeBinary(cl_program program, const std::string& path);
+  bool build(cl_program program, const std::string& options);
+
+  cl_context context_;
+  cl_device_id device_;
+  std::string device_id_;
+  std::string cache_dir_;
+  std::unordered_map<std::string, Entry> programs_;
+  size_t compiles_;
+  size_t binary_loads_;
+};
+
+}
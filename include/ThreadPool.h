@@ -0,0 +1,39 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kumo {
+
+// Fixed set of worker threads for data-parallel loops on the host.
+class ThreadPool {
+public:
+  // num_threads == 0 uses std::thread::hardware_concurrency()
+  explicit ThreadPool(size_t num_threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t size() const;
+
+  // Calls fn(i) for every i in [begin, end) and blocks until all calls
+  // returned. Indices are handed out one at a time, so uneven work per index
+  // still balances across threads. The calling thread takes part as well.
+  void parallelFor(size_t begin, size_t end, const std::function<void(size_t)>& fn);
+
+private:
+  void workerLoop();
+
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_;
+};
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace kumo {
+
+// What a tuned launch configuration applies to. device should identify the
+// driver as well, e.g. "<name>|<driver version>", a driver update then
+// starts from scratch.
+struct TuningKey {
+  std::string device;
+  std::string kernel;
+  int width = 0;
+  int height = 0;
+  int radius = 0;
+  int channels = 0;
+
+  bool operator<(const TuningKey& other) const;
+};
+
+// Winner of a sweep. params is opaque here, its layout belongs to the
+// caller that tuned it.
+struct TuningResult {
+  std::vector<int> params;
+  double ms = 0.0;
+};
+
+// Tuned launch configurations persisted as a tab separated text file, one
+// entry per line. load() merges the file into memory, save() writes
+// everything back through a temporary file and a rename, so a concurrent
+// reader never sees half a file.
+class TuningDatabase {
+public:
+  // An empty path keeps the database in memory only.
+  explicit TuningDatabase(const std::string& path = defaultPath());
+
+  bool load();
+  bool save() const;
+
+  bool find(const TuningKey& key, TuningResult* result) const;
+  void store(const TuningKey& key, const TuningResult& result);
+  void clear();
+  size_t size() const;
+  const std::string& path() const;
+
+  // $KUMO_CL_TUNING_FILE, else tuning.tsv in ProgramCache::defaultCacheDir().
+  static std::string defaultPath();
+
+private:
+  std::string path_;
+  std::map<TuningKey, TuningResult> entries_;
+};
+
+}
@@ -0,0 +1,86 @@
+// Box filter cascade on summed lines. The image is split into one int line
+// per row and channel, every line padded to a pitch the host picks so that
+// scan / uniform_add from test_scan/scan.cl can turn it into an exclusive
+// prefix sum. A box of any radius is then two reads of that sum. Values
+// carry BOX_FRACTION_BITS fractional bits, so the passes do not quantize to
+// whole grey levels in between.
+
+#define BOX_FRACTION_BITS 8
+#define TRANSPOSE_TILE 16
+
+// Interleaved uchar to one line per (channel, row). Padding past width is
+// zero, the scan treats it as part of the line.
+__kernel void box_deinterleave(__global const uchar* src, __global int* lines,
+                               int width, int height, int channels, int pitch) {
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if (x >= pitch || y >= height) return;
+  for (int c = 0; c < channels; c++) {
+    lines[((size_t)c * height + y) * pitch + x] =
+      x < width ? src[((size_t)y * width + x) * channels + c] << BOX_FRACTION_BITS : 0;
+  }
+}
+
+// sat holds the exclusive prefix sum of every line, sat[i] = sum of a[0..i).
+// Taps left of the line repeat a[0] and taps right of it a[width - 1],
+// which replicates the border like the FIR kernels.
+__kernel void box_from_sat(__global const int* sat, __global int* dst,
+                           int width, int pitch, int num_lines, int radius) {
+  const int x = get_global_id(0);
+  const int line = get_global_id(1);
+  if (x >= pitch || line >= num_lines) return;
+  __global const int* s = sat + (size_t)line * pitch;
+  if (x >= width) {
+    dst[(size_t)line * pitch + x] = 0;
+    return;
+  }
+  const int lo = x - radius;
+  const int hi = x + radius + 1;
+  const int first = s[1] - s[0];
+  const int last = s[width] - s[width - 1];
+  const int sum = s[min(hi, width)] - s[max(lo, 0)] +
+                  max(-lo, 0) * first + max(hi - width, 0) * last;
+  const int taps = 2 * radius + 1;
+  dst[(size_t)line * pitch + x] = (sum + taps / 2) / taps;
+}
+
+// Transposes every plane of num_planes height x width lines into width x
+// height lines through a local tile, reads and writes stay coalesced.
+// Launched over dst_pitch in y so the padding of the new lines is zeroed.
+__kernel void box_transpose(__global const int* src, __global int* dst,
+                            int width, int height, int src_pitch, int dst_pitch) {
+  __local int tile[TRANSPOSE_TILE][TRANSPOSE_TILE + 1];
+  const int plane = get_global_id(2);
+  const int lx = get_local_id(0);
+  const int ly = get_local_id(1);
+  const int bx = get_group_id(0) * TRANSPOSE_TILE;
+  const int by = get_group_id(1) * TRANSPOSE_TILE;
+  __global const int* s = src + (size_t)plane * height * src_pitch;
+  __global int* d = dst + (size_t)plane * width * dst_pitch;
+
+  const int x = bx + lx;
+  const int y = by + ly;
+  tile[ly][lx] = x < width && y < height ? s[(size_t)y * src_pitch + x] : 0;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // dst line bx + ly, element by + lx
+  const int out_line = bx + ly;
+  const int out_x = by + lx;
+  if (out_line < width && out_x < dst_pitch) {
+    d[(size_t)out_line * dst_pitch + out_x] = tile[lx][ly];
+  }
+}
+
+// Transposed lines (one per channel and column) back to interleaved uchar,
+// rounding off the fractional bits.
+__kernel void box_interleave(__global const int* lines, __global uchar* dst,
+                             int width, int height, int channels, int pitch) {
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if (x >= width || y >= height) return;
+  for (int c = 0; c < channels; c++) {
+    const int v = lines[((size_t)c * width + x) * pitch + y];
+    dst[((size_t)y * width + x) * channels + c] =
+      convert_uchar_sat((v + (1 << (BOX_FRACTION_BITS - 1))) >> BOX_FRACTION_BITS);
+  }
+}
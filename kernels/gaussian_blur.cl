@@ -1,8 +1,43 @@
 #define KERNEL_RADIUS 15
 #define ROWS_BLOCKDIM_X 4
 #define ROWS_BLOCKDIM_Y 4
-#define CHANNEL_NUM 3
 
+// Border modes, the values match cv::BorderTypes and gaussian_blur_seperate.cl.
+#define BORDER_CONSTANT 0
+#define BORDER_REPLICATE 1
+#define BORDER_WRAP 3
+#define BORDER_REFLECT_101 4
+
+// Same mapping as border_index in gaussian_blur_seperate.cl, -1 stands for
+// the constant border value. BORDER_NONE marks a launch over the interior
+// whose taps never leave the image.
+#define BORDER_NONE -1
+
+inline int border_index(int i, int n, int border) {
+  if (i >= 0 && i < n) {
+    return i;
+  }
+  if (border == BORDER_CONSTANT) {
+    return -1;
+  }
+  if (border == BORDER_WRAP) {
+    i %= n;
+    return i < 0 ? i + n : i;
+  }
+  if (border == BORDER_REFLECT_101 && n > 1) {
+    do {
+      i = i < 0 ? -i : 2 * n - i - 2;
+    } while (i < 0 || i >= n);
+    return i;
+  }
+  return clamp(i, 0, n - 1);
+}
+
+// Interior of the image, launched with a global offset of (k_w / 2,
+// k_h / 2). No tap leaves the image, the frame within the kernel radius
+// of an edge is covered by gaussian_blur_border launches. The kernel is
+// anchored at (k_w / 2, k_h / 2) like cv::filter2D, even sizes reach one
+// tap less to the right and down. pitch / width is the channel count.
 __kernel void gaussian_blur(
   __global uchar* input,
   __global uchar* output,
@@ -16,31 +51,184 @@ __kernel void gaussian_blur(
   int x = get_global_id(0);
   int y = get_global_id(1);
 
+  int half_k_w = k_w / 2;
+  int half_k_h = k_h / 2;
+
+  if (x >= width - (k_w - 1 - half_k_w) || y >= height - (k_h - 1 - half_k_h)) {
+    return;
+  }
+
+  const int channels = pitch / width;
+  __global const uchar* corner = input + (y - half_k_h) * pitch + (x - half_k_w) * channels;
+
+  for (int c = 0; c < channels; ++c) {
+    float sum = 0.0f;
+
+    for (int ky = 0; ky < k_h; ++ky) {
+      for (int kx = 0; kx < k_w; kx++) {
+        uchar pixel = corner[ky * pitch + kx * channels + c];
+        float coeff = gaussian_kernel[ky * k_w + kx];
+        sum += (float)pixel * coeff;
+      }
+    }
+
+    int out_idx = y * pitch + x * channels + c;
+    float result = clamp(sum, 0.0f, 255.0f);
+    output[out_idx] = (uchar)result;
+  }
+
+}
+
+__kernel void gaussian_blur_border(
+  __global uchar* input,
+  __global uchar* output,
+  __global const float* gaussian_kernel,
+  int width,
+  int height,
+  int pitch,
+  int k_w,
+  int k_h,
+  int border,
+  float border_value
+) {
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+
   if (x >= width || y >= height) {
     return;
   }
 
   int half_k_w = k_w / 2;
   int half_k_h = k_h / 2;
+  const int channels = pitch / width;
 
-  for (int c = 0; c < CHANNEL_NUM; ++c) {
+  for (int c = 0; c < channels; ++c) {
     float sum = 0.0f;
 
     for (int ky = 0; ky < k_h; ++ky) {
+      int iy = border_index(y + ky - half_k_h, height, border);
       for (int kx = 0; kx < k_w; kx++) {
-        int ix = clamp(x + kx - half_k_w, 0, width - 1);
-        int iy = clamp(y + ky - half_k_h, 0, height - 1);
+        int ix = border_index(x + kx - half_k_w, width, border);
 
-        int in_idx = iy * pitch + ix * CHANNEL_NUM + c;
-        uchar pixel = input[in_idx];
+        float pixel = ix < 0 || iy < 0 ? border_value
+                                       : (float)input[iy * pitch + ix * channels + c];
         float coeff = gaussian_kernel[ky * k_w + kx];
-        sum += (float)pixel * coeff;
+        sum += pixel * coeff;
       }
     }
 
-    int out_idx = y * pitch + x * CHANNEL_NUM + c;
+    int out_idx = y * pitch + x * channels + c;
     float result = clamp(sum, 0.0f, 255.0f);
     output[out_idx] = (uchar)result;
   }
 
-}
\ No newline at end of file
+}
+
+// Low-rank passes, a kernel decomposed into separable terms runs one row
+// and one column pass per term at k_w + k_h taps per pixel instead of
+// k_w * k_h. weights holds every term as its row vector followed by its
+// column vector, term selects one. The singular vectors are signed, so
+// the intermediate and the running sum stay float. One work-item per
+// element, the host launches the interior with BORDER_NONE and the strips
+// near the edges with the border mode.
+__kernel void lowrank_rows(
+  __global const uchar* input,
+  __global float* temp,
+  __global const float* weights,
+  int width,
+  int height,
+  int pitch,
+  int k_w,
+  int border,
+  float border_value,
+  int k_h,
+  int term
+) {
+  const int e = get_global_id(0);
+  const int y = get_global_id(1);
+  if (e >= pitch || y >= height) {
+    return;
+  }
+
+  const int channels = pitch / width;
+  const int x = e / channels;
+  const int half_k_w = k_w / 2;
+  __global const float* row = weights + term * (k_w + k_h);
+  __global const uchar* line = input + y * pitch + (e - x * channels);
+
+  float sum = 0.0f;
+  if (border == BORDER_NONE) {
+    if (x >= width - (k_w - 1 - half_k_w)) {
+      return;
+    }
+    __global const uchar* first = line + (x - half_k_w) * channels;
+    for (int kx = 0; kx < k_w; ++kx) {
+      sum += (float)first[kx * channels] * row[kx];
+    }
+  } else {
+    for (int kx = 0; kx < k_w; ++kx) {
+      int ix = border_index(x + kx - half_k_w, width, border);
+      float pixel = ix < 0 ? border_value : (float)line[ix * channels];
+      sum += pixel * row[kx];
+    }
+  }
+  temp[y * pitch + e] = sum;
+}
+
+// Column pass of one term. The first term starts the sum in accum, later
+// ones add to it and the last writes bytes instead, a single term goes
+// straight to output. With BORDER_CONSTANT the host passes the border
+// value scaled by the sum of the term's row vector, the row-filtered
+// value of a constant padding.
+__kernel void lowrank_cols(
+  __global const float* temp,
+  __global uchar* output,
+  __global const float* weights,
+  int width,
+  int height,
+  int pitch,
+  int k_h,
+  int border,
+  float border_value,
+  __global float* accum,
+  int k_w,
+  int term,
+  int first,
+  int last
+) {
+  const int e = get_global_id(0);
+  const int y = get_global_id(1);
+  if (e >= pitch || y >= height) {
+    return;
+  }
+
+  const int half_k_h = k_h / 2;
+  __global const float* column = weights + term * (k_w + k_h) + k_w;
+
+  float sum = 0.0f;
+  if (border == BORDER_NONE) {
+    if (y >= height - (k_h - 1 - half_k_h)) {
+      return;
+    }
+    __global const float* top = temp + (y - half_k_h) * pitch + e;
+    for (int ky = 0; ky < k_h; ++ky) {
+      sum += top[ky * pitch] * column[ky];
+    }
+  } else {
+    for (int ky = 0; ky < k_h; ++ky) {
+      int iy = border_index(y + ky - half_k_h, height, border);
+      float pixel = iy < 0 ? border_value : temp[iy * pitch + e];
+      sum += pixel * column[ky];
+    }
+  }
+
+  const int idx = y * pitch + e;
+  if (!first) {
+    sum += accum[idx];
+  }
+  if (last) {
+    output[idx] = (uchar)clamp(sum, 0.0f, 255.0f);
+  } else {
+    accum[idx] = sum;
+  }
+}
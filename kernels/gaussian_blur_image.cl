@@ -0,0 +1,54 @@
+// Image2D separable blur. Frames live in CL_RGBA images and are read
+// through a clamp-to-edge sampler, so the hardware handles the border and
+// the unorm conversion and no per-tap clamp() is needed. With linear
+// filtering two neighbouring taps collapse into one fetch placed between
+// them at the ratio of their weights (the bilinear tap trick), a radius r
+// kernel costs r + 1 fetches per pass instead of 2r + 1. taps holds
+// (offset in pixels, weight) pairs computed on the host.
+//
+// Filtering weights are quantized by the texture unit, typically to 8 bits
+// of fraction, which is well inside the rounding of the uchar output.
+
+__constant sampler_t kLinearClampSampler =
+  CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_LINEAR;
+
+__kernel void gaussian_blur_rows_image(
+  __read_only image2d_t input,
+  __write_only image2d_t temp,
+  __constant float2* taps,
+  int num_taps
+) {
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+  if (x >= get_image_width(temp) || y >= get_image_height(temp)) {
+    return;
+  }
+
+  // pixel centers sit at .5 with unnormalized coordinates
+  float2 pos = (float2)(x + 0.5f, y + 0.5f);
+  float4 sum = (float4)(0.0f);
+  for (int i = 0; i < num_taps; ++i) {
+    sum += read_imagef(input, kLinearClampSampler, pos + (float2)(taps[i].x, 0.0f)) * taps[i].y;
+  }
+  write_imagef(temp, (int2)(x, y), sum);
+}
+
+__kernel void gaussian_blur_cols_image(
+  __read_only image2d_t temp,
+  __write_only image2d_t output,
+  __constant float2* taps,
+  int num_taps
+) {
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+  if (x >= get_image_width(output) || y >= get_image_height(output)) {
+    return;
+  }
+
+  float2 pos = (float2)(x + 0.5f, y + 0.5f);
+  float4 sum = (float4)(0.0f);
+  for (int i = 0; i < num_taps; ++i) {
+    sum += read_imagef(temp, kLinearClampSampler, pos + (float2)(0.0f, taps[i].x)) * taps[i].y;
+  }
+  write_imagef(output, (int2)(x, y), sum);
+}
@@ -0,0 +1,71 @@
+// Young-van Vliet recursive Gaussian. coeffs holds (b, a1, a2, a3) of
+//   w[n] = b * x[n] + a1 * w[n-1] + a2 * w[n-2] + a3 * w[n-3]
+// which runs causally and then anti-causally along every line. Each
+// work-item owns one line and the border replicates like the FIR kernels:
+// the causal state starts at the first sample, the anti-causal one at
+// N - 1, N and N + 1 comes from the Triggs-Sdika matrix in boundary (row
+// major, s0..s8), see RecursiveGaussian::boundary.
+
+// u is the last input sample, w1..w3 the last causal outputs on entry and
+// the anti-causal state on return.
+inline void iir_boundary(float16 boundary, float u, float* w1, float* w2, float* w3) {
+  const float d1 = *w1 - u, d2 = *w2 - u, d3 = *w3 - u;
+  *w1 = u + boundary.s0 * d1 + boundary.s1 * d2 + boundary.s2 * d3;
+  *w2 = u + boundary.s3 * d1 + boundary.s4 * d2 + boundary.s5 * d3;
+  *w3 = u + boundary.s6 * d1 + boundary.s7 * d2 + boundary.s8 * d3;
+}
+
+// One work-item per row and channel. The float result stays in temp for the
+// column pass.
+__kernel void gaussian_iir_rows(__global const uchar* src, __global float* temp,
+                                int width, int height, int channels, float4 coeffs,
+                                float16 boundary) {
+  const int gid = get_global_id(0);
+  if (gid >= height * channels) return;
+  const int y = gid / channels;
+  const int c = gid - y * channels;
+  __global const uchar* in = src + (size_t)y * width * channels + c;
+  __global float* out = temp + (size_t)y * width * channels + c;
+
+  float w1 = in[0], w2 = w1, w3 = w1;
+  for (int x = 0; x < width; x++) {
+    float w = coeffs.x * in[x * channels] + coeffs.y * w1 + coeffs.z * w2 + coeffs.w * w3;
+    out[x * channels] = w;
+    w3 = w2; w2 = w1; w1 = w;
+  }
+  iir_boundary(boundary, in[(width - 1) * channels], &w1, &w2, &w3);
+  out[(width - 1) * channels] = w1;
+  for (int x = width - 2; x >= 0; x--) {
+    float w = coeffs.x * out[x * channels] + coeffs.y * w1 + coeffs.z * w2 + coeffs.w * w3;
+    out[x * channels] = w;
+    w3 = w2; w2 = w1; w1 = w;
+  }
+}
+
+// One work-item per column element. Neighbouring work-items read
+// neighbouring addresses of the same row, so every step is coalesced. The
+// causal pass writes back into temp, the anti-causal pass writes dst.
+__kernel void gaussian_iir_cols(__global float* temp, __global uchar* dst,
+                                int width, int height, int channels, float4 coeffs,
+                                float16 boundary) {
+  const int gid = get_global_id(0);
+  const int pitch = width * channels;
+  if (gid >= pitch) return;
+  __global float* col = temp + gid;
+  // the causal pass overwrites it
+  const float last = col[(size_t)(height - 1) * pitch];
+
+  float w1 = col[0], w2 = w1, w3 = w1;
+  for (int y = 0; y < height; y++) {
+    float w = coeffs.x * col[(size_t)y * pitch] + coeffs.y * w1 + coeffs.z * w2 + coeffs.w * w3;
+    col[(size_t)y * pitch] = w;
+    w3 = w2; w2 = w1; w1 = w;
+  }
+  iir_boundary(boundary, last, &w1, &w2, &w3);
+  dst[(size_t)(height - 1) * pitch + gid] = convert_uchar_sat(w1);
+  for (int y = height - 2; y >= 0; y--) {
+    float w = coeffs.x * col[(size_t)y * pitch] + coeffs.y * w1 + coeffs.z * w2 + coeffs.w * w3;
+    dst[(size_t)y * pitch + gid] = convert_uchar_sat(w);
+    w3 = w2; w2 = w1; w1 = w;
+  }
+}
@@ -1,9 +1,115 @@
+// Interleaved channels per pixel, the host passes -DCHANNELS= when it
+// builds a specialized variant.
+#ifdef CHANNELS
+#define CHANNEL_NUM CHANNELS
+#else
 #define CHANNEL_NUM 3
+#endif
 
-// generate temp result
+// Block sizes of the tiled kernels, the host overrides them with -D options.
+// MAX_RADIUS bounds the apron that is staged into local memory.
+#ifndef ROWS_BLOCKDIM_X
+#define ROWS_BLOCKDIM_X 16
+#endif
+#ifndef ROWS_BLOCKDIM_Y
+#define ROWS_BLOCKDIM_Y 4
+#endif
+#ifndef COLS_BLOCKDIM_X
+#define COLS_BLOCKDIM_X 16
+#endif
+#ifndef COLS_BLOCKDIM_Y
+#define COLS_BLOCKDIM_Y 8
+#endif
+#ifndef MAX_RADIUS
+#define MAX_RADIUS 15
+#endif
+#ifndef FUSED_BLOCKDIM_X
+#define FUSED_BLOCKDIM_X 16
+#endif
+#ifndef FUSED_BLOCKDIM_Y
+#define FUSED_BLOCKDIM_Y 8
+#endif
+#ifndef FUSED_STEPS
+#define FUSED_STEPS 4
+#endif
+// output rows covered by one fused work-group
+#define FUSED_TILE_H (FUSED_BLOCKDIM_Y * FUSED_STEPS)
+
+// Storage format of the intermediate image written by the row pass.
+// uchar clamps and truncates between the passes, half and float keep the
+// fractional part so the column pass works on unquantized values.
+#define TEMP_FORMAT_UCHAR 0
+#define TEMP_FORMAT_HALF 1
+#define TEMP_FORMAT_FLOAT 2
+#ifndef TEMP_FORMAT
+#define TEMP_FORMAT TEMP_FORMAT_UCHAR
+#endif
+
+// The *4/*16 forms load and store whole pixels at a pointer for the RGBA
+// kernels, the pointer only needs the alignment of the element type.
+#if TEMP_FORMAT == TEMP_FORMAT_HALF
+typedef half temp_t;
+typedef float temp_tile_t;   // half is storage only, stage it as float
+#define LOAD_TEMP(p, i) vload_half((i), (p))
+#define STORE_TEMP(v, p, i) vstore_half((v), (i), (p))
+#define LOAD_TEMP4(p) vload_half4(0, (p))
+#define STORE_TEMP4(v, p) vstore_half4((v), 0, (p))
+#define LOAD_TEMP16(p) vload_half16(0, (p))
+#elif TEMP_FORMAT == TEMP_FORMAT_FLOAT
+typedef float temp_t;
+typedef float temp_tile_t;
+#define LOAD_TEMP(p, i) ((p)[i])
+#define STORE_TEMP(v, p, i) ((p)[i] = (v))
+#define LOAD_TEMP4(p) vload4(0, (p))
+#define STORE_TEMP4(v, p) vstore4((v), 0, (p))
+#define LOAD_TEMP16(p) vload16(0, (p))
+#else
+typedef uchar temp_t;
+typedef uchar temp_tile_t;
+#define LOAD_TEMP(p, i) ((p)[i])
+#define STORE_TEMP(v, p, i) ((p)[i] = (uchar)clamp((v), 0.0f, 255.0f))
+#define LOAD_TEMP4(p) convert_float4(vload4(0, (p)))
+#define STORE_TEMP4(v, p) vstore4(convert_uchar4_sat(v), 0, (p))
+#define LOAD_TEMP16(p) convert_float16(vload16(0, (p)))
+#endif
+
+// Border modes of the naive passes, the values match cv::BorderTypes.
+#define BORDER_CONSTANT 0
+#define BORDER_REPLICATE 1
+#define BORDER_WRAP 3
+#define BORDER_REFLECT_101 4
+
+// Maps a tap index outside [0, n) back into the image like
+// cv::borderInterpolate, -1 stands for the constant border value.
+inline int border_index(int i, int n, int border) {
+  if (i >= 0 && i < n) {
+    return i;
+  }
+  if (border == BORDER_CONSTANT) {
+    return -1;
+  }
+  if (border == BORDER_WRAP) {
+    i %= n;
+    return i < 0 ? i + n : i;
+  }
+  if (border == BORDER_REFLECT_101 && n > 1) {
+    // radii beyond the image size reflect more than once
+    do {
+      i = i < 0 ? -i : 2 * n - i - 2;
+    } while (i < 0 || i >= n);
+    return i;
+  }
+  return clamp(i, 0, n - 1);
+}
+
+// The naive passes are split by the host into an interior launch and thin
+// border launches. The interior launch starts at a global offset of
+// k / 2, every tap of it stays inside the image and needs no bounds check,
+// the strips within k / 2 of an edge go to the *_border kernels. pitch /
+// width is the channel count, so 3 and 4 channel images share them.
 __kernel void gaussian_blur_rows(
   __global uchar* input,
-  __global uchar* temp,
+  __global temp_t* temp,
   __constant float* kernel1d,
   int width,
   int height,
@@ -12,66 +118,665 @@ __kernel void gaussian_blur_rows(
 ) {
   int x = get_global_id(0);
   int y = get_global_id(1); 
+  int half_k_w = k_w / 2;
+
+  // a fixed local size rounds the grid up past the interior
+  if (x >= width - half_k_w || y >= height) {
+    return;
+  }
+
+  const int channels = pitch / width;
+  __global const uchar* row = input + y * pitch + (x - half_k_w) * channels;
+
+  for (int c = 0; c < channels; ++c) {
+    float sum = 0.0f;
+    for (int kx = 0; kx < k_w; kx++) {
+      sum += (float)row[kx * channels + c] * kernel1d[kx];
+    }
+
+    int out_idx = y * pitch + x * channels + c;
+    STORE_TEMP(sum, temp, out_idx);
+  }
+}
+
+__kernel void gaussian_blur_rows_border(
+  __global uchar* input,
+  __global temp_t* temp,
+  __constant float* kernel1d,
+  int width,
+  int height,
+  int pitch,
+  int k_w,
+  int border,
+  float border_value
+) {
+  int x = get_global_id(0);
+  int y = get_global_id(1);
 
   if (x >= width || y >= height) {
     return;
   }
 
   int half_k_w = k_w / 2;
+  const int channels = pitch / width;
+
+  for (int c = 0; c < channels; ++c) {
+    float sum = 0.0f;
+    for (int kx = 0; kx < k_w; kx++) {
+      int ix = border_index(x + kx - half_k_w, width, border);
+      float pixel = ix < 0 ? border_value : (float)input[y * pitch + ix * channels + c];
+      sum += pixel * kernel1d[kx];
+    }
+
+    int out_idx = y * pitch + x * channels + c;
+    STORE_TEMP(sum, temp, out_idx);
+  }
+}
+
+__kernel void gaussian_blur_cols(
+  __global temp_t* temp,
+  __global uchar* output,
+  __constant float* kernel1d,
+  int width,
+  int height,
+  int pitch,
+  int k_h
+) {
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+  int half_k_h = k_h / 2;
+
+  if (x >= width || y >= height - half_k_h) {
+    return;
+  }
+
+  const int channels = pitch / width;
+  const int top = (y - half_k_h) * pitch;
+
+  for (int c = 0; c < channels; ++c) {
+    float sum = 0.0f;
+    for (int ky = 0; ky < k_h; ky++) {
+      float pixel = LOAD_TEMP(temp, top + ky * pitch + x * channels + c);
+      sum += pixel * kernel1d[ky];
+    }
+
+    int out_idx = y * pitch + x * channels + c;
+    float result = clamp(sum, 0.0f, 255.0f);
+    output[out_idx] = (uchar)result;
+  }
+}
+
+// The constant border is applied to the row-filtered image, which for a
+// normalized kernel equals filtering a constant padded input.
+__kernel void gaussian_blur_cols_border(
+  __global temp_t* temp,
+  __global uchar* output,
+  __constant float* kernel1d,
+  int width,
+  int height,
+  int pitch,
+  int k_h,
+  int border,
+  float border_value
+) {
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+
+  if (x >= width || y >= height) {
+    return;
+  }
+
+  int half_k_h = k_h / 2;
+  const int channels = pitch / width;
+
+  for (int c = 0; c < channels; ++c) {
+    float sum = 0.0f;
+    for (int ky = 0; ky < k_h; ky++) {
+      int iy = border_index(y + ky - half_k_h, height, border);
+      float pixel = iy < 0 ? border_value : LOAD_TEMP(temp, iy * pitch + x * channels + c);
+      sum += pixel * kernel1d[ky];
+    }
+
+    int out_idx = y * pitch + x * channels + c;
+    float result = clamp(sum, 0.0f, 255.0f);
+    output[out_idx] = (uchar)result;
+  }
+}
+
+// Tiled row pass: each work-group stages ROWS_BLOCKDIM_Y rows of
+// ROWS_BLOCKDIM_X pixels plus the left/right apron into local memory, so
+// every input byte is read from global memory once instead of k_w times.
+// The global size is rounded up to the block size, out of range items still
+// take part in the load and the barrier.
+__kernel __attribute__((reqd_work_group_size(ROWS_BLOCKDIM_X, ROWS_BLOCKDIM_Y, 1)))
+void gaussian_blur_rows_tiled(
+  __global const uchar* input,
+  __global temp_t* temp,
+  __constant float* kernel1d,
+  int width,
+  int height,
+  int pitch,
+  int k_w
+) {
+  __local uchar tile[ROWS_BLOCKDIM_Y][(ROWS_BLOCKDIM_X + 2 * MAX_RADIUS) * CHANNEL_NUM];
+
+  int lx = get_local_id(0);
+  int ly = get_local_id(1);
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+
+  int half_k_w = k_w / 2;
+  int tile_x0 = get_group_id(0) * ROWS_BLOCKDIM_X - half_k_w;
+  int tile_bytes = (ROWS_BLOCKDIM_X + 2 * half_k_w) * CHANNEL_NUM;
+  int iy = min(y, height - 1);
+
+  // consecutive work-items read consecutive bytes of the row
+  for (int i = lx; i < tile_bytes; i += ROWS_BLOCKDIM_X) {
+    int ix = clamp(tile_x0 + i / CHANNEL_NUM, 0, width - 1);
+    tile[ly][i] = input[iy * pitch + ix * CHANNEL_NUM + i % CHANNEL_NUM];
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (x >= width || y >= height) {
+    return;
+  }
 
   for (int c = 0; c < CHANNEL_NUM; ++c) {
     float sum = 0.0f;
     for (int kx = 0; kx < k_w; kx++) {
-      // calculate row covolution
-      int ix = clamp(x + kx - half_k_w, 0, width - 1);
-      int iy = y;
+      sum += (float)tile[ly][(lx + kx) * CHANNEL_NUM + c] * kernel1d[kx];
+    }
+
+    int out_idx = y * pitch + x * CHANNEL_NUM + c;
+    STORE_TEMP(sum, temp, out_idx);
+  }
+}
+
+// Tiled column pass: the block plus the top/bottom apron is staged into
+// local memory, then each work-item walks down its own column.
+__kernel __attribute__((reqd_work_group_size(COLS_BLOCKDIM_X, COLS_BLOCKDIM_Y, 1)))
+void gaussian_blur_cols_tiled(
+  __global const temp_t* temp,
+  __global uchar* output,
+  __constant float* kernel1d,
+  int width,
+  int height,
+  int pitch,
+  int k_h
+) {
+  __local temp_tile_t tile[COLS_BLOCKDIM_Y + 2 * MAX_RADIUS][COLS_BLOCKDIM_X * CHANNEL_NUM];
 
-      int in_idx = iy * pitch + ix * CHANNEL_NUM + c;
-      uchar pixel = input[in_idx];
-      float coeff = kernel1d[kx];
-      sum += (float)pixel * coeff;
+  int lx = get_local_id(0);
+  int ly = get_local_id(1);
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+
+  int half_k_h = k_h / 2;
+  int tile_x0 = get_group_id(0) * COLS_BLOCKDIM_X;
+  int tile_y0 = get_group_id(1) * COLS_BLOCKDIM_Y - half_k_h;
+  int tile_rows = COLS_BLOCKDIM_Y + 2 * half_k_h;
+  int row_bytes = COLS_BLOCKDIM_X * CHANNEL_NUM;
+
+  for (int i = ly * COLS_BLOCKDIM_X + lx; i < tile_rows * row_bytes;
+       i += COLS_BLOCKDIM_X * COLS_BLOCKDIM_Y) {
+    int r = i / row_bytes;
+    int b = i % row_bytes;
+    int ix = min(tile_x0 + b / CHANNEL_NUM, width - 1);
+    int iy = clamp(tile_y0 + r, 0, height - 1);
+    tile[r][b] = LOAD_TEMP(temp, iy * pitch + ix * CHANNEL_NUM + b % CHANNEL_NUM);
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (x >= width || y >= height) {
+    return;
+  }
+
+  for (int c = 0; c < CHANNEL_NUM; ++c) {
+    float sum = 0.0f;
+    for (int ky = 0; ky < k_h; ky++) {
+      sum += (float)tile[ly + ky][lx * CHANNEL_NUM + c] * kernel1d[ky];
     }
 
     int out_idx = y * pitch + x * CHANNEL_NUM + c;
     float result = clamp(sum, 0.0f, 255.0f);
-    temp[out_idx] = (uchar)result;
+    output[out_idx] = (uchar)result;
   }
 }
 
-__kernel void gaussian_blur_cols(
-  __global uchar* temp,
+// Fused row + column pass. A work-group stages its FUSED_BLOCKDIM_X x
+// FUSED_TILE_H block plus the apron on all four sides into local memory,
+// row-filters every staged row into a float tile and then runs the column
+// filter on that tile, so the intermediate image never touches global memory.
+// Each work-item slides down FUSED_STEPS consecutive rows of its column in
+// the last phase.
+__kernel __attribute__((reqd_work_group_size(FUSED_BLOCKDIM_X, FUSED_BLOCKDIM_Y, 1)))
+void gaussian_blur_fused(
+  __global const uchar* input,
   __global uchar* output,
   __constant float* kernel1d,
   int width,
   int height,
   int pitch,
-  int k_h
+  int k
+) {
+  __local uchar src[FUSED_TILE_H + 2 * MAX_RADIUS][(FUSED_BLOCKDIM_X + 2 * MAX_RADIUS) * CHANNEL_NUM];
+  __local float rows[FUSED_TILE_H + 2 * MAX_RADIUS][FUSED_BLOCKDIM_X * CHANNEL_NUM];
+
+  int lx = get_local_id(0);
+  int ly = get_local_id(1);
+  int flat_id = ly * FUSED_BLOCKDIM_X + lx;
+  int group_items = FUSED_BLOCKDIM_X * FUSED_BLOCKDIM_Y;
+
+  int half_k = k / 2;
+  int x0 = get_group_id(0) * FUSED_BLOCKDIM_X;
+  int y0 = get_group_id(1) * FUSED_TILE_H;
+  int tile_rows = FUSED_TILE_H + 2 * half_k;
+  int src_bytes = (FUSED_BLOCKDIM_X + 2 * half_k) * CHANNEL_NUM;
+  int row_bytes = FUSED_BLOCKDIM_X * CHANNEL_NUM;
+
+  // 1. block plus apron, borders replicate the edge pixels
+  for (int i = flat_id; i < tile_rows * src_bytes; i += group_items) {
+    int r = i / src_bytes;
+    int b = i % src_bytes;
+    int ix = clamp(x0 - half_k + b / CHANNEL_NUM, 0, width - 1);
+    int iy = clamp(y0 - half_k + r, 0, height - 1);
+    src[r][b] = input[iy * pitch + ix * CHANNEL_NUM + b % CHANNEL_NUM];
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // 2. row filter, including the top/bottom apron rows the column pass needs
+  for (int i = flat_id; i < tile_rows * row_bytes; i += group_items) {
+    int r = i / row_bytes;
+    int b = i % row_bytes;
+    int px = b / CHANNEL_NUM;
+    int c = b % CHANNEL_NUM;
+    float sum = 0.0f;
+    for (int kx = 0; kx < k; kx++) {
+      sum += (float)src[r][(px + kx) * CHANNEL_NUM + c] * kernel1d[kx];
+    }
+    rows[r][b] = sum;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // 3. column filter
+  int x = x0 + lx;
+  if (x >= width) {
+    return;
+  }
+
+  for (int step = 0; step < FUSED_STEPS; ++step) {
+    int ry = ly * FUSED_STEPS + step;
+    int y = y0 + ry;
+    if (y >= height) {
+      return;
+    }
+
+    for (int c = 0; c < CHANNEL_NUM; ++c) {
+      float sum = 0.0f;
+      for (int ky = 0; ky < k; ky++) {
+        sum += rows[ry + ky][lx * CHANNEL_NUM + c] * kernel1d[ky];
+      }
+
+      int out_idx = y * pitch + x * CHANNEL_NUM + c;
+      float result = clamp(sum, 0.0f, 255.0f);
+      output[out_idx] = (uchar)result;
+    }
+  }
+}
+
+// RGBA row pass: one pixel per work-item, every tap is a single uchar4 load
+// feeding a float4 accumulator, which maps directly onto SIMD lanes on CPU
+// devices. pitch is in bytes, i.e. width * 4 for packed input.
+__kernel void gaussian_blur_rows_rgba(
+  __global const uchar* input,
+  __global temp_t* temp,
+  __constant float* kernel1d,
+  int width,
+  int height,
+  int pitch,
+  int k_w
 ) {
   int x = get_global_id(0);
   int y = get_global_id(1);
 
-  if (x>= width || y >= height) {
+  if (x >= width || y >= height) {
+    return;
+  }
+
+  int half_k_w = k_w / 2;
+  __global const uchar* row = input + y * pitch;
+
+  float4 sum = (float4)(0.0f);
+  for (int kx = 0; kx < k_w; kx++) {
+    int ix = clamp(x + kx - half_k_w, 0, width - 1);
+    sum += convert_float4(vload4(ix, row)) * kernel1d[kx];
+  }
+
+  STORE_TEMP4(sum, temp + y * pitch + x * 4);
+}
+
+// RGBA column pass: four adjacent pixels per work-item, so every tap is one
+// 16-byte vector load along the row. The last partial group of a row falls
+// back to one float4 per pixel.
+__kernel void gaussian_blur_cols_rgba(
+  __global const temp_t* temp,
+  __global uchar* output,
+  __constant float* kernel1d,
+  int width,
+  int height,
+  int pitch,
+  int k_h
+) {
+  int x = get_global_id(0) * 4;
+  int y = get_global_id(1);
+
+  if (x >= width || y >= height) {
     return;
   }
 
   int half_k_h = k_h / 2;
 
+  if (x + 4 <= width) {
+    float16 sum = (float16)(0.0f);
+    for (int ky = 0; ky < k_h; ky++) {
+      int iy = clamp(y + ky - half_k_h, 0, height - 1);
+      sum += LOAD_TEMP16(temp + iy * pitch + x * 4) * kernel1d[ky];
+    }
+    vstore16(convert_uchar16_sat(sum), 0, output + y * pitch + x * 4);
+    return;
+  }
+
+  for (int px = x; px < width; ++px) {
+    float4 sum = (float4)(0.0f);
+    for (int ky = 0; ky < k_h; ky++) {
+      int iy = clamp(y + ky - half_k_h, 0, height - 1);
+      sum += LOAD_TEMP4(temp + iy * pitch + px * 4) * kernel1d[ky];
+    }
+    vstore4(convert_uchar4_sat(sum), 0, output + y * pitch + px * 4);
+  }
+}
+
+// Batched passes: many images packed back to back in one buffer, one
+// work-item per pixel over the whole batch. images[i] holds
+// (element offset, width, height, first pixel index) of image i and is
+// sorted by first pixel index, so a binary search finds the image a
+// work-item belongs to. Every image is tightly packed (pitch = width * 3).
+inline int find_batch_image(__global const int4* images, int num_images, int pixel) {
+  int lo = 0;
+  int hi = num_images - 1;
+  while (lo < hi) {
+    int mid = (lo + hi + 1) >> 1;
+    if (images[mid].w <= pixel) lo = mid;
+    else hi = mid - 1;
+  }
+  return lo;
+}
+
+__kernel void gaussian_blur_rows_batch(
+  __global const uchar* input,
+  __global temp_t* temp,
+  __constant float* kernel1d,
+  __global const int4* images,
+  int num_images,
+  int total_pixels,
+  int k_w
+) {
+  int gid = get_global_id(0);
+  if (gid >= total_pixels) {
+    return;
+  }
+
+  int4 image = images[find_batch_image(images, num_images, gid)];
+  int width = image.y;
+  int local_idx = gid - image.w;
+  int x = local_idx % width;
+  int y = local_idx / width;
+  int pitch = width * CHANNEL_NUM;
+  __global const uchar* src = input + image.x + y * pitch;
+  __global temp_t* dst = temp + image.x + y * pitch;
+
+  int half_k_w = k_w / 2;
+  for (int c = 0; c < CHANNEL_NUM; ++c) {
+    float sum = 0.0f;
+    for (int kx = 0; kx < k_w; kx++) {
+      int ix = clamp(x + kx - half_k_w, 0, width - 1);
+      sum += (float)src[ix * CHANNEL_NUM + c] * kernel1d[kx];
+    }
+    STORE_TEMP(sum, dst, x * CHANNEL_NUM + c);
+  }
+}
+
+__kernel void gaussian_blur_cols_batch(
+  __global const temp_t* temp,
+  __global uchar* output,
+  __constant float* kernel1d,
+  __global const int4* images,
+  int num_images,
+  int total_pixels,
+  int k_h
+) {
+  int gid = get_global_id(0);
+  if (gid >= total_pixels) {
+    return;
+  }
+
+  int4 image = images[find_batch_image(images, num_images, gid)];
+  int width = image.y;
+  int height = image.z;
+  int local_idx = gid - image.w;
+  int x = local_idx % width;
+  int y = local_idx / width;
+  int pitch = width * CHANNEL_NUM;
+  __global const temp_t* src = temp + image.x + x * CHANNEL_NUM;
+
+  int half_k_h = k_h / 2;
   for (int c = 0; c < CHANNEL_NUM; ++c) {
     float sum = 0.0f;
     for (int ky = 0; ky < k_h; ky++) {
-      // calculate column covolution
-      int ix = x;
       int iy = clamp(y + ky - half_k_h, 0, height - 1);
+      sum += LOAD_TEMP(src, iy * pitch + c) * kernel1d[ky];
+    }
+    output[image.x + y * pitch + x * CHANNEL_NUM + c] = (uchar)clamp(sum, 0.0f, 255.0f);
+  }
+}
+
+#ifdef RADIUS
+// Specialized passes, built per (radius, coefficients, channels) with
+// -DRADIUS=, -DCHANNELS= and -DCOEFFS= holding the 2 * RADIUS + 1 taps as
+// float literals. With the tap count known at compile time the loops are
+// fully unrolled and the coefficients become immediates. kernel1d is only
+// kept so the argument list matches the other kernels.
+#define FIXED_TAPS (2 * RADIUS + 1)
+__constant float kFixedCoeffs[FIXED_TAPS] = { COEFFS };
+
+__kernel void gaussian_blur_rows_fixed(
+  __global const uchar* input,
+  __global temp_t* temp,
+  __constant float* kernel1d,
+  int width,
+  int height,
+  int pitch,
+  int k_w
+) {
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+  if (x >= width || y >= height) {
+    return;
+  }
 
-      int in_idx = iy * pitch + ix * CHANNEL_NUM + c;
-      uchar pixel = temp[in_idx];
-      float coeff = kernel1d[ky];
-      sum += (float)pixel * coeff;
+  __global const uchar* row = input + y * pitch;
+  float sum[CHANNEL_NUM];
+  #pragma unroll
+  for (int c = 0; c < CHANNEL_NUM; ++c) sum[c] = 0.0f;
+
+  #pragma unroll
+  for (int kx = 0; kx < FIXED_TAPS; kx++) {
+    int ix = clamp(x + kx - RADIUS, 0, width - 1);
+    #pragma unroll
+    for (int c = 0; c < CHANNEL_NUM; ++c) {
+      sum[c] += (float)row[ix * CHANNEL_NUM + c] * kFixedCoeffs[kx];
     }
+  }
 
-    int out_idx = y * pitch + x * CHANNEL_NUM + c;
-    float result = clamp(sum, 0.0f, 255.0f);
-    output[out_idx] = (uchar)result;
+  #pragma unroll
+  for (int c = 0; c < CHANNEL_NUM; ++c) {
+    STORE_TEMP(sum[c], temp, y * pitch + x * CHANNEL_NUM + c);
+  }
+}
+
+__kernel void gaussian_blur_cols_fixed(
+  __global const temp_t* temp,
+  __global uchar* output,
+  __constant float* kernel1d,
+  int width,
+  int height,
+  int pitch,
+  int k_h
+) {
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+  if (x >= width || y >= height) {
+    return;
+  }
+
+  float sum[CHANNEL_NUM];
+  #pragma unroll
+  for (int c = 0; c < CHANNEL_NUM; ++c) sum[c] = 0.0f;
+
+  #pragma unroll
+  for (int ky = 0; ky < FIXED_TAPS; ky++) {
+    int iy = clamp(y + ky - RADIUS, 0, height - 1);
+    #pragma unroll
+    for (int c = 0; c < CHANNEL_NUM; ++c) {
+      sum[c] += LOAD_TEMP(temp, iy * pitch + x * CHANNEL_NUM + c) * kFixedCoeffs[ky];
+    }
+  }
+
+  #pragma unroll
+  for (int c = 0; c < CHANNEL_NUM; ++c) {
+    output[y * pitch + x * CHANNEL_NUM + c] = (uchar)clamp(sum[c], 0.0f, 255.0f);
+  }
+}
+#endif
+
+// Folded passes, mirrored taps are added before the multiply,
+// (p[-k] + p[k]) * w[k], which halves the multiplies of the naive passes.
+// One work-item per element of a row, pitch / width is the channel count,
+// so 3 and 4 channel images share the kernels. The host only picks them
+// for symmetric kernels.
+__kernel void gaussian_blur_rows_folded(
+  __global const uchar* input,
+  __global temp_t* temp,
+  __constant float* kernel1d,
+  int width,
+  int height,
+  int pitch,
+  int k_w
+) {
+  const int e = get_global_id(0);
+  const int y = get_global_id(1);
+  if (e >= pitch || y >= height) {
+    return;
+  }
+
+  const int channels = pitch / width;
+  const int x = e / channels;
+  const int radius = k_w / 2;
+  __global const uchar* row = input + y * pitch + (e - x * channels);
 
+  float sum = kernel1d[radius] * row[x * channels];
+  for (int k = 1; k <= radius; ++k) {
+    const int left = max(x - k, 0);
+    const int right = min(x + k, width - 1);
+    sum += kernel1d[radius + k] * (float)(row[left * channels] + row[right * channels]);
   }
-}
\ No newline at end of file
+  STORE_TEMP(sum, temp, y * pitch + e);
+}
+
+__kernel void gaussian_blur_cols_folded(
+  __global const temp_t* temp,
+  __global uchar* output,
+  __constant float* kernel1d,
+  int width,
+  int height,
+  int pitch,
+  int k_h
+) {
+  const int e = get_global_id(0);
+  const int y = get_global_id(1);
+  if (e >= pitch || y >= height) {
+    return;
+  }
+
+  const int radius = k_h / 2;
+  float sum = kernel1d[radius] * LOAD_TEMP(temp, y * pitch + e);
+  for (int k = 1; k <= radius; ++k) {
+    const int up = max(y - k, 0);
+    const int down = min(y + k, height - 1);
+    sum += kernel1d[radius + k] *
+           (LOAD_TEMP(temp, up * pitch + e) + LOAD_TEMP(temp, down * pitch + e));
+  }
+  output[y * pitch + e] = (uchar)clamp(sum, 0.0f, 255.0f);
+}
+
+// Fixed-point folded passes. weights holds the Q0.16 center and one side,
+// weights[k] for offsets 0..k / 2, see quantizeKernelQ16. The row pass
+// rounds its Q8.16 sums to a Q8.8 ushort intermediate, the column pass its
+// Q16.24 sums to bytes. For weights summing to at most 1 neither overflows
+// 32 bits, the results match CpuArithmetic::kFixedPoint bit for bit.
+#define Q_ROW_SHIFT 8
+#define Q_COL_SHIFT 24
+
+__kernel void gaussian_blur_rows_q16(
+  __global const uchar* input,
+  __global ushort* temp,
+  __constant ushort* weights,
+  int width,
+  int height,
+  int pitch,
+  int k_w
+) {
+  const int e = get_global_id(0);
+  const int y = get_global_id(1);
+  if (e >= pitch || y >= height) {
+    return;
+  }
+
+  const int channels = pitch / width;
+  const int x = e / channels;
+  const int radius = k_w / 2;
+  __global const uchar* row = input + y * pitch + (e - x * channels);
+
+  uint acc = (1u << (Q_ROW_SHIFT - 1)) + weights[0] * (uint)row[x * channels];
+  for (int k = 1; k <= radius; ++k) {
+    const int left = max(x - k, 0);
+    const int right = min(x + k, width - 1);
+    acc += weights[k] * (uint)(row[left * channels] + row[right * channels]);
+  }
+  temp[y * pitch + e] = (ushort)(acc >> Q_ROW_SHIFT);
+}
+
+__kernel void gaussian_blur_cols_q16(
+  __global const ushort* temp,
+  __global uchar* output,
+  __constant ushort* weights,
+  int width,
+  int height,
+  int pitch,
+  int k_h
+) {
+  const int e = get_global_id(0);
+  const int y = get_global_id(1);
+  if (e >= pitch || y >= height) {
+    return;
+  }
+
+  const int radius = k_h / 2;
+  uint acc = (1u << (Q_COL_SHIFT - 1)) + weights[0] * (uint)temp[y * pitch + e];
+  for (int k = 1; k <= radius; ++k) {
+    const int up = max(y - k, 0);
+    const int down = min(y + k, height - 1);
+    acc += weights[k] * ((uint)temp[up * pitch + e] + temp[down * pitch + e]);
+  }
+  output[y * pitch + e] = (uchar)(acc >> Q_COL_SHIFT);
+}
@@ -0,0 +1,53 @@
+#include "BufferPool.h"
+#include <glog/logging.h>
+
+namespace kumo {
+
+BufferPool::BufferPool(cl_context context)
+  : context_(context), allocations_(0) {}
+
+BufferPool::~BufferPool() {
+  clear();
+}
+
+void BufferPool::setContext(cl_context context) {
+  clear();
+  context_ = context;
+}
+
+cl_mem BufferPool::acquire(const std::string& slot, size_t size, cl_mem_flags flags,
+                           void* host_ptr) {
+  auto it = slots_.find(slot);
+  if (it != slots_.end()) {
+    if (it->second.size == size && it->second.flags == flags &&
+        it->second.host_ptr == host_ptr) {
+      return it->second.mem;
+    }
+    // geometry changed, drop the stale buffer
+    clReleaseMemObject(it->second.mem);
+    slots_.erase(it);
+  }
+
+  cl_int err;
+  cl_mem mem = clCreateBuffer(context_, flags, size, host_ptr, &err);
+  if (!mem || err != CL_SUCCESS) {
+    LOG(ERROR) << "Failed to create pooled buffer '" << slot << "' of " << size << " bytes.\n";
+    return nullptr;
+  }
+  ++allocations_;
+  slots_[slot] = Entry{mem, size, flags, host_ptr};
+  return mem;
+}
+
+void BufferPool::clear() {
+  for (auto& kv : slots_) {
+    clReleaseMemObject(kv.second.mem);
+  }
+  slots_.clear();
+}
+
+size_t BufferPool::allocationCount() const {
+  return allocations_;
+}
+
+}
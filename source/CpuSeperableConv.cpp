@@ -0,0 +1,692 @@
+#include "CpuSeperableConv.h"
+#include <algorithm>
+#include <cstdlib>
+#include <glog/logging.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KUMO_CPU_X86 1
+#endif
+
+namespace kumo {
+
+namespace {
+
+enum class SimdLevel { kScalar, kAVX2, kAVX512 };
+
+SimdLevel detectSimdLevel() {
+#ifdef KUMO_CPU_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return SimdLevel::kAVX512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SimdLevel::kAVX2;
+#endif
+  return SimdLevel::kScalar;
+}
+
+const SimdLevel kSimdLevel = detectSimdLevel();
+
+// Row pass over flat interleaved elements i in [begin, end):
+//   out[i] = sum_k w[k] * in[i + (k - radius) * step]
+// step is the channel count, so every tap of every element stays in the row.
+void rowInteriorScalar(const uint8_t* in, float* out, size_t begin, size_t end,
+                       const float* w, int taps, int step) {
+  const size_t apron = (size_t)(taps / 2) * step;
+  for (size_t i = begin; i < end; ++i) {
+    const uint8_t* p = in + i - apron;
+    float sum = 0.0f;
+    for (int k = 0; k < taps; ++k) {
+      sum += w[k] * p[k * step];
+    }
+    out[i] = sum;
+  }
+}
+
+// Column pass over one output row, rows[k] is the row-filtered source of tap k.
+void colScalar(const float* const* rows, uint8_t* out, size_t begin, size_t end,
+               const float* w, int taps) {
+  for (size_t i = begin; i < end; ++i) {
+    float sum = 0.0f;
+    for (int k = 0; k < taps; ++k) {
+      sum += w[k] * rows[k][i];
+    }
+    out[i] = (uint8_t)std::min(std::max(sum, 0.0f), 255.0f);
+  }
+}
+
+// Folded passes, w points at the center weight and w[k] weighs both
+// samples k steps away. Mirrored bytes are added as integers, exactly.
+void rowInteriorFoldedScalar(const uint8_t* in, float* out, size_t begin, size_t end,
+                             const float* w, int radius, int step) {
+  for (size_t i = begin; i < end; ++i) {
+    const uint8_t* p = in + i;
+    float sum = w[0] * p[0];
+    for (int k = 1; k <= radius; ++k) {
+      sum += w[k] * (p[-k * step] + p[k * step]);
+    }
+    out[i] = sum;
+  }
+}
+
+// rows[radius] is the center row
+void colFoldedScalar(const float* const* rows, uint8_t* out, size_t begin, size_t end,
+                     const float* w, int radius) {
+  for (size_t i = begin; i < end; ++i) {
+    float sum = w[0] * rows[radius][i];
+    for (int k = 1; k <= radius; ++k) {
+      sum += w[k] * (rows[radius - k][i] + rows[radius + k][i]);
+    }
+    out[i] = (uint8_t)std::min(std::max(sum, 0.0f), 255.0f);
+  }
+}
+
+// Fixed-point passes with Q0.16 weights q[0..radius]. The row pass rounds
+// Q8.16 sums to the Q8.8 intermediate, the column pass Q16.24 sums to
+// bytes. Both stay below 2^32 for weights summing to at most 1.
+constexpr int kRowShift = kWeightFractionBits - kTempFractionBits;
+constexpr int kColShift = kWeightFractionBits + kTempFractionBits;
+constexpr uint32_t kRowRound = 1u << (kRowShift - 1);
+constexpr uint32_t kColRound = 1u << (kColShift - 1);
+
+void rowInteriorFixedScalar(const uint8_t* in, uint16_t* out, size_t begin, size_t end,
+                            const uint16_t* q, int radius, int step) {
+  for (size_t i = begin; i < end; ++i) {
+    const uint8_t* p = in + i;
+    uint32_t acc = kRowRound + q[0] * (uint32_t)p[0];
+    for (int k = 1; k <= radius; ++k) {
+      acc += q[k] * (uint32_t)(p[-k * step] + p[k * step]);
+    }
+    out[i] = (uint16_t)(acc >> kRowShift);
+  }
+}
+
+void colFixedScalar(const uint16_t* const* rows, uint8_t* out, size_t begin, size_t end,
+                    const uint16_t* q, int radius) {
+  for (size_t i = begin; i < end; ++i) {
+    uint32_t acc = kColRound + q[0] * (uint32_t)rows[radius][i];
+    for (int k = 1; k <= radius; ++k) {
+      acc += q[k] * ((uint32_t)rows[radius - k][i] + rows[radius + k][i]);
+    }
+    out[i] = (uint8_t)(acc >> kColShift);
+  }
+}
+
+#ifdef KUMO_CPU_X86
+__attribute__((target("avx2,fma")))
+void rowInteriorAVX2(const uint8_t* in, float* out, size_t begin, size_t end,
+                     const float* w, int taps, int step) {
+  const size_t apron = (size_t)(taps / 2) * step;
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    const uint8_t* p = in + i - apron;
+    __m256 acc = _mm256_setzero_ps();
+    for (int k = 0; k < taps; ++k) {
+      __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + k * step));
+      __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+      acc = _mm256_fmadd_ps(_mm256_set1_ps(w[k]), v, acc);
+    }
+    _mm256_storeu_ps(out + i, acc);
+  }
+  rowInteriorScalar(in, out, i, end, w, taps, step);
+}
+
+__attribute__((target("avx2,fma")))
+void colAVX2(const float* const* rows, uint8_t* out, size_t begin, size_t end,
+             const float* w, int taps) {
+  const __m256 lo = _mm256_setzero_ps();
+  const __m256 hi = _mm256_set1_ps(255.0f);
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 acc = _mm256_setzero_ps();
+    for (int k = 0; k < taps; ++k) {
+      acc = _mm256_fmadd_ps(_mm256_set1_ps(w[k]), _mm256_loadu_ps(rows[k] + i), acc);
+    }
+    __m256i v = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(acc, lo), hi));
+    __m128i v16 = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(v16, v16));
+  }
+  colScalar(rows, out, i, end, w, taps);
+}
+
+__attribute__((target("avx2,fma")))
+void rowInteriorFoldedAVX2(const uint8_t* in, float* out, size_t begin, size_t end,
+                           const float* w, int radius, int step) {
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    const uint8_t* p = in + i;
+    __m256i center = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+    __m256 acc = _mm256_mul_ps(_mm256_set1_ps(w[0]), _mm256_cvtepi32_ps(center));
+    for (int k = 1; k <= radius; ++k) {
+      __m256i a = _mm256_cvtepu8_epi32(
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p - k * step)));
+      __m256i b = _mm256_cvtepu8_epi32(
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + k * step)));
+      acc = _mm256_fmadd_ps(_mm256_set1_ps(w[k]),
+                            _mm256_cvtepi32_ps(_mm256_add_epi32(a, b)), acc);
+    }
+    _mm256_storeu_ps(out + i, acc);
+  }
+  rowInteriorFoldedScalar(in, out, i, end, w, radius, step);
+}
+
+__attribute__((target("avx2,fma")))
+void colFoldedAVX2(const float* const* rows, uint8_t* out, size_t begin, size_t end,
+                   const float* w, int radius) {
+  const __m256 lo = _mm256_setzero_ps();
+  const __m256 hi = _mm256_set1_ps(255.0f);
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 acc = _mm256_mul_ps(_mm256_set1_ps(w[0]), _mm256_loadu_ps(rows[radius] + i));
+    for (int k = 1; k <= radius; ++k) {
+      __m256 pair = _mm256_add_ps(_mm256_loadu_ps(rows[radius - k] + i),
+                                  _mm256_loadu_ps(rows[radius + k] + i));
+      acc = _mm256_fmadd_ps(_mm256_set1_ps(w[k]), pair, acc);
+    }
+    __m256i v = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(acc, lo), hi));
+    __m128i v16 = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(v16, v16));
+  }
+  colFoldedScalar(rows, out, i, end, w, radius);
+}
+
+// 16 elements per register. mullo/mulhi give the low and high halves of
+// the exact 16 x 16 bit products, unpacking them yields 32-bit sums of
+// elements 0-3 and 8-11 in lo and 4-7 and 12-15 in hi, which packus puts
+// back in order.
+__attribute__((target("avx2")))
+void rowInteriorFixedAVX2(const uint8_t* in, uint16_t* out, size_t begin, size_t end,
+                          const uint16_t* q, int radius, int step) {
+  const __m256i round = _mm256_set1_epi32(kRowRound);
+  size_t i = begin;
+  for (; i + 16 <= end; i += 16) {
+    const uint8_t* p = in + i;
+    __m256i s = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    __m256i w = _mm256_set1_epi16((short)q[0]);
+    __m256i prod_lo = _mm256_mullo_epi16(s, w);
+    __m256i prod_hi = _mm256_mulhi_epu16(s, w);
+    __m256i lo = _mm256_add_epi32(round, _mm256_unpacklo_epi16(prod_lo, prod_hi));
+    __m256i hi = _mm256_add_epi32(round, _mm256_unpackhi_epi16(prod_lo, prod_hi));
+    for (int k = 1; k <= radius; ++k) {
+      // at most 510, the pair still fits 16 bits
+      s = _mm256_add_epi16(
+          _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p - k * step))),
+          _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k * step))));
+      w = _mm256_set1_epi16((short)q[k]);
+      prod_lo = _mm256_mullo_epi16(s, w);
+      prod_hi = _mm256_mulhi_epu16(s, w);
+      lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(prod_lo, prod_hi));
+      hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(prod_lo, prod_hi));
+    }
+    __m256i v = _mm256_packus_epi32(_mm256_srli_epi32(lo, kRowShift),
+                                    _mm256_srli_epi32(hi, kRowShift));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), v);
+  }
+  rowInteriorFixedScalar(in, out, i, end, q, radius, step);
+}
+
+// Q8.8 pairs can exceed 16 bits, the column pass does not fold
+__attribute__((target("avx2")))
+void colFixedAVX2(const uint16_t* const* rows, uint8_t* out, size_t begin, size_t end,
+                  const uint16_t* q, int radius) {
+  const __m256i round = _mm256_set1_epi32(kColRound);
+  size_t i = begin;
+  for (; i + 16 <= end; i += 16) {
+    __m256i lo = round;
+    __m256i hi = round;
+    for (int k = 0; k <= 2 * radius; ++k) {
+      __m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k] + i));
+      __m256i w = _mm256_set1_epi16((short)q[std::abs(k - radius)]);
+      __m256i prod_lo = _mm256_mullo_epi16(t, w);
+      __m256i prod_hi = _mm256_mulhi_epu16(t, w);
+      lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(prod_lo, prod_hi));
+      hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(prod_lo, prod_hi));
+    }
+    __m256i v16 = _mm256_packus_epi32(_mm256_srli_epi32(lo, kColShift),
+                                      _mm256_srli_epi32(hi, kColShift));
+    __m128i v8 = _mm_packus_epi16(_mm256_castsi256_si128(v16),
+                                  _mm256_extracti128_si256(v16, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), v8);
+  }
+  colFixedScalar(rows, out, i, end, q, radius);
+}
+
+__attribute__((target("avx512f")))
+void rowInteriorAVX512(const uint8_t* in, float* out, size_t begin, size_t end,
+                       const float* w, int taps, int step) {
+  const size_t apron = (size_t)(taps / 2) * step;
+  size_t i = begin;
+  for (; i + 16 <= end; i += 16) {
+    const uint8_t* p = in + i - apron;
+    __m512 acc = _mm512_setzero_ps();
+    for (int k = 0; k < taps; ++k) {
+      __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k * step));
+      __m512 v = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(bytes));
+      acc = _mm512_fmadd_ps(_mm512_set1_ps(w[k]), v, acc);
+    }
+    _mm512_storeu_ps(out + i, acc);
+  }
+  rowInteriorAVX2(in, out, i, end, w, taps, step);
+}
+
+__attribute__((target("avx512f")))
+void colAVX512(const float* const* rows, uint8_t* out, size_t begin, size_t end,
+               const float* w, int taps) {
+  const __m512 lo = _mm512_setzero_ps();
+  const __m512 hi = _mm512_set1_ps(255.0f);
+  size_t i = begin;
+  for (; i + 16 <= end; i += 16) {
+    __m512 acc = _mm512_setzero_ps();
+    for (int k = 0; k < taps; ++k) {
+      acc = _mm512_fmadd_ps(_mm512_set1_ps(w[k]), _mm512_loadu_ps(rows[k] + i), acc);
+    }
+    __m512i v = _mm512_cvttps_epi32(_mm512_min_ps(_mm512_max_ps(acc, lo), hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm512_cvtusepi32_epi8(v));
+  }
+  colAVX2(rows, out, i, end, w, taps);
+}
+
+__attribute__((target("avx512f")))
+void rowInteriorFoldedAVX512(const uint8_t* in, float* out, size_t begin, size_t end,
+                             const float* w, int radius, int step) {
+  size_t i = begin;
+  for (; i + 16 <= end; i += 16) {
+    const uint8_t* p = in + i;
+    __m512i center = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    __m512 acc = _mm512_mul_ps(_mm512_set1_ps(w[0]), _mm512_cvtepi32_ps(center));
+    for (int k = 1; k <= radius; ++k) {
+      __m512i a = _mm512_cvtepu8_epi32(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p - k * step)));
+      __m512i b = _mm512_cvtepu8_epi32(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k * step)));
+      acc = _mm512_fmadd_ps(_mm512_set1_ps(w[k]),
+                            _mm512_cvtepi32_ps(_mm512_add_epi32(a, b)), acc);
+    }
+    _mm512_storeu_ps(out + i, acc);
+  }
+  rowInteriorFoldedAVX2(in, out, i, end, w, radius, step);
+}
+
+__attribute__((target("avx512f")))
+void colFoldedAVX512(const float* const* rows, uint8_t* out, size_t begin, size_t end,
+                     const float* w, int radius) {
+  const __m512 lo = _mm512_setzero_ps();
+  const __m512 hi = _mm512_set1_ps(255.0f);
+  size_t i = begin;
+  for (; i + 16 <= end; i += 16) {
+    __m512 acc = _mm512_mul_ps(_mm512_set1_ps(w[0]), _mm512_loadu_ps(rows[radius] + i));
+    for (int k = 1; k <= radius; ++k) {
+      __m512 pair = _mm512_add_ps(_mm512_loadu_ps(rows[radius - k] + i),
+                                  _mm512_loadu_ps(rows[radius + k] + i));
+      acc = _mm512_fmadd_ps(_mm512_set1_ps(w[k]), pair, acc);
+    }
+    __m512i v = _mm512_cvttps_epi32(_mm512_min_ps(_mm512_max_ps(acc, lo), hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm512_cvtusepi32_epi8(v));
+  }
+  colFoldedAVX2(rows, out, i, end, w, radius);
+}
+#endif
+
+void rowInterior(const uint8_t* in, float* out, size_t begin, size_t end,
+                 const float* w, int taps, int step) {
+#ifdef KUMO_CPU_X86
+  if (kSimdLevel == SimdLevel::kAVX512) return rowInteriorAVX512(in, out, begin, end, w, taps, step);
+  if (kSimdLevel == SimdLevel::kAVX2) return rowInteriorAVX2(in, out, begin, end, w, taps, step);
+#endif
+  rowInteriorScalar(in, out, begin, end, w, taps, step);
+}
+
+void col(const float* const* rows, uint8_t* out, size_t begin, size_t end,
+         const float* w, int taps) {
+#ifdef KUMO_CPU_X86
+  if (kSimdLevel == SimdLevel::kAVX512) return colAVX512(rows, out, begin, end, w, taps);
+  if (kSimdLevel == SimdLevel::kAVX2) return colAVX2(rows, out, begin, end, w, taps);
+#endif
+  colScalar(rows, out, begin, end, w, taps);
+}
+
+void rowInteriorFolded(const uint8_t* in, float* out, size_t begin, size_t end,
+                       const float* w, int radius, int step) {
+#ifdef KUMO_CPU_X86
+  if (kSimdLevel == SimdLevel::kAVX512) {
+    return rowInteriorFoldedAVX512(in, out, begin, end, w, radius, step);
+  }
+  if (kSimdLevel == SimdLevel::kAVX2) {
+    return rowInteriorFoldedAVX2(in, out, begin, end, w, radius, step);
+  }
+#endif
+  rowInteriorFoldedScalar(in, out, begin, end, w, radius, step);
+}
+
+void colFolded(const float* const* rows, uint8_t* out, size_t begin, size_t end,
+               const float* w, int radius) {
+#ifdef KUMO_CPU_X86
+  if (kSimdLevel == SimdLevel::kAVX512) return colFoldedAVX512(rows, out, begin, end, w, radius);
+  if (kSimdLevel == SimdLevel::kAVX2) return colFoldedAVX2(rows, out, begin, end, w, radius);
+#endif
+  colFoldedScalar(rows, out, begin, end, w, radius);
+}
+
+// 16-bit lanes need AVX512BW, AVX-512 machines take the AVX2 code
+void rowInteriorFixed(const uint8_t* in, uint16_t* out, size_t begin, size_t end,
+                      const uint16_t* q, int radius, int step) {
+#ifdef KUMO_CPU_X86
+  if (kSimdLevel != SimdLevel::kScalar) {
+    return rowInteriorFixedAVX2(in, out, begin, end, q, radius, step);
+  }
+#endif
+  rowInteriorFixedScalar(in, out, begin, end, q, radius, step);
+}
+
+void colFixed(const uint16_t* const* rows, uint8_t* out, size_t begin, size_t end,
+              const uint16_t* q, int radius) {
+#ifdef KUMO_CPU_X86
+  if (kSimdLevel != SimdLevel::kScalar) return colFixedAVX2(rows, out, begin, end, q, radius);
+#endif
+  colFixedScalar(rows, out, begin, end, q, radius);
+}
+
+// Pixels in [x_begin, x_end) whose taps leave the row, clamped to the edge.
+void rowBorder(const uint8_t* in, float* out, int x_begin, int x_end, int width,
+               int channels, const float* w, int taps) {
+  const int radius = taps / 2;
+  for (int x = x_begin; x < x_end; ++x) {
+    for (int c = 0; c < channels; ++c) {
+      float sum = 0.0f;
+      for (int k = 0; k < taps; ++k) {
+        int ix = std::min(std::max(x + k - radius, 0), width - 1);
+        sum += w[k] * in[ix * channels + c];
+      }
+      out[x * channels + c] = sum;
+    }
+  }
+}
+
+void rowPass(const uint8_t* in, float* out, int width, int channels,
+             const float* w, int taps, bool folded) {
+  const int radius = taps / 2;
+  // interior columns never touch the edge, the two strips do
+  const int left = std::min(radius, width);
+  const int right = std::max(width - radius, left);
+  rowBorder(in, out, 0, left, width, channels, w, taps);
+  if (folded) {
+    rowInteriorFolded(in, out, (size_t)left * channels, (size_t)right * channels,
+                      w + radius, radius, channels);
+  } else {
+    rowInterior(in, out, (size_t)left * channels, (size_t)right * channels, w, taps, channels);
+  }
+  rowBorder(in, out, right, width, width, channels, w, taps);
+}
+
+void rowBorderFixed(const uint8_t* in, uint16_t* out, int x_begin, int x_end, int width,
+                    int channels, const uint16_t* q, int radius) {
+  for (int x = x_begin; x < x_end; ++x) {
+    for (int c = 0; c < channels; ++c) {
+      uint32_t acc = kRowRound + q[0] * (uint32_t)in[x * channels + c];
+      for (int k = 1; k <= radius; ++k) {
+        int left = std::max(x - k, 0);
+        int right = std::min(x + k, width - 1);
+        acc += q[k] * (uint32_t)(in[left * channels + c] + in[right * channels + c]);
+      }
+      out[x * channels + c] = (uint16_t)(acc >> kRowShift);
+    }
+  }
+}
+
+void rowPassFixed(const uint8_t* in, uint16_t* out, int width, int channels,
+                  const uint16_t* q, int radius) {
+  const int left = std::min(radius, width);
+  const int right = std::max(width - radius, left);
+  rowBorderFixed(in, out, 0, left, width, channels, q, radius);
+  rowInteriorFixed(in, out, (size_t)left * channels, (size_t)right * channels,
+                   q, radius, channels);
+  rowBorderFixed(in, out, right, width, width, channels, q, radius);
+}
+
+// Anti-causal state at N - 1, N and N + 1 of a replicated border, from the
+// last input sample u and the last three causal outputs, see
+// RecursiveGaussian::boundary.
+void recursiveBoundary(const RecursiveGaussian& g, float u, float w1, float w2,
+                       float w3, float* v1, float* v2, float* v3) {
+  const float d1 = w1 - u, d2 = w2 - u, d3 = w3 - u;
+  const float* m = g.boundary;
+  *v1 = u + m[0] * d1 + m[1] * d2 + m[2] * d3;
+  *v2 = u + m[3] * d1 + m[4] * d2 + m[5] * d3;
+  *v3 = u + m[6] * d1 + m[7] * d2 + m[8] * d3;
+}
+
+// Causal then anti-causal recursion over n samples spaced step apart, in
+// place. The causal state starts at the first sample, the steady state of
+// a replicated left border. The anti-causal one comes from the Triggs-Sdika
+// boundary matrix, the causal output still lags at the right end.
+void recursiveLine(float* data, int n, size_t step, const RecursiveGaussian& g) {
+  const float u = data[(n - 1) * step];
+  float w1 = data[0], w2 = w1, w3 = w1;
+  for (int i = 0; i < n; ++i) {
+    float w = g.b * data[i * step] + g.a1 * w1 + g.a2 * w2 + g.a3 * w3;
+    data[i * step] = w;
+    w3 = w2;
+    w2 = w1;
+    w1 = w;
+  }
+  recursiveBoundary(g, u, w1, w2, w3, &w1, &w2, &w3);
+  data[(n - 1) * step] = w1;
+  for (int i = n - 2; i >= 0; --i) {
+    float w = g.b * data[i * step] + g.a1 * w1 + g.a2 * w2 + g.a3 * w3;
+    data[i * step] = w;
+    w3 = w2;
+    w2 = w1;
+    w1 = w;
+  }
+}
+
+// Column elements per task of the vertical pass, its three state rows stay
+// in L1
+constexpr size_t kRecursiveStrip = 256;
+
+}
+
+CpuSeperableConv::CpuSeperableConv(size_t num_threads)
+  : pool_(num_threads), recursive_threshold_(kRecursiveSigmaThreshold),
+    arithmetic_(CpuArithmetic::kFloat) {}
+
+void CpuSeperableConv::setRecursiveSigmaThreshold(float sigma) {
+  recursive_threshold_ = sigma;
+}
+
+float CpuSeperableConv::recursiveSigmaThreshold() const {
+  return recursive_threshold_;
+}
+
+void CpuSeperableConv::setArithmetic(CpuArithmetic arithmetic) {
+  arithmetic_ = arithmetic;
+}
+
+CpuArithmetic CpuSeperableConv::arithmetic() const {
+  return arithmetic_;
+}
+
+size_t CpuSeperableConv::threadCount() const {
+  return pool_.size();
+}
+
+const char* CpuSeperableConv::simdPath() {
+  switch (kSimdLevel) {
+    case SimdLevel::kAVX512: return "avx512";
+    case SimdLevel::kAVX2: return "avx2";
+    default: return "scalar";
+  }
+}
+
+bool CpuSeperableConv::run(const uint8_t* src, size_t src_pitch, uint8_t* dst, size_t dst_pitch,
+                           int width, int height, int channels, const std::vector<float>& kernel) {
+  if (!src || !dst || width <= 0 || height <= 0 || channels <= 0) {
+    LOG(ERROR) << "Invalid image for CPU convolution.\n";
+    return false;
+  }
+  if (kernel.empty() || kernel.size() % 2 == 0) {
+    LOG(ERROR) << "CPU convolution needs an odd kernel size, got " << kernel.size() << ".\n";
+    return false;
+  }
+
+  // one band per thread keeps the duplicated apron rows to 2 * radius per
+  // thread, the sliding window inside a band stays cache resident
+  const int taps = (int)kernel.size();
+  const int band_rows = std::max((int)((height + pool_.size() - 1) / pool_.size()), taps);
+  const int bands = (height + band_rows - 1) / band_rows;
+
+  const bool folded = arithmetic_ != CpuArithmetic::kFloat && isSymmetric(kernel);
+  const std::vector<uint16_t> q = folded && arithmetic_ == CpuArithmetic::kFixedPoint
+    ? quantizeKernelQ16(kernel) : std::vector<uint16_t>();
+
+  pool_.parallelFor(0, bands, [&](size_t band) {
+    int y0 = (int)band * band_rows;
+    int y1 = std::min(y0 + band_rows, height);
+    if (!q.empty()) {
+      runBandFixed(src, src_pitch, dst, dst_pitch, width, height, channels, q, y0, y1);
+    } else {
+      runBand(src, src_pitch, dst, dst_pitch, width, height, channels, kernel, folded, y0, y1);
+    }
+  });
+  return true;
+}
+
+void CpuSeperableConv::runBand(const uint8_t* src, size_t src_pitch, uint8_t* dst, size_t dst_pitch,
+                               int width, int height, int channels, const std::vector<float>& kernel,
+                               bool folded, int y0, int y1) {
+  const int taps = (int)kernel.size();
+  const int radius = taps / 2;
+  const size_t row_len = (size_t)width * channels;
+  const float* w = kernel.data();
+
+  // Ring of the last `taps` row-filtered rows. Source row yy lives in slot
+  // yy % taps, the rows one output row needs are at most taps apart.
+  thread_local std::vector<float> ring;
+  thread_local std::vector<const float*> tap_rows;
+  ring.resize((size_t)taps * row_len);
+  tap_rows.resize(taps);
+
+  int next_row = std::max(y0 - radius, 0);
+  for (int y = y0; y < y1; ++y) {
+    const int last_row = std::min(y + radius, height - 1);
+    for (; next_row <= last_row; ++next_row) {
+      rowPass(src + next_row * src_pitch, ring.data() + (size_t)(next_row % taps) * row_len,
+              width, channels, w, taps, folded);
+    }
+
+    for (int k = 0; k < taps; ++k) {
+      int iy = std::min(std::max(y + k - radius, 0), height - 1);
+      tap_rows[k] = ring.data() + (size_t)(iy % taps) * row_len;
+    }
+    if (folded) {
+      colFolded(tap_rows.data(), dst + y * dst_pitch, 0, row_len, w + radius, radius);
+    } else {
+      col(tap_rows.data(), dst + y * dst_pitch, 0, row_len, w, taps);
+    }
+  }
+}
+
+void CpuSeperableConv::runBandFixed(const uint8_t* src, size_t src_pitch, uint8_t* dst,
+                                    size_t dst_pitch, int width, int height, int channels,
+                                    const std::vector<uint16_t>& q, int y0, int y1) {
+  const int radius = (int)q.size() - 1;
+  const int taps = 2 * radius + 1;
+  const size_t row_len = (size_t)width * channels;
+
+  // same ring as runBand, at half the footprint
+  thread_local std::vector<uint16_t> ring;
+  thread_local std::vector<const uint16_t*> tap_rows;
+  ring.resize((size_t)taps * row_len);
+  tap_rows.resize(taps);
+
+  int next_row = std::max(y0 - radius, 0);
+  for (int y = y0; y < y1; ++y) {
+    const int last_row = std::min(y + radius, height - 1);
+    for (; next_row <= last_row; ++next_row) {
+      rowPassFixed(src + next_row * src_pitch, ring.data() + (size_t)(next_row % taps) * row_len,
+                   width, channels, q.data(), radius);
+    }
+
+    for (int k = 0; k < taps; ++k) {
+      int iy = std::min(std::max(y + k - radius, 0), height - 1);
+      tap_rows[k] = ring.data() + (size_t)(iy % taps) * row_len;
+    }
+    colFixed(tap_rows.data(), dst + y * dst_pitch, 0, row_len, q.data(), radius);
+  }
+}
+
+bool CpuSeperableConv::runGaussian(const uint8_t* src, size_t src_pitch, uint8_t* dst,
+                                   size_t dst_pitch, int width, int height, int channels,
+                                   float sigma) {
+  if (preferRecursive(sigma, recursive_threshold_)) {
+    return runRecursive(src, src_pitch, dst, dst_pitch, width, height, channels, sigma);
+  }
+  return run(src, src_pitch, dst, dst_pitch, width, height, channels, gaussianKernel1D(sigma));
+}
+
+bool CpuSeperableConv::runRecursive(const uint8_t* src, size_t src_pitch, uint8_t* dst,
+                                    size_t dst_pitch, int width, int height, int channels,
+                                    float sigma) {
+  if (!src || !dst || width <= 0 || height <= 0 || channels <= 0) {
+    LOG(ERROR) << "Invalid image for CPU convolution.\n";
+    return false;
+  }
+  const RecursiveGaussian g = RecursiveGaussian::fromSigma(sigma);
+  const size_t row_len = (size_t)width * channels;
+  recursive_scratch_.resize(row_len * height);
+  float* scratch = recursive_scratch_.data();
+
+  // horizontal, one row per task, the channels of a pixel are separate lines
+  pool_.parallelFor(0, height, [&](size_t y) {
+    const uint8_t* in = src + y * src_pitch;
+    float* out = scratch + y * row_len;
+    for (size_t i = 0; i < row_len; ++i) out[i] = in[i];
+    for (int c = 0; c < channels; ++c) {
+      recursiveLine(out + c, width, channels, g);
+    }
+  });
+
+  // vertical, a strip of columns per task. The recursion state is a row
+  // segment, so every step is a contiguous multiply-add the compiler vectorizes.
+  const size_t strips = (row_len + kRecursiveStrip - 1) / kRecursiveStrip;
+  pool_.parallelFor(0, strips, [&](size_t strip) {
+    const size_t x0 = strip * kRecursiveStrip;
+    const size_t n = std::min(kRecursiveStrip, row_len - x0);
+    float w1[kRecursiveStrip], w2[kRecursiveStrip], w3[kRecursiveStrip];
+    float last[kRecursiveStrip];
+    const float* first = scratch + x0;
+    for (size_t i = 0; i < n; ++i) w1[i] = w2[i] = w3[i] = first[i];
+    // the causal pass overwrites the input of the last row
+    const float* bottom = scratch + (height - 1) * row_len + x0;
+    for (size_t i = 0; i < n; ++i) last[i] = bottom[i];
+    for (int y = 0; y < height; ++y) {
+      float* row = scratch + y * row_len + x0;
+      for (size_t i = 0; i < n; ++i) {
+        float w = g.b * row[i] + g.a1 * w1[i] + g.a2 * w2[i] + g.a3 * w3[i];
+        row[i] = w;
+        w3[i] = w2[i];
+        w2[i] = w1[i];
+        w1[i] = w;
+      }
+    }
+    {
+      uint8_t* out = dst + (height - 1) * dst_pitch + x0;
+      for (size_t i = 0; i < n; ++i) {
+        recursiveBoundary(g, last[i], w1[i], w2[i], w3[i], &w1[i], &w2[i], &w3[i]);
+        out[i] = (uint8_t)std::min(std::max(w1[i], 0.0f), 255.0f);
+      }
+    }
+    for (int y = height - 2; y >= 0; --y) {
+      const float* row = scratch + y * row_len + x0;
+      uint8_t* out = dst + y * dst_pitch + x0;
+      for (size_t i = 0; i < n; ++i) {
+        float w = g.b * row[i] + g.a1 * w1[i] + g.a2 * w2[i] + g.a3 * w3[i];
+        out[i] = (uint8_t)std::min(std::max(w, 0.0f), 255.0f);
+        w3[i] = w2[i];
+        w2[i] = w1[i];
+        w1[i] = w;
+      }
+    }
+  });
+  return true;
+}
+
+}
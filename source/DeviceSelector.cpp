@@ -0,0 +1,188 @@
+#include "DeviceSelector.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <glog/logging.h>
+#include <vector>
+
+namespace kumo {
+
+namespace {
+
+std::string toLower(std::string value) {
+  std::transform(value.begin(), value.end(), value.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return value;
+}
+
+std::string platformString(cl_platform_id platform, cl_platform_info param) {
+  size_t size = 0;
+  if (clGetPlatformInfo(platform, param, 0, nullptr, &size) != CL_SUCCESS || size == 0) {
+    return std::string();
+  }
+  std::string value(size, '\0');
+  clGetPlatformInfo(platform, param, size, &value[0], nullptr);
+  value.resize(size - 1);  // trailing '\0'
+  return value;
+}
+
+template <typename T>
+T deviceValue(cl_device_id device, cl_device_info param) {
+  T value{};
+  clGetDeviceInfo(device, param, sizeof(T), &value, nullptr);
+  return value;
+}
+
+bool findDevice(cl_device_type type, const std::string& filter,
+                cl_platform_id* platform, cl_device_id* device) {
+  DeviceSelector selector;
+  selector.type = type;
+  selector.filter = filter;
+  std::vector<DeviceHandle> devices = listDevices(selector);
+  if (devices.empty()) return false;
+  *platform = devices.front().platform;
+  *device = devices.front().device;
+  return true;
+}
+
+}
+
+DeviceSelector DeviceSelector::fromEnv() {
+  const char* spec = std::getenv("KUMO_CL_DEVICE");
+  return spec ? parse(spec) : DeviceSelector();
+}
+
+DeviceSelector DeviceSelector::parse(const std::string& spec) {
+  DeviceSelector selector;
+  const size_t colon = spec.find(':');
+  const std::string head = toLower(spec.substr(0, colon));
+  const std::string tail = colon == std::string::npos ? std::string() : spec.substr(colon + 1);
+
+  if (head == "gpu") {
+    selector.type = CL_DEVICE_TYPE_GPU;
+  } else if (head == "cpu") {
+    selector.type = CL_DEVICE_TYPE_CPU;
+  } else if (head == "accelerator") {
+    selector.type = CL_DEVICE_TYPE_ACCELERATOR;
+  } else if (head == "all") {
+    selector.type = CL_DEVICE_TYPE_ALL;
+  } else {
+    selector.filter = spec;
+    return selector;
+  }
+  selector.filter = tail;
+  return selector;
+}
+
+bool DeviceInfo::isGpu() const {
+  return (type & CL_DEVICE_TYPE_GPU) != 0;
+}
+
+bool DeviceInfo::isCpu() const {
+  return (type & CL_DEVICE_TYPE_CPU) != 0;
+}
+
+std::string deviceString(cl_device_id device, cl_device_info param) {
+  size_t size = 0;
+  if (clGetDeviceInfo(device, param, 0, nullptr, &size) != CL_SUCCESS || size == 0) {
+    return std::string();
+  }
+  std::string value(size, '\0');
+  clGetDeviceInfo(device, param, size, &value[0], nullptr);
+  value.resize(size - 1);  // trailing '\0'
+  return value;
+}
+
+DeviceInfo queryDeviceInfo(cl_device_id device) {
+  DeviceInfo info;
+  cl_platform_id platform = deviceValue<cl_platform_id>(device, CL_DEVICE_PLATFORM);
+  if (platform) info.platform_name = platformString(platform, CL_PLATFORM_NAME);
+  info.name = deviceString(device, CL_DEVICE_NAME);
+  info.vendor = deviceString(device, CL_DEVICE_VENDOR);
+  info.version = deviceString(device, CL_DEVICE_VERSION);
+  info.driver_version = deviceString(device, CL_DRIVER_VERSION);
+  info.type = deviceValue<cl_device_type>(device, CL_DEVICE_TYPE);
+  info.compute_units = deviceValue<cl_uint>(device, CL_DEVICE_MAX_COMPUTE_UNITS);
+  info.max_work_group_size = deviceValue<size_t>(device, CL_DEVICE_MAX_WORK_GROUP_SIZE);
+  info.local_mem_size = deviceValue<cl_ulong>(device, CL_DEVICE_LOCAL_MEM_SIZE);
+  info.global_mem_size = deviceValue<cl_ulong>(device, CL_DEVICE_GLOBAL_MEM_SIZE);
+  info.preferred_vector_width_char =
+      deviceValue<cl_uint>(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR);
+  info.preferred_vector_width_float =
+      deviceValue<cl_uint>(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT);
+  info.image_support = deviceValue<cl_bool>(device, CL_DEVICE_IMAGE_SUPPORT) != CL_FALSE;
+  info.host_unified_memory =
+      deviceValue<cl_bool>(device, CL_DEVICE_HOST_UNIFIED_MEMORY) != CL_FALSE;
+  return info;
+}
+
+std::vector<DeviceHandle> listDevices(const DeviceSelector& selector) {
+  std::vector<DeviceHandle> result;
+  cl_uint num_platforms = 0;
+  if (clGetPlatformIDs(0, nullptr, &num_platforms) != CL_SUCCESS || num_platforms == 0) {
+    LOG(ERROR) << "Failed to get OpenCL platform IDs.\n";
+    return result;
+  }
+  std::vector<cl_platform_id> platforms(num_platforms);
+  clGetPlatformIDs(num_platforms, platforms.data(), nullptr);
+
+  const std::string needle = toLower(selector.filter);
+  for (cl_platform_id platform : platforms) {
+    cl_uint num_devices = 0;
+    cl_int err = clGetDeviceIDs(platform, selector.type, 0, nullptr, &num_devices);
+    if (err != CL_SUCCESS || num_devices == 0) continue;
+    std::vector<cl_device_id> devices(num_devices);
+    clGetDeviceIDs(platform, selector.type, num_devices, devices.data(), nullptr);
+
+    const std::string platform_name = toLower(platformString(platform, CL_PLATFORM_NAME));
+    for (cl_device_id device : devices) {
+      if (!needle.empty() &&
+          platform_name.find(needle) == std::string::npos &&
+          toLower(deviceString(device, CL_DEVICE_VENDOR)).find(needle) == std::string::npos &&
+          toLower(deviceString(device, CL_DEVICE_NAME)).find(needle) == std::string::npos) {
+        continue;
+      }
+      result.push_back({platform, device});
+    }
+  }
+  return result;
+}
+
+std::vector<cl_device_id> partitionDevice(cl_device_id device, cl_uint compute_units) {
+  std::vector<cl_device_id> sub_devices;
+  const cl_uint max_sub_devices =
+      deviceValue<cl_uint>(device, CL_DEVICE_PARTITION_MAX_SUB_DEVICES);
+  if (compute_units == 0 || max_sub_devices < 2) return sub_devices;
+
+  const cl_device_partition_property props[] = {
+      CL_DEVICE_PARTITION_EQUALLY, (cl_device_partition_property)compute_units, 0};
+  cl_uint num_sub_devices = 0;
+  cl_int err = clCreateSubDevices(device, props, 0, nullptr, &num_sub_devices);
+  if (err != CL_SUCCESS || num_sub_devices == 0) {
+    LOG(ERROR) << "Failed to partition OpenCL device.\n";
+    return sub_devices;
+  }
+  sub_devices.resize(num_sub_devices);
+  err = clCreateSubDevices(device, props, num_sub_devices, sub_devices.data(), nullptr);
+  if (err != CL_SUCCESS) {
+    LOG(ERROR) << "Failed to create OpenCL sub-devices.\n";
+    sub_devices.clear();
+  }
+  return sub_devices;
+}
+
+bool selectDevice(const DeviceSelector& selector,
+                  cl_platform_id* platform, cl_device_id* device) {
+  if (findDevice(selector.type, selector.filter, platform, device)) {
+    return true;
+  }
+  if (selector.fallback && selector.type != CL_DEVICE_TYPE_CPU &&
+      findDevice(CL_DEVICE_TYPE_CPU, selector.filter, platform, device)) {
+    LOG(WARNING) << "No matching OpenCL device of the requested type, falling back to a CPU device.\n";
+    return true;
+  }
+  LOG(ERROR) << "Failed to find an OpenCL device matching '" << selector.filter << "'.\n";
+  return false;
+}
+
+}
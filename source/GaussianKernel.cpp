@@ -0,0 +1,112 @@
+#include "GaussianKernel.h"
+#include <algorithm>
+#include <cmath>
+
+namespace kumo {
+
+std::vector<float> gaussianKernel1D(float sigma, int radius) {
+  if (radius < 0) radius = std::max(1, (int)std::ceil(3.0f * sigma));
+  std::vector<float> kernel(2 * radius + 1);
+  float sum = 0.0f;
+  for (int i = -radius; i <= radius; ++i) {
+    float value = std::exp(-(i * i) / (2.0f * sigma * sigma));
+    kernel[i + radius] = value;
+    sum += value;
+  }
+  for (float& v : kernel) v /= sum;
+  return kernel;
+}
+
+RecursiveGaussian RecursiveGaussian::fromSigma(float sigma) {
+  // eq. 11b of the paper, q is the scale the coefficients are fitted for
+  const double s = std::max(sigma, 0.5f);
+  const double q = s >= 2.5 ? 0.98711 * s - 0.96330
+                            : 3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * s);
+  const double q2 = q * q;
+  const double q3 = q2 * q;
+  const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+  const double b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+  const double b2 = -(1.4281 * q2 + 1.26661 * q3);
+  const double b3 = 0.422205 * q3;
+
+  RecursiveGaussian coeffs;
+  coeffs.a1 = (float)(b1 / b0);
+  coeffs.a2 = (float)(b2 / b0);
+  coeffs.a3 = (float)(b3 / b0);
+  // unit DC gain, a flat image stays flat
+  coeffs.b = 1.0f - (coeffs.a1 + coeffs.a2 + coeffs.a3);
+
+  // from the rounded coefficients, the ones the recursion actually runs
+  const double a1 = coeffs.a1;
+  const double a2 = coeffs.a2;
+  const double a3 = coeffs.a3;
+  const double scale = coeffs.b /
+      ((1.0 + a1 - a2 + a3) * (1.0 - a1 - a2 - a3) * (1.0 + a2 + (a1 - a3) * a3));
+  const double m[9] = {
+      -a3 * a1 + 1.0 - a3 * a3 - a2,
+      (a3 + a1) * (a2 + a3 * a1),
+      a3 * (a1 + a3 * a2),
+      a1 + a3 * a2,
+      -(a2 - 1.0) * (a2 + a3 * a1),
+      -(a3 * a1 + a3 * a3 + a2 - 1.0) * a3,
+      a3 * a1 + a2 + a1 * a1 - a2 * a2,
+      a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3 - a3 * a3 * a3 - a3 * a2 + a3,
+      a3 * (a1 + a3 * a2)};
+  for (int i = 0; i < 9; ++i) coeffs.boundary[i] = (float)(scale * m[i]);
+  return coeffs;
+}
+
+std::vector<int> boxBlurRadii(float sigma, int passes) {
+  // ideal width of equal boxes, then mix the odd widths around it
+  const double n = passes;
+  const double ideal = std::sqrt(12.0 * sigma * sigma / n + 1.0);
+  int wl = (int)std::floor(ideal);
+  if (wl % 2 == 0) --wl;
+  wl = std::max(wl, 1);
+  const int wu = wl + 2;
+  const int m = (int)std::lround((12.0 * sigma * sigma - n * wl * wl - 4.0 * n * wl - 3.0 * n) /
+                                 (-4.0 * wl - 4.0));
+
+  std::vector<int> radii(passes);
+  for (int i = 0; i < passes; ++i) {
+    radii[i] = ((i < m ? wl : wu) - 1) / 2;
+  }
+  return radii;
+}
+
+bool isSymmetric(const std::vector<float>& kernel, float tolerance) {
+  if (kernel.size() % 2 == 0) return false;
+  const size_t radius = kernel.size() / 2;
+  for (size_t k = 1; k <= radius; ++k) {
+    if (std::fabs(kernel[radius - k] - kernel[radius + k]) > tolerance) return false;
+  }
+  return true;
+}
+
+std::vector<uint16_t> quantizeKernelQ16(const std::vector<float>& kernel) {
+  if (!isSymmetric(kernel)) return {};
+  const int radius = (int)kernel.size() / 2;
+  const double one = 1 << kWeightFractionBits;
+
+  double sum = 0.0;
+  for (float w : kernel) {
+    if (w < 0.0f) return {};
+    sum += w;
+  }
+  if (sum > 1.0 + 1e-4) return {};
+  const long target = std::lround(std::min(sum, 1.0) * one);
+
+  std::vector<uint16_t> q(radius + 1);
+  long side = 0;
+  for (int k = 1; k <= radius; ++k) {
+    const long value = std::lround(kernel[radius + k] * one);
+    q[k] = (uint16_t)value;
+    side += value;
+  }
+  const long center = target - 2 * side;
+  if (center < 0 || center > 0xffff) return {};
+  q[0] = (uint16_t)center;
+  return q;
+}
+
+}
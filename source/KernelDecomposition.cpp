@@ -0,0 +1,132 @@
+#include "KernelDecomposition.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace kumo {
+
+namespace {
+
+// One-sided Jacobi SVD (Hestenes) of the column-major m x n matrix a,
+// m >= n. Column pairs of a are rotated until they are orthogonal, then
+// a = U * S column by column and the accumulated rotations are V.
+void jacobiSvd(std::vector<double>& a, int m, int n, std::vector<double>& v) {
+  v.assign((size_t)n * n, 0.0);
+  for (int j = 0; j < n; ++j) v[(size_t)j * n + j] = 1.0;
+
+  const double eps = 1e-15;
+  for (int sweep = 0; sweep < 64; ++sweep) {
+    bool rotated = false;
+    for (int p = 0; p < n - 1; ++p) {
+      for (int q = p + 1; q < n; ++q) {
+        double* ap = &a[(size_t)p * m];
+        double* aq = &a[(size_t)q * m];
+        double alpha = 0.0, beta = 0.0, gamma = 0.0;
+        for (int i = 0; i < m; ++i) {
+          alpha += ap[i] * ap[i];
+          beta += aq[i] * aq[i];
+          gamma += ap[i] * aq[i];
+        }
+        if (std::abs(gamma) <= eps * std::sqrt(alpha * beta)) continue;
+        rotated = true;
+
+        const double zeta = (beta - alpha) / (2.0 * gamma);
+        const double t = (zeta >= 0.0 ? 1.0 : -1.0) /
+                         (std::abs(zeta) + std::sqrt(1.0 + zeta * zeta));
+        const double c = 1.0 / std::sqrt(1.0 + t * t);
+        const double s = c * t;
+        for (int i = 0; i < m; ++i) {
+          const double x = ap[i];
+          ap[i] = c * x - s * aq[i];
+          aq[i] = s * x + c * aq[i];
+        }
+        double* vp = &v[(size_t)p * n];
+        double* vq = &v[(size_t)q * n];
+        for (int i = 0; i < n; ++i) {
+          const double x = vp[i];
+          vp[i] = c * x - s * vq[i];
+          vq[i] = s * x + c * vq[i];
+        }
+      }
+    }
+    if (!rotated) break;
+  }
+}
+
+}
+
+LowRankKernel decomposeKernel2D(const std::vector<float>& kernel, int rows, int cols,
+                                int max_rank, float tolerance) {
+  LowRankKernel result;
+  if (rows <= 0 || cols <= 0 || kernel.size() != (size_t)rows * cols) return result;
+
+  // the Jacobi sweep wants a tall matrix, a wide kernel is decomposed
+  // transposed, K^T = U S V^T gives K = V S U^T
+  const bool transposed = cols > rows;
+  const int m = transposed ? cols : rows;
+  const int n = transposed ? rows : cols;
+  std::vector<double> a((size_t)m * n);
+  for (int y = 0; y < rows; ++y) {
+    for (int x = 0; x < cols; ++x) {
+      const double value = kernel[(size_t)y * cols + x];
+      if (transposed) {
+        a[(size_t)y * m + x] = value;
+      } else {
+        a[(size_t)x * m + y] = value;
+      }
+    }
+  }
+  std::vector<double> v;
+  jacobiSvd(a, m, n, v);
+
+  std::vector<double> sigma(n);
+  for (int j = 0; j < n; ++j) {
+    double norm = 0.0;
+    for (int i = 0; i < m; ++i) norm += a[(size_t)j * m + i] * a[(size_t)j * m + i];
+    sigma[j] = std::sqrt(norm);
+  }
+  std::vector<int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](int l, int r) { return sigma[l] > sigma[r]; });
+
+  double total = 0.0;
+  for (int j = 0; j < n; ++j) {
+    result.singular_values.push_back((float)sigma[order[j]]);
+    total += sigma[j] * sigma[j];
+  }
+  if (total <= 0.0) return result;
+
+  // energy left out by the first r terms, the Eckart-Young error
+  const int limit = std::min(max_rank, n);
+  int rank = 0;
+  double tail = total;
+  for (int r = 1; r <= limit; ++r) {
+    tail -= sigma[order[r - 1]] * sigma[order[r - 1]];
+    result.residual = (float)std::sqrt(std::max(tail, 0.0) / total);
+    if (result.residual <= tolerance) {
+      rank = r;
+      break;
+    }
+  }
+
+  for (int r = 0; r < rank; ++r) {
+    const int j = order[r];
+    const double scale = std::sqrt(sigma[j]);
+    std::vector<float> left(m), right(n);
+    for (int i = 0; i < m; ++i) left[i] = (float)(a[(size_t)j * m + i] / sigma[j] * scale);
+    for (int i = 0; i < n; ++i) right[i] = (float)(v[(size_t)j * n + i] * scale);
+
+    SeparableTerm term;
+    term.column = transposed ? std::move(right) : std::move(left);
+    term.row = transposed ? std::move(left) : std::move(right);
+    // the sign of a singular vector pair is arbitrary
+    if (std::accumulate(term.row.begin(), term.row.end(), 0.0f) < 0.0f) {
+      for (float& w : term.column) w = -w;
+      for (float& w : term.row) w = -w;
+    }
+    result.terms.push_back(std::move(term));
+  }
+  return result;
+}
+
+}
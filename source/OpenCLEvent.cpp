@@ -0,0 +1,95 @@
+#include "OpenCLEvent.h"
+#include <glog/logging.h>
+#include <utility>
+
+namespace kumo {
+
+Event::Event() : event_(nullptr), error_(CL_SUCCESS) {}
+
+Event::Event(cl_event event) : event_(event), error_(CL_SUCCESS) {}
+
+Event Event::failure(cl_int error) {
+  Event event;
+  event.error_ = error;
+  return event;
+}
+
+Event::Event(const Event& other) : event_(other.event_), error_(other.error_) {
+  if (event_) clRetainEvent(event_);
+}
+
+Event::Event(Event&& other) noexcept : event_(other.event_), error_(other.error_) {
+  other.event_ = nullptr;
+  other.error_ = CL_SUCCESS;
+}
+
+Event& Event::operator=(const Event& other) {
+  if (this != &other) {
+    if (other.event_) clRetainEvent(other.event_);
+    if (event_) clReleaseEvent(event_);
+    event_ = other.event_;
+    error_ = other.error_;
+  }
+  return *this;
+}
+
+Event& Event::operator=(Event&& other) noexcept {
+  if (this != &other) {
+    if (event_) clReleaseEvent(event_);
+    event_ = std::exchange(other.event_, nullptr);
+    error_ = std::exchange(other.error_, CL_SUCCESS);
+  }
+  return *this;
+}
+
+Event::~Event() {
+  if (event_) clReleaseEvent(event_);
+}
+
+bool Event::valid() const {
+  return event_ != nullptr;
+}
+
+bool Event::failed() const {
+  return error_ != CL_SUCCESS;
+}
+
+cl_int Event::error() const {
+  return error_;
+}
+
+bool Event::isComplete() const {
+  if (!event_) return true;
+  cl_int status = CL_COMPLETE;
+  cl_int err = clGetEventInfo(event_, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                              sizeof(status), &status, nullptr);
+  // negative status means the command terminated abnormally
+  return err != CL_SUCCESS || status <= CL_COMPLETE;
+}
+
+bool Event::wait() const {
+  if (error_ != CL_SUCCESS) return false;
+  if (!event_) return true;
+  cl_int err = clWaitForEvents(1, &event_);
+  if (err != CL_SUCCESS) {
+    LOG(ERROR) << "Failed to wait for event.\n";
+    return false;
+  }
+  return true;
+}
+
+cl_event Event::get() const {
+  return event_;
+}
+
+cl_int Event::toWaitList(const std::vector<Event>& events, std::vector<cl_event>* raw) {
+  raw->clear();
+  raw->reserve(events.size());
+  for (const auto& event : events) {
+    if (event.failed()) return event.error();
+    if (event.valid()) raw->push_back(event.get());
+  }
+  return CL_SUCCESS;
+}
+
+}
@@ -11,48 +11,40 @@ namespace kumo {
 
 OpenCLRuntime::OpenCLRuntime()
   : platform_(nullptr), device_(nullptr), context_(nullptr),
-    queue_(nullptr), program_(nullptr), kernel_(nullptr) {}
+    queue_(nullptr), kernel_(nullptr) {}
 
 OpenCLRuntime::~OpenCLRuntime() {
-  if (kernel_) clReleaseKernel(kernel_);
-  if (program_) clReleaseProgram(program_);
+  buffer_pool_.clear();
+  for (auto& entry : kernels_) {
+    clReleaseKernel(entry.second);
+  }
   if (queue_) clReleaseCommandQueue(queue_);
+  program_cache_.clear();
   if (context_) clReleaseContext(context_);
 }
 
 bool OpenCLRuntime::init() {
-  cl_int err;
+  return init(DeviceSelector::fromEnv());
+}
 
-  // get platfrom
-  cl_uint num_platforms = 0;
-  err = clGetPlatformIDs(0, nullptr, &num_platforms);
-  if (err != CL_SUCCESS) {
-    LOG(ERROR) << "Failed to get OpenCL platform IDs.\n";
+bool OpenCLRuntime::init(const DeviceSelector& selector) {
+  cl_platform_id platform = nullptr;
+  cl_device_id device = nullptr;
+  // search every platform, falls back to a CPU device when allowed
+  if (!selectDevice(selector, &platform, &device)) {
     return false;
   }
+  return init(platform, device);
+}
 
-  std::vector<cl_platform_id> platforms(num_platforms);
-  err = clGetPlatformIDs(num_platforms, platforms.data(), nullptr);
-  if (err != CL_SUCCESS) {
-    LOG(ERROR) << "Failed to get platform IDs.\n";
-    return false;
-  }
-  platform_ = platforms[0];
+bool OpenCLRuntime::init(cl_platform_id platform, cl_device_id device) {
+  cl_int err;
 
-  // get device
-  cl_uint num_devices = 0;
-  err = clGetDeviceIDs(platform_, CL_DEVICE_TYPE_GPU, 0, nullptr, &num_devices);
-  if (err != CL_SUCCESS || num_devices == 0) {
-    LOG(ERROR) << "Failed to find any GPU device.\n";
-    return false;
-  }
-  std::vector<cl_device_id> devices(num_devices);
-  err = clGetDeviceIDs(platform_, CL_DEVICE_TYPE_GPU, num_devices, devices.data(), nullptr);
-  if (err != CL_SUCCESS) {
-    LOG(ERROR) << "Failed to get OpenCL device IDs.\n";
-    return false;
-  }
-  device_ = devices[0];
+  platform_ = platform;
+  device_ = device;
+  device_info_ = queryDeviceInfo(device_);
+  LOG(INFO) << "OpenCL device: " << device_info_.name << " (" << device_info_.platform_name
+            << "), " << device_info_.compute_units << " compute units\n";
 
   // create context
   context_ = clCreateContext(nullptr, 1, &device_, nullptr, nullptr, &err);
@@ -60,12 +52,15 @@ bool OpenCLRuntime::init() {
     LOG(ERROR) << "Failed to create OpenCL context.\n";
     return false;
   }
+  buffer_pool_.setContext(context_);
+  program_cache_.setDevice(context_, device_);
 
-  // create command queue
+  // create command queue, profiling is on so callers can time their events
 #if CL_TARGET_OPENCL_VERSION >= 200
-  queue_ = clCreateCommandQueueWithProperties(context_, device_, nullptr, &err);
+  cl_queue_properties props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+  queue_ = clCreateCommandQueueWithProperties(context_, device_, props, &err);
 #else
-  queue_ = clCreateCommandQueue(context_, device_, 0, &err);
+  queue_ = clCreateCommandQueue(context_, device_, CL_QUEUE_PROFILING_ENABLE, &err);
 #endif
   if (!queue_ || err != CL_SUCCESS) {
     LOG(ERROR) << "Failed to create command queue.\n";
@@ -75,58 +70,62 @@ bool OpenCLRuntime::init() {
   return true;
 }
 
-bool OpenCLRuntime::buildKernelFromFile(const std::string& file_path, const std::string& kernel_name) {
-  cl_int err;
+bool OpenCLRuntime::isInitialized() const {
+  return queue_ != nullptr;
+}
 
-  // read kernel code
-  std::ifstream file(file_path);
-  if (!file.is_open()) {
-    LOG(ERROR) << "Failed to open kernel file: " << file_path << "\n";
-    return false;
-  }
-  std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+const DeviceInfo& OpenCLRuntime::deviceInfo() const {
+  return device_info_;
+}
 
-  const char* source_cstr = source.c_str();
-  size_t source_size = source.size();
+cl_platform_id OpenCLRuntime::platform() const {
+  return platform_;
+}
 
-  if (program_) {
-    clReleaseProgram(program_);
-    program_ = nullptr;
-  }
+cl_device_id OpenCLRuntime::device() const {
+  return device_;
+}
 
-  if (kernel_) {
-    clReleaseKernel(kernel_);
-    kernel_ = nullptr;
-  }
+cl_context OpenCLRuntime::context() const {
+  return context_;
+}
 
-  // create program
-  program_ = clCreateProgramWithSource(context_, 1, &source_cstr, &source_size, &err);
-  if (!program_ || err != CL_SUCCESS) {
-    LOG(ERROR) << "Failed to create CL program from source.\n";
-    return false;
-  }
+cl_command_queue OpenCLRuntime::queue() const {
+  return queue_;
+}
 
-  // compile program
-  err = clBuildProgram(program_, 1, &device_, nullptr, nullptr, nullptr);
-  if (err != CL_SUCCESS) {
-    // get build log
-    size_t log_size = 0;
-    clGetProgramBuildInfo(program_, device_, CL_PROGRAM_BUILD_LOG, 0, nullptr, &log_size);
-    std::vector<char> log(log_size);
-    clGetProgramBuildInfo(program_, device_, CL_PROGRAM_BUILD_LOG, log_size, log.data(), nullptr);
-    LOG(ERROR) << "Error building program:\n" << log.data() << "\n"; 
-    clReleaseProgram(program_);
-    program_ = nullptr;
+bool OpenCLRuntime::buildKernelFromFile(const std::string& file_path, const std::string& kernel_name,
+                                        const std::string& options) {
+  return buildKernelsFromFile(file_path, {kernel_name}, options);
+}
+
+bool OpenCLRuntime::buildKernelsFromFile(const std::string& file_path,
+                                         const std::vector<std::string>& kernel_names,
+                                         const std::string& options) {
+  cl_int err;
+
+  // compiled once per file and options, later runs load the binary from disk
+  cl_program program = program_cache_.getProgramFromFile(file_path, options);
+  if (!program) {
+    LOG(ERROR) << "Failed to build program: " << file_path << "\n";
     return false;
   }
 
-  // create kernel
-  kernel_ = clCreateKernel(program_, kernel_name.c_str(), &err);
-  if (!kernel_ || err != CL_SUCCESS) {
-    LOG(ERROR) << "Failed to create kernel: " << kernel_name << "\n";
-    clReleaseProgram(program_);
-    program_ = nullptr;
-    return false;
+  for (const std::string& kernel_name : kernel_names) {
+    cl_kernel kernel = clCreateKernel(program, kernel_name.c_str(), &err);
+    if (!kernel || err != CL_SUCCESS) {
+      LOG(ERROR) << "Failed to create kernel: " << kernel_name << "\n";
+      return false;
+    }
+    // kernels still in use elsewhere keep their own reference
+    auto it = kernels_.find(kernel_name);
+    if (it != kernels_.end()) {
+      clReleaseKernel(it->second);
+      it->second = kernel;
+    } else {
+      kernels_.emplace(kernel_name, kernel);
+    }
+    kernel_ = kernel;
   }
 
   return true;
@@ -136,6 +135,19 @@ cl_kernel OpenCLRuntime::getKernel() const {
   return kernel_;
 }
 
+cl_kernel OpenCLRuntime::getKernel(const std::string& kernel_name) const {
+  auto it = kernels_.find(kernel_name);
+  return it == kernels_.end() ? nullptr : it->second;
+}
+
+bool OpenCLRuntime::hasKernel(const std::string& kernel_name) const {
+  return kernels_.count(kernel_name) != 0;
+}
+
+ProgramCache& OpenCLRuntime::programCache() {
+  return program_cache_;
+}
+
 cl_mem OpenCLRuntime::createBuffer(size_t size, cl_mem_flags flags, void* host_ptr) {
   cl_int err;
   cl_mem buf = clCreateBuffer(context_, flags, size, host_ptr, &err);
@@ -146,28 +158,89 @@ cl_mem OpenCLRuntime::createBuffer(size_t size, cl_mem_flags flags, void* host_p
   return buf;
 }
 
-void OpenCLRuntime::writeBuffer(cl_mem buf, const void* data, size_t size) {
-  cl_int err = clEnqueueWriteBuffer(queue_, buf, CL_TRUE, 0, size, data, 0, nullptr, nullptr);
+cl_mem OpenCLRuntime::acquireBuffer(const std::string& slot, size_t size, cl_mem_flags flags) {
+  return buffer_pool_.acquire(slot, size, flags);
+}
+
+bool OpenCLRuntime::writeBuffer(cl_mem buf, const void* data, size_t size) {
+  return writeBufferAsync(buf, data, size).wait();
+}
+
+bool OpenCLRuntime::readBuffer(cl_mem buf, void* data, size_t size) {
+  return readBufferAsync(buf, data, size).wait();
+}
+
+bool OpenCLRuntime::runKernel(const std::vector<size_t>& global, const std::vector<size_t>& local) {
+  return runKernelAsync(global, local).wait();
+}
+
+Event OpenCLRuntime::writeBufferAsync(cl_mem buf, const void* data, size_t size,
+                                      const std::vector<Event>& wait_list) {
+  std::vector<cl_event> waits;
+  cl_int err = Event::toWaitList(wait_list, &waits);
+  if (err != CL_SUCCESS) {
+    LOG(ERROR) << "Skipped buffer write, a dependency failed to enqueue.\n";
+    return Event::failure(err);
+  }
+  cl_event event = nullptr;
+  err = clEnqueueWriteBuffer(queue_, buf, CL_FALSE, 0, size, data,
+                             (cl_uint)waits.size(), waits.empty() ? nullptr : waits.data(), &event);
   if (err != CL_SUCCESS) {
     LOG(ERROR) << "Failed to write buffer.\n";
+    return Event::failure(err);
   }
-  clFinish(queue_);
+  return Event(event);
 }
 
-void OpenCLRuntime::readBuffer(cl_mem buf, void* data, size_t size) {
-  cl_int err = clEnqueueReadBuffer(queue_, buf, CL_TRUE, 0, size, data, 0, nullptr, nullptr);
+Event OpenCLRuntime::readBufferAsync(cl_mem buf, void* data, size_t size,
+                                     const std::vector<Event>& wait_list) {
+  std::vector<cl_event> waits;
+  cl_int err = Event::toWaitList(wait_list, &waits);
+  if (err != CL_SUCCESS) {
+    LOG(ERROR) << "Skipped buffer read, a dependency failed to enqueue.\n";
+    return Event::failure(err);
+  }
+  cl_event event = nullptr;
+  err = clEnqueueReadBuffer(queue_, buf, CL_FALSE, 0, size, data,
+                            (cl_uint)waits.size(), waits.empty() ? nullptr : waits.data(), &event);
   if (err != CL_SUCCESS) {
     LOG(ERROR) << "Failed to read buffer.\n";
+    return Event::failure(err);
   }
-  clFinish(queue_);
+  return Event(event);
 }
 
-void OpenCLRuntime::runKernel(const std::vector<size_t>& global, const std::vector<size_t>& local) {
-  CHECK(kernel_ != nullptr) << "cl_kernel is null\n";
-  cl_int err = clEnqueueNDRangeKernel(queue_, kernel_, (cl_uint)global.size(), nullptr, global.data(), local.data(), 0, nullptr, nullptr);
+Event OpenCLRuntime::runKernelAsync(const std::vector<size_t>& global, const std::vector<size_t>& local,
+                                    const std::vector<Event>& wait_list) {
+  return runKernelAsync(kernel_, global, local, wait_list);
+}
+
+Event OpenCLRuntime::runKernelAsync(cl_kernel kernel,
+                                    const std::vector<size_t>& global, const std::vector<size_t>& local,
+                                    const std::vector<Event>& wait_list) {
+  CHECK(kernel != nullptr) << "cl_kernel is null\n";
+  std::vector<cl_event> waits;
+  cl_int err = Event::toWaitList(wait_list, &waits);
+  if (err != CL_SUCCESS) {
+    LOG(ERROR) << "Skipped kernel, a dependency failed to enqueue.\n";
+    return Event::failure(err);
+  }
+  cl_event event = nullptr;
+  err = clEnqueueNDRangeKernel(queue_, kernel, (cl_uint)global.size(), nullptr, global.data(),
+                               local.empty() ? nullptr : local.data(),
+                               (cl_uint)waits.size(), waits.empty() ? nullptr : waits.data(), &event);
   if (err != CL_SUCCESS) {
     LOG(ERROR) << "Failed to enqueue kernel.\n";
+    return Event::failure(err);
   }
+  return Event(event);
+}
+
+void OpenCLRuntime::flush() {
+  clFlush(queue_);
+}
+
+void OpenCLRuntime::finish() {
   clFinish(queue_);
 }
 
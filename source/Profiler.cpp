@@ -0,0 +1,133 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <glog/logging.h>
+#include <map>
+
+namespace kumo {
+
+namespace {
+
+// a long benchmark loop should not hold thousands of events
+constexpr size_t kMaxPending = 256;
+
+double toMs(cl_ulong ns) {
+  return ns * 1e-6;
+}
+
+double toUs(cl_ulong ns) {
+  return ns * 1e-3;
+}
+
+}
+
+double StageStats::averageMs() const {
+  return count ? total_ms / count : 0.0;
+}
+
+double StageStats::gbPerSecond() const {
+  return total_ms > 0.0 ? bytes / (total_ms * 1e6) : 0.0;
+}
+
+void Profiler::record(const std::string& stage, cl_event event, size_t bytes) {
+  if (!event) return;
+  pending_.push_back({stage, Event(event), bytes});
+  if (pending_.size() >= kMaxPending) collect();
+}
+
+bool Profiler::collect() {
+  bool ok = true;
+  for (const Pending& pending : pending_) {
+    if (!pending.event.wait()) {
+      ok = false;
+      continue;
+    }
+    ProfiledCommand command;
+    command.stage = pending.stage;
+    command.bytes = pending.bytes;
+    const cl_profiling_info params[] = {CL_PROFILING_COMMAND_QUEUED, CL_PROFILING_COMMAND_SUBMIT,
+                                        CL_PROFILING_COMMAND_START, CL_PROFILING_COMMAND_END};
+    cl_ulong* values[] = {&command.queued, &command.submit, &command.start, &command.end};
+    cl_int err = CL_SUCCESS;
+    for (int i = 0; i < 4 && err == CL_SUCCESS; ++i) {
+      err = clGetEventProfilingInfo(pending.event.get(), params[i], sizeof(cl_ulong),
+                                    values[i], nullptr);
+    }
+    if (err != CL_SUCCESS) {
+      // queue without CL_QUEUE_PROFILING_ENABLE
+      ok = false;
+      continue;
+    }
+    commands_.push_back(command);
+  }
+  pending_.clear();
+  if (!ok) LOG(ERROR) << "Some commands had no profiling info.\n";
+  return ok;
+}
+
+void Profiler::clear() {
+  pending_.clear();
+  commands_.clear();
+}
+
+const std::vector<ProfiledCommand>& Profiler::commands() const {
+  return commands_;
+}
+
+StageStats Profiler::stage(const std::string& name) const {
+  StageStats stats;
+  for (const ProfiledCommand& command : commands_) {
+    if (command.stage != name) continue;
+    ++stats.count;
+    stats.total_ms += toMs(command.end - command.start);
+    stats.bytes += command.bytes;
+  }
+  return stats;
+}
+
+double Profiler::spanMs() const {
+  if (commands_.empty()) return 0.0;
+  cl_ulong first = commands_.front().queued;
+  cl_ulong last = commands_.front().end;
+  for (const ProfiledCommand& command : commands_) {
+    first = std::min(first, command.queued);
+    last = std::max(last, command.end);
+  }
+  return toMs(last - first);
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) const {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file.is_open()) {
+    LOG(ERROR) << "Failed to write trace: " << path << "\n";
+    return false;
+  }
+
+  cl_ulong origin = 0;
+  for (size_t i = 0; i < commands_.size(); ++i) {
+    if (i == 0 || commands_[i].queued < origin) origin = commands_[i].queued;
+  }
+  // one trace row per stage, in order of first appearance
+  std::map<std::string, int> rows;
+
+  file << "{\"traceEvents\":[";
+  for (size_t i = 0; i < commands_.size(); ++i) {
+    const ProfiledCommand& command = commands_[i];
+    auto row = rows.emplace(command.stage, (int)rows.size()).first;
+    file << (i ? "," : "") << "\n{\"name\":\"" << command.stage
+         << "\",\"cat\":\"opencl\",\"ph\":\"X\",\"pid\":0,\"tid\":" << row->second
+         << ",\"ts\":" << toUs(command.start - origin)
+         << ",\"dur\":" << toUs(command.end - command.start)
+         << ",\"args\":{\"queued_us\":" << toUs(command.queued - origin)
+         << ",\"submit_us\":" << toUs(command.submit - origin)
+         << ",\"bytes\":" << command.bytes << "}}";
+  }
+  for (const auto& row : rows) {
+    file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << row.second
+         << ",\"args\":{\"name\":\"" << row.first << "\"}}";
+  }
+  file << "\n]}\n";
+  return true;
+}
+
+}
@@ -0,0 +1,247 @@
+#include "ProgramCache.h"
+#include "DeviceSelector.h"
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <glog/logging.h>
+#include <iterator>
+#include <vector>
+
+namespace kumo {
+
+namespace {
+
+uint64_t fnv1a(const std::string& data, uint64_t hash = 1469598103934665603ull) {
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+}
+
+ProgramCache::ProgramCache()
+  : context_(nullptr), device_(nullptr), cache_dir_(defaultCacheDir()),
+    compiles_(0), binary_loads_(0) {}
+
+ProgramCache::~ProgramCache() {
+  clear();
+}
+
+void ProgramCache::setDevice(cl_context context, cl_device_id device) {
+  clear();
+  context_ = context;
+  device_ = device;
+  device_id_.clear();
+  if (device_) {
+    device_id_ = deviceString(device_, CL_DEVICE_NAME) + "|" +
+                 deviceString(device_, CL_DEVICE_VENDOR) + "|" +
+                 deviceString(device_, CL_DEVICE_VERSION) + "|" +
+                 deviceString(device_, CL_DRIVER_VERSION);
+  }
+}
+
+void ProgramCache::setCacheDir(const std::string& dir) {
+  cache_dir_ = dir;
+}
+
+const std::string& ProgramCache::cacheDir() const {
+  return cache_dir_;
+}
+
+std::string ProgramCache::makeKey(const std::string& source, const std::string& options) const {
+  uint64_t hash = fnv1a(source);
+  hash = fnv1a(std::string(1, '\0') + options, hash);
+  hash = fnv1a(std::string(1, '\0') + device_id_, hash);
+  char key[17];
+  std::snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash));
+  return key;
+}
+
+bool ProgramCache::readSource(const std::string& file_path, std::string* source) {
+  std::ifstream file(file_path);
+  if (!file.is_open()) {
+    LOG(ERROR) << "Failed to open kernel file: " << file_path << "\n";
+    return false;
+  }
+  source->assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  return true;
+}
+
+cl_program ProgramCache::getProgramFromFile(const std::string& file_path, const std::string& options) {
+  std::string source;
+  if (!readSource(file_path, &source)) return nullptr;
+  return getProgram(source, options);
+}
+
+cl_program ProgramCache::getProgram(const std::string& source, const std::string& options) {
+  Entry* entry = findOrBuild(source, options, makeKey(source, options));
+  if (!entry) return nullptr;
+  entry->pinned = true;
+  return entry->program;
+}
+
+cl_program ProgramCache::acquireProgramFromFile(const std::string& file_path,
+                                                const std::string& options, std::string* key) {
+  std::string source;
+  if (!readSource(file_path, &source)) return nullptr;
+  return acquireProgram(source, options, key);
+}
+
+cl_program ProgramCache::acquireProgram(const std::string& source, const std::string& options,
+                                        std::string* key) {
+  *key = makeKey(source, options);
+  Entry* entry = findOrBuild(source, options, *key);
+  if (!entry) return nullptr;
+  ++entry->holders;
+  return entry->program;
+}
+
+void ProgramCache::releaseProgram(const std::string& key) {
+  auto it = programs_.find(key);
+  // already gone with clear()
+  if (it == programs_.end() || it->second.holders == 0) return;
+  if (--it->second.holders == 0 && !it->second.pinned) {
+    clReleaseProgram(it->second.program);
+    programs_.erase(it);
+  }
+}
+
+ProgramCache::Entry* ProgramCache::findOrBuild(const std::string& source,
+                                               const std::string& options,
+                                               const std::string& key) {
+  if (!context_ || !device_) {
+    LOG(ERROR) << "ProgramCache has no device.\n";
+    return nullptr;
+  }
+
+  auto it = programs_.find(key);
+  if (it != programs_.end()) return &it->second;
+
+  std::string binary_path;
+  if (!cache_dir_.empty()) {
+    binary_path = (std::filesystem::path(cache_dir_) / (key + ".bin")).string();
+    cl_program program = loadBinary(binary_path, options);
+    if (program) {
+      ++binary_loads_;
+      return &programs_.emplace(key, Entry{program, 0, false}).first->second;
+    }
+  }
+
+  cl_int err;
+  const char* source_cstr = source.c_str();
+  size_t source_size = source.size();
+  cl_program program = clCreateProgramWithSource(context_, 1, &source_cstr, &source_size, &err);
+  if (!program || err != CL_SUCCESS) {
+    LOG(ERROR) << "Failed to create CL program from source.\n";
+    return nullptr;
+  }
+  if (!build(program, options)) {
+    clReleaseProgram(program);
+    return nullptr;
+  }
+  ++compiles_;
+
+  if (!binary_path.empty()) storeBinary(program, binary_path);
+  return &programs_.emplace(key, Entry{program, 0, false}).first->second;
+}
+
+bool ProgramCache::build(cl_program program, const std::string& options) {
+  cl_int err = clBuildProgram(program, 1, &device_, options.c_str(), nullptr, nullptr);
+  if (err != CL_SUCCESS) {
+    size_t log_size = 0;
+    clGetProgramBuildInfo(program, device_, CL_PROGRAM_BUILD_LOG, 0, nullptr, &log_size);
+    std::vector<char> log(log_size + 1, '\0');
+    clGetProgramBuildInfo(program, device_, CL_PROGRAM_BUILD_LOG, log_size, log.data(), nullptr);
+    LOG(ERROR) << "Error building program:\n" << log.data() << "\n";
+    return false;
+  }
+  return true;
+}
+
+cl_program ProgramCache::loadBinary(const std::string& path, const std::string& options) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) return nullptr;
+  std::vector<unsigned char> binary((std::istreambuf_iterator<char>(file)),
+                                    std::istreambuf_iterator<char>());
+  if (binary.empty()) return nullptr;
+
+  cl_int err;
+  cl_int binary_status;
+  const unsigned char* data = binary.data();
+  size_t size = binary.size();
+  cl_program program = clCreateProgramWithBinary(context_, 1, &device_, &size, &data,
+                                                 &binary_status, &err);
+  if (!program || err != CL_SUCCESS || binary_status != CL_SUCCESS) {
+    // stale or corrupt file, fall back to the source and overwrite it
+    LOG(ERROR) << "Ignoring cached program binary: " << path << "\n";
+    if (program) clReleaseProgram(program);
+    return nullptr;
+  }
+  // a binary still has to be built before kernels can be created
+  if (!build(program, options)) {
+    clReleaseProgram(program);
+    return nullptr;
+  }
+  return program;
+}
+
+void ProgramCache::storeBinary(cl_program program, const std::string& path) {
+  size_t size = 0;
+  cl_int err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, nullptr);
+  if (err != CL_SUCCESS || size == 0) return;
+  std::vector<unsigned char> binary(size);
+  unsigned char* data = binary.data();
+  err = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(data), &data, nullptr);
+  if (err != CL_SUCCESS) {
+    LOG(ERROR) << "Failed to get program binary.\n";
+    return;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(cache_dir_, ec);
+  if (ec) {
+    LOG(ERROR) << "Failed to create program cache directory: " << cache_dir_ << "\n";
+    return;
+  }
+  // write then rename, a concurrent process never reads a partial file
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return;
+    file.write(reinterpret_cast<const char*>(binary.data()), binary.size());
+  }
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) std::filesystem::remove(tmp_path, ec);
+}
+
+void ProgramCache::clear() {
+  for (auto& entry : programs_) {
+    clReleaseProgram(entry.second.program);
+  }
+  programs_.clear();
+}
+
+size_t ProgramCache::compileCount() const {
+  return compiles_;
+}
+
+size_t ProgramCache::binaryLoadCount() const {
+  return binary_loads_;
+}
+
+std::string ProgramCache::defaultCacheDir() {
+  if (const char* dir = std::getenv("KUMO_CL_CACHE_DIR")) return dir;
+  if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+    return (std::filesystem::path(xdg) / "kumo_cl").string();
+  }
+  if (const char* home = std::getenv("HOME")) {
+    return (std::filesystem::path(home) / ".cache" / "kumo_cl").string();
+  }
+  std::error_code ec;
+  return (std::filesystem::temp_directory_path(ec) / "kumo_cl").string();
+}
+
+}
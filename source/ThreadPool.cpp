@@ -0,0 +1,85 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace kumo {
+
+ThreadPool::ThreadPool(size_t num_threads) : stop_(false) {
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  // the thread calling parallelFor is the last worker
+  for (size_t i = 1; i < num_threads; ++i) {
+    workers_.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+size_t ThreadPool::size() const {
+  return workers_.size() + 1;
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, const std::function<void(size_t)>& fn) {
+  if (begin >= end) return;
+
+  struct Job {
+    std::atomic<size_t> next;
+    std::atomic<size_t> running;
+    std::mutex mutex;
+    std::condition_variable done;
+  };
+  auto job = std::make_shared<Job>();
+  job->next = begin;
+
+  auto drain = [job, end, &fn]() {
+    for (size_t i = job->next++; i < end; i = job->next++) {
+      fn(i);
+    }
+  };
+
+  const size_t helpers = std::min(workers_.size(), end - begin - 1);
+  job->running = helpers;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < helpers; ++i) {
+      tasks_.emplace_back([job, drain]() {
+        drain();
+        std::lock_guard<std::mutex> job_lock(job->mutex);
+        if (--job->running == 0) job->done.notify_one();
+      });
+    }
+  }
+  cv_.notify_all();
+
+  drain();
+
+  std::unique_lock<std::mutex> lock(job->mutex);
+  job->done.wait(lock, [&job]() { return job->running == 0; });
+}
+
+void ThreadPool::workerLoop() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+      if (stop_ && tasks_.empty()) return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+}
@@ -0,0 +1,122 @@
+#include "TuningDatabase.h"
+#include "ProgramCache.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <glog/logging.h>
+#include <sstream>
+#include <tuple>
+
+namespace kumo {
+
+bool TuningKey::operator<(const TuningKey& other) const {
+  return std::tie(device, kernel, width, height, radius, channels) <
+         std::tie(other.device, other.kernel, other.width, other.height,
+                  other.radius, other.channels);
+}
+
+TuningDatabase::TuningDatabase(const std::string& path) : path_(path) {}
+
+bool TuningDatabase::load() {
+  if (path_.empty()) return false;
+  std::ifstream file(path_);
+  if (!file.is_open()) return false;
+
+  // device \t kernel \t width \t height \t radius \t channels \t ms \t p0,p1,...
+  std::string line;
+  size_t line_no = 0;
+  while (std::getline(file, line)) {
+    ++line_no;
+    if (line.empty() || line[0] == '#') continue;
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, '\t')) fields.push_back(field);
+    if (fields.size() != 8) {
+      LOG(ERROR) << "Ignoring malformed tuning entry " << path_ << ":" << line_no << "\n";
+      continue;
+    }
+
+    TuningKey key;
+    TuningResult result;
+    key.device = fields[0];
+    key.kernel = fields[1];
+    key.width = std::atoi(fields[2].c_str());
+    key.height = std::atoi(fields[3].c_str());
+    key.radius = std::atoi(fields[4].c_str());
+    key.channels = std::atoi(fields[5].c_str());
+    result.ms = std::atof(fields[6].c_str());
+    std::stringstream params(fields[7]);
+    while (std::getline(params, field, ',')) {
+      if (!field.empty()) result.params.push_back(std::atoi(field.c_str()));
+    }
+    entries_[key] = result;
+  }
+  return true;
+}
+
+bool TuningDatabase::save() const {
+  if (path_.empty()) return false;
+  std::error_code ec;
+  const std::filesystem::path path(path_);
+  if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path(), ec);
+
+  const std::string tmp_path = path_ + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::trunc);
+    if (!file.is_open()) {
+      LOG(ERROR) << "Failed to write tuning database: " << tmp_path << "\n";
+      return false;
+    }
+    file << "# device\tkernel\twidth\theight\tradius\tchannels\tms\tparams\n";
+    for (const auto& entry : entries_) {
+      const TuningKey& key = entry.first;
+      file << key.device << '\t' << key.kernel << '\t' << key.width << '\t'
+           << key.height << '\t' << key.radius << '\t' << key.channels << '\t'
+           << entry.second.ms << '\t';
+      for (size_t i = 0; i < entry.second.params.size(); ++i) {
+        file << (i ? "," : "") << entry.second.params[i];
+      }
+      file << '\n';
+    }
+  }
+  std::filesystem::rename(tmp_path, path_, ec);
+  if (ec) {
+    LOG(ERROR) << "Failed to replace tuning database: " << path_ << "\n";
+    std::filesystem::remove(tmp_path, ec);
+    return false;
+  }
+  return true;
+}
+
+bool TuningDatabase::find(const TuningKey& key, TuningResult* result) const {
+  auto it = entries_.find(key);
+  if (it == entries_.end()) return false;
+  if (result) *result = it->second;
+  return true;
+}
+
+void TuningDatabase::store(const TuningKey& key, const TuningResult& result) {
+  entries_[key] = result;
+}
+
+void TuningDatabase::clear() {
+  entries_.clear();
+}
+
+size_t TuningDatabase::size() const {
+  return entries_.size();
+}
+
+const std::string& TuningDatabase::path() const {
+  return path_;
+}
+
+std::string TuningDatabase::defaultPath() {
+  if (const char* path = std::getenv("KUMO_CL_TUNING_FILE")) return path;
+  const std::string dir = ProgramCache::defaultCacheDir();
+  if (dir.empty()) return std::string();
+  return (std::filesystem::path(dir) / "tuning.tsv").string();
+}
+
+}
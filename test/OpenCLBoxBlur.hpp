@@ -0,0 +1,322 @@
+#pragma once
+
+#include "BufferPool.h"
+#include "GaussianKernel.h"
+#include "OpenCLConvolution.hpp"
+#include "OpenCLRuntime.h"
+#include <CL/cl.h>
+#include <iostream>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <utility>
+#include <vector>
+
+namespace kumo {
+
+constexpr const char* kScanKernelPath =
+  "/home/kumo/dev/hello_ocl_runtime/test_scan/scan.cl";
+constexpr const char* kBoxBlurKernelPath =
+  "/home/kumo/dev/hello_ocl_runtime/kernels/box_blur.cl";
+
+// Approximate Gaussian from three box filters (widths from boxBlurRadii).
+// Every channel of every row becomes an int line that the Blelloch scan and
+// uniform_add of test_scan/scan.cl turn into an exclusive prefix sum, each
+// box is then two reads per pixel whatever its radius. The columns run the
+// same way on the transposed planes. Cost per pixel is independent of sigma.
+//
+// Lines are padded to tile_size * 2^k elements, longer than the line itself.
+// The first scan then covers whole lines with whole tiles, and the second
+// scan over the tile sums has one work-group per line, so the prefix sums
+// restart at every line without a segmented scan.
+class OpenCLBoxBlur {
+public:
+  explicit OpenCLBoxBlur(std::shared_ptr<OpenCLRuntime> runtime = nullptr)
+      : runtime_(std::move(runtime)), own_runtime_(false), context_(nullptr),
+        queue_(nullptr), kernel_scan_(nullptr), kernel_uniform_add_(nullptr),
+        kernel_deinterleave_(nullptr), kernel_box_(nullptr),
+        kernel_transpose_(nullptr), kernel_interleave_(nullptr), tile_size_(0) {};
+  ~OpenCLBoxBlur() { UnInit(); };
+
+  bool Init();
+  void UnInit();
+
+  // 3 or 4 channel 8-bit input, borders replicate
+  bool Run(const cv::Mat& input, float sigma, cv::Mat& output);
+
+  int TileSize() const;
+
+private:
+  bool BuildKernel(const char* source_path, const char* kernel_func_name, cl_kernel* out_kernel);
+  size_t LinePitch(int length) const;
+  // Exclusive prefix sum of num_lines lines of pitch elements, in place.
+  bool ScanLines(cl_mem lines, cl_mem tile_sums, size_t num_lines, size_t pitch);
+  bool BoxLines(cl_mem sat, cl_mem dst, int length, size_t pitch, size_t num_lines, int radius);
+  bool Enqueue(cl_kernel kernel, cl_uint dims, const size_t* global, const size_t* local);
+
+  std::shared_ptr<OpenCLRuntime> runtime_;
+  bool own_runtime_;
+  // borrowed from runtime_
+  cl_context context_;
+  cl_command_queue queue_;
+  cl_kernel kernel_scan_;
+  cl_kernel kernel_uniform_add_;
+  cl_kernel kernel_deinterleave_;
+  cl_kernel kernel_box_;
+  cl_kernel kernel_transpose_;
+  cl_kernel kernel_interleave_;
+  size_t tile_size_;
+  BufferPool buffer_pool_;
+};
+
+inline bool OpenCLBoxBlur::Init() {
+  if (!runtime_) {
+    runtime_ = std::make_shared<OpenCLRuntime>();
+    own_runtime_ = true;
+  }
+  if (!runtime_->isInitialized() && !runtime_->init()) {
+    std::cerr << "OpenCLRuntime init failed" << std::endl;
+    if (own_runtime_) runtime_.reset();
+    own_runtime_ = false;
+    return false;
+  }
+  context_ = runtime_->context();
+  queue_ = runtime_->queue();
+  buffer_pool_.setContext(context_);
+
+  // one work-group scans one tile, the largest power of two up to 256
+  const size_t max_wg = runtime_->deviceInfo().max_work_group_size;
+  tile_size_ = 256;
+  while (max_wg && tile_size_ > max_wg) tile_size_ /= 2;
+
+  bool ok = BuildKernel(kScanKernelPath, "scan", &kernel_scan_);
+  ok &= BuildKernel(kScanKernelPath, "uniform_add", &kernel_uniform_add_);
+  ok &= BuildKernel(kBoxBlurKernelPath, "box_deinterleave", &kernel_deinterleave_);
+  ok &= BuildKernel(kBoxBlurKernelPath, "box_from_sat", &kernel_box_);
+  ok &= BuildKernel(kBoxBlurKernelPath, "box_transpose", &kernel_transpose_);
+  ok &= BuildKernel(kBoxBlurKernelPath, "box_interleave", &kernel_interleave_);
+  if (!ok) {
+    UnInit();
+    return false;
+  }
+  return true;
+}
+
+inline bool OpenCLBoxBlur::BuildKernel(const char* source_path,
+                                       const char* kernel_func_name,
+                                       cl_kernel* out_kernel) {
+  if (!runtime_->buildKernelFromFile(source_path, kernel_func_name)) {
+    std::cerr << "Build " << kernel_func_name << " failed from " << source_path << std::endl;
+    return false;
+  }
+  // the runtime may replace its kernel later, keep a reference of our own
+  cl_kernel kernel = runtime_->getKernel(kernel_func_name);
+  clRetainKernel(kernel);
+  *out_kernel = kernel;
+  return true;
+}
+
+inline void OpenCLBoxBlur::UnInit() {
+  buffer_pool_.clear();
+  cl_kernel* kernels[] = {&kernel_scan_, &kernel_uniform_add_, &kernel_deinterleave_,
+                          &kernel_box_, &kernel_transpose_, &kernel_interleave_};
+  for (cl_kernel* kernel : kernels) {
+    if (*kernel) clReleaseKernel(*kernel);
+    *kernel = nullptr;
+  }
+  // context and queue belong to the runtime
+  if (own_runtime_) runtime_.reset();
+  own_runtime_ = false;
+  context_ = nullptr;
+  queue_ = nullptr;
+}
+
+inline size_t OpenCLBoxBlur::LinePitch(int length) const {
+  // one spare element, sat[length] is the sum of the whole line
+  size_t tiles = 1;
+  while (tiles * tile_size_ < (size_t)length + 1) tiles *= 2;
+  return tiles * tile_size_;
+}
+
+inline bool OpenCLBoxBlur::Enqueue(cl_kernel kernel, cl_uint dims,
+                                   const size_t* global, const size_t* local) {
+  cl_int err = clEnqueueNDRangeKernel(queue_, kernel, dims, nullptr, global, local,
+                                      0, nullptr, nullptr);
+  if (err != CL_SUCCESS) {
+    std::cerr << "clEnqueueNDRangeKernel failed return " << err << std::endl;
+    return false;
+  }
+  return true;
+}
+
+inline bool OpenCLBoxBlur::ScanLines(cl_mem lines, cl_mem tile_sums,
+                                     size_t num_lines, size_t pitch) {
+  const cl_int n = (cl_int)(num_lines * pitch);
+  const cl_int tile = (cl_int)tile_size_;
+  const size_t tiles_per_line = pitch / tile_size_;
+  const cl_int num_tiles = (cl_int)(num_lines * tiles_per_line);
+  cl_mem no_sums = nullptr;
+
+  // tiles, then the tile sums of each line, then add the offsets back
+  int arg_index = 0;
+  cl_int err = clSetKernelArg(kernel_scan_, arg_index++, sizeof(cl_mem), &lines);
+  err |= clSetKernelArg(kernel_scan_, arg_index++, sizeof(cl_mem), &tile_sums);
+  err |= clSetKernelArg(kernel_scan_, arg_index++, tile_size_ * sizeof(int), nullptr);
+  err |= clSetKernelArg(kernel_scan_, arg_index++, sizeof(cl_int), &n);
+  size_t global = n;
+  if (err != CL_SUCCESS || !Enqueue(kernel_scan_, 1, &global, &tile_size_)) {
+    std::cerr << "scan tiles failed" << std::endl;
+    return false;
+  }
+
+  arg_index = 0;
+  err  = clSetKernelArg(kernel_scan_, arg_index++, sizeof(cl_mem), &tile_sums);
+  err |= clSetKernelArg(kernel_scan_, arg_index++, sizeof(cl_mem), &no_sums);
+  err |= clSetKernelArg(kernel_scan_, arg_index++, tiles_per_line * sizeof(int), nullptr);
+  err |= clSetKernelArg(kernel_scan_, arg_index++, sizeof(cl_int), &num_tiles);
+  global = num_tiles;
+  if (err != CL_SUCCESS || !Enqueue(kernel_scan_, 1, &global, &tiles_per_line)) {
+    std::cerr << "scan tile sums failed" << std::endl;
+    return false;
+  }
+
+  arg_index = 0;
+  err  = clSetKernelArg(kernel_uniform_add_, arg_index++, sizeof(cl_mem), &lines);
+  err |= clSetKernelArg(kernel_uniform_add_, arg_index++, sizeof(cl_mem), &tile_sums);
+  err |= clSetKernelArg(kernel_uniform_add_, arg_index++, sizeof(cl_int), &n);
+  err |= clSetKernelArg(kernel_uniform_add_, arg_index++, sizeof(cl_int), &tile);
+  global = n;
+  if (err != CL_SUCCESS || !Enqueue(kernel_uniform_add_, 1, &global, &tile_size_)) {
+    std::cerr << "uniform_add failed" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+inline bool OpenCLBoxBlur::BoxLines(cl_mem sat, cl_mem dst, int length, size_t pitch,
+                                    size_t num_lines, int radius) {
+  const cl_int width = length, line_pitch = (cl_int)pitch, lines = (cl_int)num_lines;
+  int arg_index = 0;
+  cl_int err = clSetKernelArg(kernel_box_, arg_index++, sizeof(cl_mem), &sat);
+  err |= clSetKernelArg(kernel_box_, arg_index++, sizeof(cl_mem), &dst);
+  err |= clSetKernelArg(kernel_box_, arg_index++, sizeof(cl_int), &width);
+  err |= clSetKernelArg(kernel_box_, arg_index++, sizeof(cl_int), &line_pitch);
+  err |= clSetKernelArg(kernel_box_, arg_index++, sizeof(cl_int), &lines);
+  err |= clSetKernelArg(kernel_box_, arg_index++, sizeof(cl_int), &radius);
+  if (err != CL_SUCCESS) {
+    std::cerr << "RunKernel failed" << std::endl;
+    return false;
+  }
+  const size_t global[2] = {pitch, num_lines};
+  return Enqueue(kernel_box_, 2, global, nullptr);
+}
+
+inline bool OpenCLBoxBlur::Run(const cv::Mat& input, float sigma, cv::Mat& output) {
+  if (!kernel_scan_) return false;
+  CV_Assert(input.depth() == CV_8U && input.isContinuous());
+  const cl_int width = input.cols;
+  const cl_int height = input.rows;
+  const cl_int channels = input.channels();
+  const size_t image_size = (size_t)width * height * channels;
+  const std::vector<int> radii = boxBlurRadii(sigma, 3);
+
+  // rows are lines of pitch_x, after the transpose columns are lines of pitch_y
+  const size_t pitch_x = LinePitch(width);
+  const size_t pitch_y = LinePitch(height);
+  const size_t row_lines = (size_t)channels * height;
+  const size_t col_lines = (size_t)channels * width;
+  const size_t line_size = std::max(row_lines * pitch_x, col_lines * pitch_y);
+
+  cl_mem input_buf = buffer_pool_.acquire("input", image_size, CL_MEM_READ_ONLY);
+  cl_mem output_buf = buffer_pool_.acquire("output", image_size, CL_MEM_WRITE_ONLY);
+  cl_mem lines = buffer_pool_.acquire("lines_a", line_size * sizeof(int), CL_MEM_READ_WRITE);
+  cl_mem spare = buffer_pool_.acquire("lines_b", line_size * sizeof(int), CL_MEM_READ_WRITE);
+  cl_mem tile_sums = buffer_pool_.acquire("tile_sums",
+    line_size / tile_size_ * sizeof(int), CL_MEM_READ_WRITE);
+  if (!input_buf || !output_buf || !lines || !spare || !tile_sums) {
+    std::cerr << "acquire device buffers failed" << std::endl;
+    return false;
+  }
+
+  cl_int err = clEnqueueWriteBuffer(queue_, input_buf, CL_FALSE, 0, image_size,
+                                    input.data, 0, nullptr, nullptr);
+  if (err != CL_SUCCESS) {
+    std::cerr << "clEnqueueWriteBuffer input failed return " << err << std::endl;
+    return false;
+  }
+
+  cl_int pitch = (cl_int)pitch_x;
+  int arg_index = 0;
+  err  = clSetKernelArg(kernel_deinterleave_, arg_index++, sizeof(cl_mem), &input_buf);
+  err |= clSetKernelArg(kernel_deinterleave_, arg_index++, sizeof(cl_mem), &lines);
+  err |= clSetKernelArg(kernel_deinterleave_, arg_index++, sizeof(cl_int), &width);
+  err |= clSetKernelArg(kernel_deinterleave_, arg_index++, sizeof(cl_int), &height);
+  err |= clSetKernelArg(kernel_deinterleave_, arg_index++, sizeof(cl_int), &channels);
+  err |= clSetKernelArg(kernel_deinterleave_, arg_index++, sizeof(cl_int), &pitch);
+  const size_t deinterleave_global[2] = {pitch_x, (size_t)height};
+  if (err != CL_SUCCESS || !Enqueue(kernel_deinterleave_, 2, deinterleave_global, nullptr)) {
+    std::cerr << "box_deinterleave failed" << std::endl;
+    return false;
+  }
+
+  for (int radius : radii) {
+    if (!ScanLines(lines, tile_sums, row_lines, pitch_x) ||
+        !BoxLines(lines, spare, width, pitch_x, row_lines, radius)) {
+      return false;
+    }
+    std::swap(lines, spare);
+  }
+
+  const cl_int src_pitch = (cl_int)pitch_x, dst_pitch = (cl_int)pitch_y;
+  arg_index = 0;
+  err  = clSetKernelArg(kernel_transpose_, arg_index++, sizeof(cl_mem), &lines);
+  err |= clSetKernelArg(kernel_transpose_, arg_index++, sizeof(cl_mem), &spare);
+  err |= clSetKernelArg(kernel_transpose_, arg_index++, sizeof(cl_int), &width);
+  err |= clSetKernelArg(kernel_transpose_, arg_index++, sizeof(cl_int), &height);
+  err |= clSetKernelArg(kernel_transpose_, arg_index++, sizeof(cl_int), &src_pitch);
+  err |= clSetKernelArg(kernel_transpose_, arg_index++, sizeof(cl_int), &dst_pitch);
+  // y spans the padded line so the padding of the transposed lines is zeroed
+  const size_t transpose_local[3] = {16, 16, 1};
+  const size_t transpose_global[3] = {RoundUp(width, 16), RoundUp(pitch_y, 16),
+                                      (size_t)channels};
+  if (err != CL_SUCCESS ||
+      !Enqueue(kernel_transpose_, 3, transpose_global, transpose_local)) {
+    std::cerr << "box_transpose failed" << std::endl;
+    return false;
+  }
+  std::swap(lines, spare);
+
+  for (int radius : radii) {
+    if (!ScanLines(lines, tile_sums, col_lines, pitch_y) ||
+        !BoxLines(lines, spare, height, pitch_y, col_lines, radius)) {
+      return false;
+    }
+    std::swap(lines, spare);
+  }
+
+  pitch = (cl_int)pitch_y;
+  arg_index = 0;
+  err  = clSetKernelArg(kernel_interleave_, arg_index++, sizeof(cl_mem), &lines);
+  err |= clSetKernelArg(kernel_interleave_, arg_index++, sizeof(cl_mem), &output_buf);
+  err |= clSetKernelArg(kernel_interleave_, arg_index++, sizeof(cl_int), &width);
+  err |= clSetKernelArg(kernel_interleave_, arg_index++, sizeof(cl_int), &height);
+  err |= clSetKernelArg(kernel_interleave_, arg_index++, sizeof(cl_int), &channels);
+  err |= clSetKernelArg(kernel_interleave_, arg_index++, sizeof(cl_int), &pitch);
+  const size_t interleave_global[2] = {(size_t)width, (size_t)height};
+  if (err != CL_SUCCESS || !Enqueue(kernel_interleave_, 2, interleave_global, nullptr)) {
+    std::cerr << "box_interleave failed" << std::endl;
+    return false;
+  }
+
+  output.create(input.rows, input.cols, input.type());
+  err = clEnqueueReadBuffer(queue_, output_buf, CL_TRUE, 0, image_size,
+                            output.data, 0, nullptr, nullptr);
+  if (err != CL_SUCCESS) {
+    std::cerr << "clEnqueueReadBuffer failed return " << err << std::endl;
+    return false;
+  }
+  return true;
+}
+
+inline int OpenCLBoxBlur::TileSize() const { return (int)tile_size_; }
+
+}
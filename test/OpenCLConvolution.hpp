@@ -1,23 +1,168 @@
 #pragma once
 
+#include "BufferPool.h"
+#include "GaussianKernel.h"
+#include "KernelDecomposition.h"
+#include "OpenCLRuntime.h"
+#include "Profiler.h"
+#include "TuningDatabase.h"
 #include <CL/cl.h>
 #include <CL/cl_platform.h>
+#include <algorithm>
 #include <benchmark/benchmark.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <opencv2/core/hal/interface.h>
 #include <sstream>
 #include <string>
+#include <iomanip>
 #include <iostream>
+#include <list>
+#include <memory>
+#include <numeric>
 #include <opencv2/opencv.hpp>
 
 namespace kumo {
 
+// kCopy uploads and downloads through clEnqueueWrite/ReadBuffer.
+// kZeroCopy wraps host memory with CL_MEM_USE_HOST_PTR/CL_MEM_ALLOC_HOST_PTR
+// and maps the result, which avoids the copies on CPU and integrated GPU
+// devices that share memory with the host.
+enum class MemoryMode { kCopy, kZeroCopy };
+
+// kNaive reads every tap from global memory, kTiled stages a block plus its
+// apron into local memory first. kFused runs both passes in one kernel and
+// keeps the row-filtered tile in local memory, no temp buffer is needed.
+// kSpecialized builds the two passes for one radius, channel count and
+// coefficient set, the tap loops unroll and the taps become literals.
+// kImage samples CL_RGBA images through a linear clamp-to-edge sampler and
+// merges pairs of taps into one bilinear fetch, it needs image support.
+// kFolded adds mirrored taps before multiplying, (p[-k] + p[k]) * w[k].
+// kFixedPoint folds as well and works in integers with Q0.16 weights and a
+// Q8.8 ushort intermediate, matching CpuArithmetic::kFixedPoint. Both take
+// any channel count and fall back to kNaive for asymmetric kernels,
+// kFixedPoint to kFolded for kernels quantizeKernelQ16 rejects.
+enum class KernelVariant { kNaive, kTiled, kFused, kSpecialized, kImage, kFolded, kFixedPoint };
+
+// Short name of a variant for benchmark labels, "unknown" out of range.
+inline const char* KernelVariantName(KernelVariant variant) {
+  switch (variant) {
+    case KernelVariant::kNaive: return "naive";
+    case KernelVariant::kTiled: return "tiled";
+    case KernelVariant::kFused: return "fused";
+    case KernelVariant::kSpecialized: return "specialized";
+    case KernelVariant::kImage: return "image";
+    case KernelVariant::kFolded: return "folded";
+    case KernelVariant::kFixedPoint: return "q16";
+  }
+  return "unknown";
+}
+
+// Storage of the image between the row and the column pass, the values
+// match TEMP_FORMAT in gaussian_blur_seperate.cl. kUChar quantizes twice,
+// kHalf and kFloat trade bandwidth for precision.
+enum class IntermediateFormat { kUChar = 0, kHalf = 1, kFloat = 2 };
+
+// Pixels the taps see past the image edge, the values match cv::BorderTypes
+// so a mode casts straight to the border argument of the OpenCV filters.
+// kReplicate repeats the edge pixel, kReflect101 mirrors without repeating
+// it, kWrap tiles the image and kConstant reads a fixed value.
+enum class BorderMode { kConstant = 0, kReplicate = 1, kWrap = 3, kReflect101 = 4 };
+
+// Work-group shapes of the tiled kernels, baked into the program as -D
+// options. The apron in local memory is sized for radii up to max_radius.
+struct TileConfig {
+  int rows_block_x = 16;
+  int rows_block_y = 4;
+  int cols_block_x = 16;
+  int cols_block_y = 8;
+  int fused_block_x = 16;
+  int fused_block_y = 8;
+  int fused_steps = 4;  // output rows per work-item in the fused kernel
+  int max_radius = 15;
+};
+
+// Shrinks the work-group shapes, heights first and then widths, until every
+// tiled kernel fits the device's max work-group size and local memory. tile_element_size is the size of
+// one staged intermediate value in the column tile.
+inline TileConfig FitTileConfig(TileConfig config, const DeviceInfo& info,
+                                size_t tile_element_size) {
+  const size_t kChannels = 3;
+  auto rows_local = [&] {
+    return (size_t)config.rows_block_y *
+           (config.rows_block_x + 2 * config.max_radius) * kChannels;
+  };
+  auto cols_local = [&] {
+    return (size_t)(config.cols_block_y + 2 * config.max_radius) *
+           config.cols_block_x * kChannels * tile_element_size;
+  };
+  auto fused_local = [&] {
+    const size_t tile_h = config.fused_block_y * config.fused_steps + 2 * config.max_radius;
+    return tile_h * (config.fused_block_x + 2 * config.max_radius) * kChannels +
+           tile_h * config.fused_block_x * kChannels * sizeof(float);
+  };
+  const size_t max_wg = info.max_work_group_size;
+  const size_t local_mem = info.local_mem_size;
+
+  while (max_wg && config.rows_block_y > 1 &&
+         (size_t)config.rows_block_x * config.rows_block_y > max_wg) config.rows_block_y /= 2;
+  while (max_wg && config.cols_block_y > 1 &&
+         (size_t)config.cols_block_x * config.cols_block_y > max_wg) config.cols_block_y /= 2;
+  while (max_wg && config.fused_block_y > 1 &&
+         (size_t)config.fused_block_x * config.fused_block_y > max_wg) config.fused_block_y /= 2;
+  // a single row still too wide, narrow it
+  while (max_wg && config.rows_block_x > 1 &&
+         (size_t)config.rows_block_x * config.rows_block_y > max_wg) config.rows_block_x /= 2;
+  while (max_wg && config.cols_block_x > 1 &&
+         (size_t)config.cols_block_x * config.cols_block_y > max_wg) config.cols_block_x /= 2;
+  while (max_wg && config.fused_block_x > 1 &&
+         (size_t)config.fused_block_x * config.fused_block_y > max_wg) config.fused_block_x /= 2;
+
+  while (local_mem && config.rows_block_y > 1 && rows_local() > local_mem) config.rows_block_y /= 2;
+  while (local_mem && config.cols_block_y > 1 && cols_local() > local_mem) config.cols_block_y /= 2;
+  while (local_mem && config.fused_steps > 1 && fused_local() > local_mem) config.fused_steps /= 2;
+  while (local_mem && config.fused_block_y > 1 && fused_local() > local_mem) config.fused_block_y /= 2;
+  while (local_mem && config.rows_block_x > 1 && rows_local() > local_mem) config.rows_block_x /= 2;
+  while (local_mem && config.cols_block_x > 1 && cols_local() > local_mem) config.cols_block_x /= 2;
+  while (local_mem && config.fused_block_x > 1 && fused_local() > local_mem) config.fused_block_x /= 2;
+  return config;
+}
+
+// Runs on the context and queue of an OpenCLRuntime. Pass a runtime shared
+// with other stages to exchange buffers with them, without one Init creates
+// a private runtime.
 class OpenCLSeperableConv {
 public:
-  OpenCLSeperableConv()
-      : platform_(nullptr), context_(nullptr), device_(nullptr),
+  explicit OpenCLSeperableConv(std::shared_ptr<OpenCLRuntime> runtime = nullptr)
+      : runtime_(std::move(runtime)), own_runtime_(false), platform_(nullptr), context_(nullptr), device_(nullptr),
         queue_(nullptr), kernel_cols_(nullptr), kernel_rows_(nullptr),
-        program_(nullptr), valid_(false) {};
+        program_(nullptr), kernel_rows_tiled_(nullptr),
+        kernel_cols_tiled_(nullptr), kernel_fused_(nullptr),
+        kernel_rows_rgba_(nullptr), kernel_cols_rgba_(nullptr),
+        kernel_rows_batch_(nullptr), kernel_cols_batch_(nullptr),
+        kernel_rows_fixed_(nullptr), kernel_cols_fixed_(nullptr),
+        fixed_taps_(0), fixed_channels_(0), specialized_capacity_(8),
+        kernel_rows_image_(nullptr), kernel_cols_image_(nullptr),
+        image_input_(nullptr), image_temp_(nullptr), image_output_(nullptr),
+        image_width_(0), image_height_(0), image_temp_type_(0),
+        kernel_rows_iir_(nullptr), kernel_cols_iir_(nullptr),
+        kernel_rows_folded_(nullptr), kernel_cols_folded_(nullptr),
+        kernel_rows_q16_(nullptr), kernel_cols_q16_(nullptr),
+        q16_weights_(nullptr), folded_taps_(0), q16_taps_(0),
+        kernel_rows_border_(nullptr), kernel_cols_border_(nullptr),
+        border_mode_(BorderMode::kReplicate), border_value_(0.0f),
+        kernel_2d_(nullptr), kernel_2d_border_(nullptr),
+        kernel_lowrank_rows_(nullptr), kernel_lowrank_cols_(nullptr),
+        lowrank_max_rank_(4), lowrank_tolerance_(1e-2f), last_rank_(0),
+        recursive_threshold_(kRecursiveSigmaThreshold),
+        local_size_{0, 0}, tuning_(false), tuned_key_{0, 0, 0, 0},
+        profile_event_(nullptr),
+        variant_(KernelVariant::kNaive),
+        temp_format_(IntermediateFormat::kUChar),
+        memory_mode_(MemoryMode::kCopy), pack_rgba_(false),
+        mapped_output_buf_(nullptr), mapped_output_(nullptr), valid_(false) {};
   ~OpenCLSeperableConv() {
     UnInit();
   };
@@ -25,7 +170,8 @@ public:
   bool Init();
   void UnInit();
 
-  bool BuildKernel(const std::string& source_path, const char* kernel_func_name, cl_kernel* out_kernel, cl_program* out_program);
+  bool BuildKernel(const std::string& source_path, const char* kernel_func_name, cl_kernel* out_kernel, cl_program* out_program,
+    const std::string& options = "");
   bool RunConvolutionRows(cl_command_queue queue,
     cl_mem input_buffer, cl_mem temp_buffer,
     cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
@@ -34,11 +180,149 @@ public:
     cl_mem temp_buffer, cl_mem output_buffer,
     cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
     cl_uint pitch, cl_uint k_h);
+  bool RunConvolutionRowsTiled(cl_command_queue queue,
+    cl_mem input_buffer, cl_mem temp_buffer,
+    cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
+    cl_uint pitch, cl_uint k_w);
+  bool RunConvolutionColsTiled(cl_command_queue queue,
+    cl_mem temp_buffer, cl_mem output_buffer,
+    cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
+    cl_uint pitch, cl_uint k_h);
+  bool RunConvolutionFused(cl_command_queue queue,
+    cl_mem input_buffer, cl_mem output_buffer,
+    cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
+    cl_uint pitch, cl_uint k);
+  bool RunConvolutionRowsRGBA(cl_command_queue queue,
+    cl_mem input_buffer, cl_mem temp_buffer,
+    cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
+    cl_uint pitch, cl_uint k_w);
+  bool RunConvolutionColsRGBA(cl_command_queue queue,
+    cl_mem temp_buffer, cl_mem output_buffer,
+    cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
+    cl_uint pitch, cl_uint k_h);
 
   bool Run(const cv::Mat& input, const std::vector<float>& kernel, cv::Mat& output);
+  // Packs every 3 channel image into one device buffer and blurs the whole
+  // batch with a single NDRange per pass. Sizes may differ between images.
+  bool RunBatch(const std::vector<cv::Mat>& inputs, const std::vector<float>& kernel,
+                std::vector<cv::Mat>& outputs);
+  // Young-van Vliet recursive Gaussian, constant work per pixel for any
+  // sigma. Rows run one work-item per row, columns one per column element.
+  bool RunRecursive(const cv::Mat& input, float sigma, cv::Mat& output);
+  // RunRecursive from the recursive sigma threshold on, Run with a 3 sigma
+  // FIR kernel below it.
+  bool RunGaussian(const cv::Mat& input, float sigma, cv::Mat& output);
+  void SetRecursiveSigmaThreshold(float sigma);
+  float GetRecursiveSigmaThreshold() const;
+  // Convolves with an arbitrary CV_32FC1 kernel anchored at its center,
+  // like cv::filter2D. When decomposeKernel2D finds at most max_rank
+  // separable terms within tolerance, and they need fewer taps than the
+  // kernel, each term runs as a row and a column pass of a float sum.
+  // Otherwise the direct kernel reads all rows * cols taps per pixel. Both
+  // paths apply the border mode. The decomposition is kept until the
+  // kernel changes.
+  bool Run2D(const cv::Mat& input, const cv::Mat& kernel, cv::Mat& output);
+  // 4 terms within 1% of the kernel's Frobenius norm by default, max_rank
+  // 0 always takes the direct kernel.
+  void SetLowRankLimits(int max_rank, float tolerance);
+  // terms the last Run2D ran, 0 for the direct kernel or a failed Run2D
+  int LastRank() const;
   bool IsValid() const;
 
+  // Enqueues both passes of the selected variant on an in-order queue
+  // without waiting. The passes start after wait_events and done, if given,
+  // signals their completion. temp_buf may be null when NeedsTempBuffer is
+  // false.
+  bool EnqueueBlur(cl_command_queue queue,
+    cl_mem input_buf, cl_mem temp_buf, cl_mem output_buf, cl_mem kernel_buf,
+    int width, int height, int channels, cl_uint k,
+    cl_uint num_wait_events = 0, const cl_event* wait_events = nullptr,
+    cl_event* done = nullptr);
+  bool NeedsTempBuffer(int channels, int kernel_size) const;
+
+  cl_context Context() const;
+  cl_device_id Device() const;
+
+  // device buffers are pooled across Run calls, this drops them
+  void ReleaseBuffers();
+  size_t BufferAllocationCount() const;
+
+  // null before Init when no runtime was passed in
+  std::shared_ptr<OpenCLRuntime> Runtime() const;
+
+  // In kZeroCopy mode the output of Run aliases mapped device memory and
+  // stays valid only until the next Run, ReleaseBuffers or UnInit.
+  void SetMemoryMode(MemoryMode mode);
+  MemoryMode GetMemoryMode() const;
+
+  // Allocates a cv::Mat whose storage is page aligned, so that it can be
+  // wrapped with CL_MEM_USE_HOST_PTR without the driver copying it.
+  static cv::Mat AllocatePageAligned(int rows, int cols, int type);
+
+  // Kernels whose radius exceeds TileConfig::max_radius always take the
+  // naive two-pass path.
+  void SetKernelVariant(KernelVariant variant);
+  KernelVariant GetKernelVariant() const;
+  bool SetTileConfig(const TileConfig& config);
+
+  // Pads 3 channel input to BGRA on the host so Run can use the uchar4 /
+  // vload16 kernels. 4 channel input always takes that path.
+  void SetPackRGBA(bool enable);
+  bool GetPackRGBA() const;
+
+  // Selects (building on a miss) the kSpecialized passes for this kernel
+  // and channel count. Run does this itself, callers of EnqueueBlur do it
+  // once per kernel. Variants are kept in an LRU of SetSpecializedCacheSize
+  // entries, 8 by default.
+  bool Specialize(const std::vector<float>& kernel, int channels);
+  // Checks kernel for symmetry and, for kFixedPoint, uploads its Q0.16
+  // weights. Like Specialize, Run does this itself and callers of
+  // EnqueueBlur do it once per kernel, a repeated kernel is not uploaded
+  // again. false leaves the fallback in charge.
+  bool Fold(const std::vector<float>& kernel);
+  void SetSpecializedCacheSize(size_t size);
+  size_t SpecializedVariantCount() const;
+
+  // Work-group shape of the naive and RGBA passes, 0 x 0 leaves it to the
+  // driver. The tiled and fused kernels take theirs from TileConfig.
+  void SetLocalWorkSize(size_t x, size_t y);
+
+  // With a database Run tunes itself: the first frame of every (size,
+  // channels, radius) looks the winner up, or runs Autotune and stores it,
+  // and applies variant, local size, tile shapes and RGBA packing.
+  void SetTuningDatabase(std::shared_ptr<TuningDatabase> database);
+  // Times every candidate launch configuration on random input of this
+  // geometry, applies the fastest and stores it in the database, if any.
+  bool Autotune(int width, int height, int channels, int radius);
+  TuningKey MakeTuningKey(int width, int height, int channels, int radius) const;
+
+  // Records every upload, kernel and download under the stages "upload",
+  // "weights", "rows", "cols", "fused" and "download", the naive border
+  // strips under "rows_border" and "cols_border". Run2D records its
+  // low-rank passes as rows and cols, the direct kernel as "conv2d" and
+  // "conv2d_border". EnqueueBlur records on the queue it is given, which
+  // needs CL_QUEUE_PROFILING_ENABLE like the runtime queue and those of
+  // OpenCLFrameStream.
+  void SetProfiler(std::shared_ptr<Profiler> profiler);
+  const std::shared_ptr<Profiler>& GetProfiler() const;
+
+  // Border handling of the naive passes, whose interior launches skip the
+  // bounds checks and whose strips within the radius of an edge apply the
+  // mode. The other variants, RunBatch and RunRecursive always replicate,
+  // so any other mode makes Run and EnqueueBlur take the naive passes.
+  // value is the pixel read by kConstant, in the 0..255 range.
+  void SetBorderMode(BorderMode mode, float value = 0.0f);
+  BorderMode GetBorderMode() const;
+
+  // Rebuilds the kernels for the new temp buffer format.
+  bool SetIntermediateFormat(IntermediateFormat format);
+  IntermediateFormat GetIntermediateFormat() const;
+  size_t IntermediateElementSize() const;
+
 private:
+  std::shared_ptr<OpenCLRuntime> runtime_;
+  bool own_runtime_;
+  // borrowed from runtime_
   cl_platform_id platform_;
   cl_context context_;
   cl_device_id device_;
@@ -46,111 +330,299 @@ private:
   cl_program program_;
   cl_kernel kernel_rows_;
   cl_kernel kernel_cols_;
+  cl_kernel kernel_rows_tiled_;
+  cl_kernel kernel_cols_tiled_;
+  cl_kernel kernel_fused_;
+  cl_kernel kernel_rows_rgba_;
+  cl_kernel kernel_cols_rgba_;
+  cl_kernel kernel_rows_batch_;
+  cl_kernel kernel_cols_batch_;
+  // active specialized pair, owned by specialized_
+  cl_kernel kernel_rows_fixed_;
+  cl_kernel kernel_cols_fixed_;
+  int fixed_taps_;
+  int fixed_channels_;
+  struct SpecializedVariant {
+    std::string options;
+    std::string program_key;  // ProgramCache key, released on eviction
+    cl_program program;
+    cl_kernel rows;
+    cl_kernel cols;
+    int taps;
+    int channels;
+  };
+  std::list<SpecializedVariant> specialized_;  // most recently used first
+  size_t specialized_capacity_;
+  std::string build_options_;
+  cl_kernel kernel_rows_image_;
+  cl_kernel kernel_cols_image_;
+  cl_mem image_input_;
+  cl_mem image_temp_;
+  cl_mem image_output_;
+  int image_width_;
+  int image_height_;
+  cl_channel_type image_temp_type_;
+  cv::Mat image_host_input_;
+  cv::Mat image_host_output_;
+  cl_kernel kernel_rows_iir_;
+  cl_kernel kernel_cols_iir_;
+  cl_kernel kernel_rows_folded_;
+  cl_kernel kernel_cols_folded_;
+  cl_kernel kernel_rows_q16_;
+  cl_kernel kernel_cols_q16_;
+  cl_mem q16_weights_;
+  int folded_taps_;  // size of the symmetric kernel Fold saw last, 0 if none
+  int q16_taps_;     // size of the kernel in q16_weights_, 0 if none
+  std::vector<float> folded_kernel_;  // kernel Fold saw last
+  cl_kernel kernel_rows_border_;
+  cl_kernel kernel_cols_border_;
+  BorderMode border_mode_;
+  float border_value_;
+  cl_kernel kernel_2d_;
+  cl_kernel kernel_2d_border_;
+  cl_kernel kernel_lowrank_rows_;
+  cl_kernel kernel_lowrank_cols_;
+  int lowrank_max_rank_;
+  float lowrank_tolerance_;
+  cv::Mat lowrank_source_;  // kernel lowrank_ was decomposed from
+  LowRankKernel lowrank_;
+  int last_rank_;
+  float recursive_threshold_;
+  size_t local_size_[2];
+  std::shared_ptr<TuningDatabase> tuning_db_;
+  bool tuning_;
+  int tuned_key_[4];  // width, height, channels, radius last applied
+  std::shared_ptr<Profiler> profiler_;
+  cl_event profile_event_;
+  KernelVariant variant_;
+  IntermediateFormat temp_format_;
+  TileConfig tile_config_;
+  BufferPool buffer_pool_;
+  MemoryMode memory_mode_;
+  bool pack_rgba_;
+  cv::Mat packed_input_;
+  cv::Mat packed_output_;
+  cl_mem mapped_output_buf_;
+  void* mapped_output_;
   bool valid_;
+
+  bool RunOnDevice(const cv::Mat& input, const std::vector<float>& kernel, cv::Mat& output);
+  bool UploadInput(const cv::Mat& input, size_t image_size, cl_mem* input_buf);
+  bool DownloadOutput(cl_mem output_buf, int width, int height, int type,
+                      size_t image_size, cv::Mat& output);
+  void UnmapOutput();
+  bool BuildKernels();
+  void ReleaseSpecialized();
+  bool RunImage(const cv::Mat& input, const std::vector<float>& kernel, cv::Mat& output);
+  bool AcquireImages(int width, int height);
+  void ReleaseImages();
+  void ApplyTuning(int width, int height, int channels, int radius);
+  bool ApplyTuningParams(const std::vector<int>& params);
+  bool EnqueueSimple(cl_command_queue queue, cl_kernel kernel, size_t global_x, size_t global_y,
+    const char* stage, size_t bytes, size_t offset_x = 0, size_t offset_y = 0);
+  // Runs a border kernel over the strips of the width x height grid outside
+  // the interior [x0, x1) x [y0, y1). The mode and value go to arguments
+  // border_arg and border_arg + 1, the others must be set already.
+  // item_bytes is what one work-item reads and writes.
+  bool EnqueueBorder(cl_command_queue queue, cl_kernel kernel, cl_uint border_arg,
+    float border_value, const char* stage, size_t item_bytes,
+    cl_uint width, cl_uint height, cl_uint x0, cl_uint x1, cl_uint y0, cl_uint y1);
+  bool RunLowRank(cl_mem input_buf, cl_mem output_buf, cl_mem weights_buf,
+    int width, int height, int channels, int k_w, int k_h);
+  bool RunDirect2D(cl_mem input_buf, cl_mem output_buf, cl_mem weights_buf,
+    int width, int height, int channels, int k_w, int k_h);
+  // Event slot for the next command on queue while a profiler is attached,
+  // null otherwise. Profile hands the event it received to the profiler.
+  cl_event* ProfileEvent();
+  void Profile(const char* stage, size_t bytes);
+  // bytes a two-pass kernel reads and writes, uchar on one side and the
+  // intermediate on the other
+  size_t PassBytes(cl_uint pitch, cl_uint height) const;
+  bool RunConvolutionFixed(cl_command_queue queue, cl_kernel kernel,
+    cl_mem src, cl_mem dst, cl_mem gaussian_kernel_1d,
+    cl_uint width, cl_uint height, cl_uint pitch, cl_uint k);
+  // one work-item per element, the folded and q16 passes
+  bool RunConvolutionElements(cl_command_queue queue, cl_kernel kernel, const char* stage,
+    cl_mem src, cl_mem dst, cl_mem weights,
+    cl_uint width, cl_uint height, cl_uint pitch, cl_uint k);
+  bool SetConvolutionArgs(cl_kernel kernel, cl_mem src, cl_mem dst,
+    cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
+    cl_uint pitch, cl_uint k);
 };
 
-inline bool OpenCLSeperableConv::Init() {
-  cl_int err;
+constexpr size_t kPageSize = 4096;
+constexpr const char* kSeperableKernelPath =
+  "/home/kumo/dev/hello_ocl_runtime/kernels/gaussian_blur_seperate.cl";
+constexpr const char* kImageKernelPath =
+  "/home/kumo/dev/hello_ocl_runtime/kernels/gaussian_blur_image.cl";
+constexpr const char* kRecursiveKernelPath =
+  "/home/kumo/dev/hello_ocl_runtime/kernels/gaussian_blur_recursive.cl";
+constexpr const char* kConvolution2DKernelPath =
+  "/home/kumo/dev/hello_ocl_runtime/kernels/gaussian_blur.cl";
 
-  // Discover avaliable OpenCL platform
-  cl_uint num_platforms = 0;
-  err = clGetPlatformIDs(1, &platform_, &num_platforms);
-  if (err != CL_SUCCESS || num_platforms == 0) {
-    std::cerr << "clGetPlatformIDs error return " << err << std::endl;
-    return false;
+// Collapses neighbouring taps of a 1D kernel into (offset, weight) pairs for
+// linear sampling: taps i and i + 1 become one fetch at
+// (i * w_i + (i + 1) * w_{i+1}) / (w_i + w_{i+1}) with weight w_i + w_{i+1}.
+// The center tap stays on its own, an odd tap left over at the end of
+// either side is kept as a single fetch.
+inline std::vector<cl_float2> BilinearTaps(const std::vector<float>& kernel) {
+  const int radius = (int)kernel.size() / 2;
+  std::vector<cl_float2> taps;
+  auto push = [&](float offset, float weight) {
+    cl_float2 tap;
+    tap.s[0] = offset;
+    tap.s[1] = weight;
+    taps.push_back(tap);
+  };
+  push(0.0f, kernel[radius]);
+  for (int side = -1; side <= 1; side += 2) {
+    for (int i = 1; i <= radius; i += 2) {
+      const float w0 = kernel[radius + side * i];
+      if (i == radius) {
+        push((float)(side * i), w0);
+        break;
+      }
+      const float w1 = kernel[radius + side * (i + 1)];
+      const float weight = w0 + w1;
+      if (weight == 0.0f) continue;
+      push(side * (i * w0 + (i + 1) * w1) / weight, weight);
+    }
   }
+  return taps;
+}
 
-  cl_uint num_devices = 0;
-  err =
-      clGetDeviceIDs(platform_, CL_DEVICE_TYPE_GPU, 1, &device_, &num_devices);
-  if (err != CL_SUCCESS || num_devices == 0) {
-    std::cerr << "clGetDeviceIDs error return " << err << std::endl;
-    return false;
+inline bool OpenCLSeperableConv::Init() {
+  if (!runtime_) {
+    runtime_ = std::make_shared<OpenCLRuntime>();
+    own_runtime_ = true;
   }
-
-  context_ = clCreateContext(nullptr, 1, &device_, nullptr, nullptr, &err);
-  if (err != CL_SUCCESS) {
-    std::cerr << "clCreateContext error return " << err << std::endl;
+  if (!runtime_->isInitialized() && !runtime_->init()) {
+    std::cerr << "OpenCLRuntime init failed" << std::endl;
+    if (own_runtime_) runtime_.reset();
+    own_runtime_ = false;
     return false;
   }
 
-#if CL_TARGET_OPENCL_VERSION >= 200
-  cl_queue_properties props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE,
-                                 0};
-  queue_ = clCreateCommandQueueWithProperties(context_, device_, props, &err);
-#else
-  queue_ =
-      clCreateCommandQueue(context_, device_, CL_QUEUE_PROFILING_ENABLE, &err);
-#endif
-  if (err != CL_SUCCESS) {
-#if CL_TARGET_OPENCL_VERSION >= 200
-    std::cerr << "clCreateCommandQueueWithProperties error return " << err << std::endl;
-#else
-    std::cerr << "clCreateCommandQueue error return " << err << std::endl;
-#endif
-    return false;
-  }
+  platform_ = runtime_->platform();
+  context_ = runtime_->context();
+  device_ = runtime_->device();
+  queue_ = runtime_->queue();
+  buffer_pool_.setContext(context_);
 
   valid_ = true;
 
-  BuildKernel(
-    "/home/kumo/dev/hello_ocl_runtime/kernels/gaussian_blur_seperate.cl",
-    "gaussian_blur_rows", &kernel_rows_, &program_);
-  
-  BuildKernel(
-    "/home/kumo/dev/hello_ocl_runtime/kernels/gaussian_blur_seperate.cl",
-    "gaussian_blur_cols", &kernel_cols_, &program_);
+  BuildKernels();
   return true;
 }
 
-inline bool OpenCLSeperableConv::BuildKernel(const std::string& source_path, const char* kernel_func_name, cl_kernel* out_kernel, cl_program* out_program) {
-  // read .cl file
-  std::ifstream file(source_path);
-  if (!file.is_open()) {
-    std::cerr << "Failed to open OpenCL source file: " << source_path << std::endl;
-    return false;
+inline bool OpenCLSeperableConv::BuildKernels() {
+  cl_kernel* kernels[] = {&kernel_rows_, &kernel_cols_,
+                          &kernel_rows_tiled_, &kernel_cols_tiled_,
+                          &kernel_fused_, &kernel_rows_rgba_, &kernel_cols_rgba_,
+                          &kernel_rows_batch_, &kernel_cols_batch_,
+                          &kernel_rows_image_, &kernel_cols_image_,
+                          &kernel_rows_iir_, &kernel_cols_iir_,
+                          &kernel_rows_folded_, &kernel_cols_folded_,
+                          &kernel_rows_q16_, &kernel_cols_q16_,
+                          &kernel_rows_border_, &kernel_cols_border_,
+                          &kernel_2d_, &kernel_2d_border_,
+                          &kernel_lowrank_rows_, &kernel_lowrank_cols_};
+  for (cl_kernel* kernel : kernels) {
+    if (*kernel) clReleaseKernel(*kernel);
+    *kernel = nullptr;
   }
+  // specialized variants were built with the previous options
+  ReleaseSpecialized();
 
-  std::ostringstream oss;
-  oss << file.rdbuf();
-  std::string source_code = oss.str();
-  const char* source_ptr = source_code.c_str();
-
-  // create program
-  cl_int err = 0;
-  cl_program program = clCreateProgramWithSource(context_, 1, &source_ptr, nullptr, &err);
-  if (err != CL_SUCCESS) {
-    std::cerr << "clCreateProgramWithSource error return " << err << std::endl;
-
-    clReleaseProgram(program);
-    program_ = nullptr;
-    return false;
+  // the same config may not fit every device the runtime selects
+  const TileConfig fitted = FitTileConfig(tile_config_, runtime_->deviceInfo(),
+    temp_format_ == IntermediateFormat::kUChar ? sizeof(uchar) : sizeof(float));
+  if (std::memcmp(&fitted, &tile_config_, sizeof(TileConfig)) != 0) {
+    std::cerr << "TileConfig shrunk to fit " << runtime_->deviceInfo().name << std::endl;
+    tile_config_ = fitted;
   }
 
-  err = clBuildProgram(program, 1, &device_, nullptr, nullptr, nullptr);
-  if (err != CL_SUCCESS) {
-      size_t log_size;
-      clGetProgramBuildInfo(program, device_, CL_PROGRAM_BUILD_LOG, 0, nullptr, &log_size);
-
-      std::vector<char> build_log(log_size);
-      clGetProgramBuildInfo(program, device_, CL_PROGRAM_BUILD_LOG, log_size, build_log.data(), nullptr);
+  std::ostringstream options;
+  options << "-DROWS_BLOCKDIM_X=" << tile_config_.rows_block_x
+          << " -DROWS_BLOCKDIM_Y=" << tile_config_.rows_block_y
+          << " -DCOLS_BLOCKDIM_X=" << tile_config_.cols_block_x
+          << " -DCOLS_BLOCKDIM_Y=" << tile_config_.cols_block_y
+          << " -DFUSED_BLOCKDIM_X=" << tile_config_.fused_block_x
+          << " -DFUSED_BLOCKDIM_Y=" << tile_config_.fused_block_y
+          << " -DFUSED_STEPS=" << tile_config_.fused_steps
+          << " -DMAX_RADIUS=" << tile_config_.max_radius
+          << " -DTEMP_FORMAT=" << static_cast<int>(temp_format_);
+  build_options_ = options.str();
 
-      std::cerr << "Build failed with error code " << err << ":\n" << build_log.data() << std::endl;
-      return false;
+  bool ok = BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_rows", &kernel_rows_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_cols", &kernel_cols_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_rows_border", &kernel_rows_border_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_cols_border", &kernel_cols_border_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_rows_tiled", &kernel_rows_tiled_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_cols_tiled", &kernel_cols_tiled_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_fused", &kernel_fused_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_rows_rgba", &kernel_rows_rgba_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_cols_rgba", &kernel_cols_rgba_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_rows_batch", &kernel_rows_batch_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_cols_batch", &kernel_cols_batch_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_rows_folded", &kernel_rows_folded_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_cols_folded", &kernel_cols_folded_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_rows_q16", &kernel_rows_q16_, nullptr, options.str());
+  ok &= BuildKernel(kSeperableKernelPath,
+    "gaussian_blur_cols_q16", &kernel_cols_q16_, nullptr, options.str());
+  ok &= BuildKernel(kConvolution2DKernelPath,
+    "gaussian_blur", &kernel_2d_, nullptr);
+  ok &= BuildKernel(kConvolution2DKernelPath,
+    "gaussian_blur_border", &kernel_2d_border_, nullptr);
+  ok &= BuildKernel(kConvolution2DKernelPath,
+    "lowrank_rows", &kernel_lowrank_rows_, nullptr);
+  ok &= BuildKernel(kConvolution2DKernelPath,
+    "lowrank_cols", &kernel_lowrank_cols_, nullptr);
+  ok &= BuildKernel(kRecursiveKernelPath,
+    "gaussian_iir_rows", &kernel_rows_iir_, nullptr);
+  ok &= BuildKernel(kRecursiveKernelPath,
+    "gaussian_iir_cols", &kernel_cols_iir_, nullptr);
+  if (runtime_->deviceInfo().image_support) {
+    ok &= BuildKernel(kImageKernelPath,
+      "gaussian_blur_rows_image", &kernel_rows_image_, nullptr);
+    ok &= BuildKernel(kImageKernelPath,
+      "gaussian_blur_cols_image", &kernel_cols_image_, nullptr);
   }
+  return ok;
+}
 
-  cl_kernel kernel = clCreateKernel(program, kernel_func_name, &err);
-  if (err != CL_SUCCESS) {
-    std::cerr << "clCreateKernel " << kernel_func_name << " error return " << err << std::endl;
-
-    clReleaseProgram(program);
-    program_ = nullptr;
+inline bool OpenCLSeperableConv::BuildKernel(const std::string& source_path, const char* kernel_func_name, cl_kernel* out_kernel, cl_program* out_program,
+  const std::string& options) {
+  // every kernel of one file and option set shares a single cached program
+  if (!runtime_->buildKernelFromFile(source_path, kernel_func_name, options)) {
+    std::cerr << "Build " << kernel_func_name << " failed from " << source_path << std::endl;
     return false;
   }
 
+  // keep a reference of our own, another user of the runtime may rebuild
+  // the kernel with different options
+  cl_kernel kernel = runtime_->getKernel(kernel_func_name);
+  clRetainKernel(kernel);
   *out_kernel = kernel;
-  if (out_program) *out_program = program;
-  else clReleaseProgram(program);
+  if (out_program) {
+    cl_program program = runtime_->programCache().getProgramFromFile(source_path, options);
+    clRetainProgram(program);
+    *out_program = program;
+  }
 
   // std::cout << "Kernel '" << kernel_func_name << "' built successfully from" << source_path << std::endl;
 
@@ -158,14 +630,67 @@ inline bool OpenCLSeperableConv::BuildKernel(const std::string& source_path, con
 }
 
 inline void OpenCLSeperableConv::UnInit() {
+  UnmapOutput();
+  buffer_pool_.clear();
+  ReleaseImages();
   if (kernel_cols_) clReleaseKernel(kernel_cols_);
   if (kernel_rows_) clReleaseKernel(kernel_rows_);
+  if (kernel_cols_tiled_) clReleaseKernel(kernel_cols_tiled_);
+  if (kernel_rows_tiled_) clReleaseKernel(kernel_rows_tiled_);
+  if (kernel_fused_) clReleaseKernel(kernel_fused_);
+  if (kernel_rows_rgba_) clReleaseKernel(kernel_rows_rgba_);
+  if (kernel_cols_rgba_) clReleaseKernel(kernel_cols_rgba_);
+  ReleaseSpecialized();
+  if (kernel_rows_batch_) clReleaseKernel(kernel_rows_batch_);
+  if (kernel_cols_batch_) clReleaseKernel(kernel_cols_batch_);
+  if (kernel_rows_image_) clReleaseKernel(kernel_rows_image_);
+  if (kernel_cols_image_) clReleaseKernel(kernel_cols_image_);
+  if (kernel_rows_iir_) clReleaseKernel(kernel_rows_iir_);
+  if (kernel_cols_iir_) clReleaseKernel(kernel_cols_iir_);
+  if (kernel_rows_folded_) clReleaseKernel(kernel_rows_folded_);
+  if (kernel_cols_folded_) clReleaseKernel(kernel_cols_folded_);
+  if (kernel_rows_q16_) clReleaseKernel(kernel_rows_q16_);
+  if (kernel_cols_q16_) clReleaseKernel(kernel_cols_q16_);
+  if (kernel_rows_border_) clReleaseKernel(kernel_rows_border_);
+  if (kernel_cols_border_) clReleaseKernel(kernel_cols_border_);
+  if (kernel_2d_) clReleaseKernel(kernel_2d_);
+  if (kernel_2d_border_) clReleaseKernel(kernel_2d_border_);
+  if (kernel_lowrank_rows_) clReleaseKernel(kernel_lowrank_rows_);
+  if (kernel_lowrank_cols_) clReleaseKernel(kernel_lowrank_cols_);
+  if (q16_weights_) clReleaseMemObject(q16_weights_);
   if (program_) clReleaseProgram(program_);
-  if (queue_) clReleaseCommandQueue(queue_);
-  if (context_) clReleaseContext(context_);
-  // device_ 和 platform_ 不需要释放
+  // context and queue belong to the runtime
+  if (own_runtime_) runtime_.reset();
+  own_runtime_ = false;
   kernel_cols_ = nullptr;
   kernel_rows_ = nullptr;
+  kernel_cols_tiled_ = nullptr;
+  kernel_rows_tiled_ = nullptr;
+  kernel_fused_ = nullptr;
+  kernel_rows_rgba_ = nullptr;
+  kernel_cols_rgba_ = nullptr;
+  kernel_rows_batch_ = nullptr;
+  kernel_cols_batch_ = nullptr;
+  kernel_rows_image_ = nullptr;
+  kernel_cols_image_ = nullptr;
+  kernel_rows_iir_ = nullptr;
+  kernel_cols_iir_ = nullptr;
+  kernel_rows_folded_ = nullptr;
+  kernel_cols_folded_ = nullptr;
+  kernel_rows_q16_ = nullptr;
+  kernel_cols_q16_ = nullptr;
+  kernel_rows_border_ = nullptr;
+  kernel_cols_border_ = nullptr;
+  kernel_2d_ = nullptr;
+  kernel_2d_border_ = nullptr;
+  kernel_lowrank_rows_ = nullptr;
+  kernel_lowrank_cols_ = nullptr;
+  lowrank_source_.release();
+  last_rank_ = 0;
+  q16_weights_ = nullptr;
+  folded_taps_ = 0;
+  q16_taps_ = 0;
+  folded_kernel_.clear();
   program_ = nullptr;
   queue_ = nullptr;
   context_ = nullptr;
@@ -179,152 +704,1465 @@ OpenCLSeperableConv::RunConvolutionRows(cl_command_queue queue,
   cl_mem input_buffer, cl_mem temp_buffer,
   cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
   cl_uint pitch, cl_uint k_w) {
+  if (!SetConvolutionArgs(kernel_rows_, input_buffer, temp_buffer,
+        gaussian_kernel_1d, width, height, pitch, k_w)) {
+    return false;
+  }
+
+  // columns [x0, x1) never read past the row, x is get_global_id(0) in
+  // the kernel and starts at the offset
+  const cl_uint radius = k_w / 2;
+  const cl_uint x0 = std::min(radius, width);
+  const cl_uint x1 = std::max(width > radius ? width - radius : 0, x0);
+  if (x1 > x0 && !EnqueueSimple(queue, kernel_rows_, x1 - x0, height,
+        "rows", PassBytes(pitch, height), x0, 0)) {
+    return false;
+  }
+
+  if (!SetConvolutionArgs(kernel_rows_border_, input_buffer, temp_buffer,
+        gaussian_kernel_1d, width, height, pitch, k_w)) {
+    return false;
+  }
+  return EnqueueBorder(queue, kernel_rows_border_, 7, border_value_, "rows_border",
+    (pitch / width) * (sizeof(uchar) + IntermediateElementSize()),
+    width, height, x0, x1, 0, height);
+}
+
+inline bool
+OpenCLSeperableConv::RunConvolutionCols(cl_command_queue queue,
+  cl_mem temp_buffer, cl_mem output_buffer,
+  cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
+  cl_uint pitch, cl_uint k_h) {
+  if (!SetConvolutionArgs(kernel_cols_, temp_buffer, output_buffer,
+        gaussian_kernel_1d, width, height, pitch, k_h)) {
+    return false;
+  }
+
+  const cl_uint radius = k_h / 2;
+  const cl_uint y0 = std::min(radius, height);
+  const cl_uint y1 = std::max(height > radius ? height - radius : 0, y0);
+  if (y1 > y0 && !EnqueueSimple(queue, kernel_cols_, width, y1 - y0,
+        "cols", PassBytes(pitch, height), 0, y0)) {
+    return false;
+  }
+
+  if (!SetConvolutionArgs(kernel_cols_border_, temp_buffer, output_buffer,
+        gaussian_kernel_1d, width, height, pitch, k_h)) {
+    return false;
+  }
+  return EnqueueBorder(queue, kernel_cols_border_, 7, border_value_, "cols_border",
+    (pitch / width) * (sizeof(uchar) + IntermediateElementSize()),
+    width, height, 0, width, y0, y1);
+}
+
+inline bool OpenCLSeperableConv::SetConvolutionArgs(cl_kernel kernel,
+  cl_mem src, cl_mem dst, cl_mem gaussian_kernel_1d,
+  cl_uint width, cl_uint height, cl_uint pitch, cl_uint k) {
   cl_int err;
 
   int arg_index = 0;
-  err  = clSetKernelArg(kernel_rows_, arg_index++, sizeof(cl_mem), (void*)&input_buffer);
-  err |= clSetKernelArg(kernel_rows_, arg_index++, sizeof(cl_mem), (void*)&temp_buffer);
-  err |= clSetKernelArg(kernel_rows_, arg_index++, sizeof(cl_mem), (void*)&gaussian_kernel_1d);
-  err |= clSetKernelArg(kernel_rows_, arg_index++, sizeof(cl_uint), (void*)&width);
-  err |= clSetKernelArg(kernel_rows_, arg_index++, sizeof(cl_uint), (void*)&height);
-  err |= clSetKernelArg(kernel_rows_, arg_index++, sizeof(cl_uint), (void*)&pitch);
-  err |= clSetKernelArg(kernel_rows_, arg_index++, sizeof(cl_uint), (void*)&k_w);
+  err  = clSetKernelArg(kernel, arg_index++, sizeof(cl_mem), (void*)&src);
+  err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_mem), (void*)&dst);
+  err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_mem), (void*)&gaussian_kernel_1d);
+  err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_uint), (void*)&width);
+  err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_uint), (void*)&height);
+  err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_uint), (void*)&pitch);
+  err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_uint), (void*)&k);
   if (err != CL_SUCCESS) {
     std::cerr << "RunKernel failed" << std::endl;
     return false;
   }
+  return true;
+}
+
+inline size_t RoundUp(size_t value, size_t multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+inline bool
+OpenCLSeperableConv::RunConvolutionRowsTiled(cl_command_queue queue,
+  cl_mem input_buffer, cl_mem temp_buffer,
+  cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
+  cl_uint pitch, cl_uint k_w) {
+  if (!SetConvolutionArgs(kernel_rows_tiled_, input_buffer, temp_buffer,
+        gaussian_kernel_1d, width, height, pitch, k_w)) {
+    return false;
+  }
 
-  size_t globalWorkSize[2] = { (size_t)height, (size_t)width};
-  err = clEnqueueNDRangeKernel(queue, kernel_rows_, 2, nullptr, globalWorkSize, nullptr, 0, nullptr, nullptr);
+  size_t localWorkSize[2] = { (size_t)tile_config_.rows_block_x,
+                              (size_t)tile_config_.rows_block_y };
+  size_t globalWorkSize[2] = { RoundUp(width, localWorkSize[0]),
+                               RoundUp(height, localWorkSize[1]) };
+  cl_int err = clEnqueueNDRangeKernel(queue, kernel_rows_tiled_, 2, nullptr,
+    globalWorkSize, localWorkSize, 0, nullptr, ProfileEvent());
   if (err != CL_SUCCESS) {
     std::cerr << "clEnqueueNDRangeKernel failed return " << err << std::endl;
+    return false;
   }
+  Profile("rows", PassBytes(pitch, height));
 
   return true;
 }
 
 inline bool
-OpenCLSeperableConv::RunConvolutionCols(cl_command_queue queue,
+OpenCLSeperableConv::RunConvolutionColsTiled(cl_command_queue queue,
   cl_mem temp_buffer, cl_mem output_buffer,
   cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
   cl_uint pitch, cl_uint k_h) {
-  cl_int err;
+  if (!SetConvolutionArgs(kernel_cols_tiled_, temp_buffer, output_buffer,
+        gaussian_kernel_1d, width, height, pitch, k_h)) {
+    return false;
+  }
 
-  int arg_index = 0;
-  err |= clSetKernelArg(kernel_cols_, arg_index++, sizeof(cl_mem), (void*)&temp_buffer);
-  err  = clSetKernelArg(kernel_cols_, arg_index++, sizeof(cl_mem), (void*)&output_buffer);
-  err |= clSetKernelArg(kernel_cols_, arg_index++, sizeof(cl_mem), (void*)&gaussian_kernel_1d);
-  err |= clSetKernelArg(kernel_cols_, arg_index++, sizeof(cl_uint), (void*)&width);
-  err |= clSetKernelArg(kernel_cols_, arg_index++, sizeof(cl_uint), (void*)&height);
-  err |= clSetKernelArg(kernel_cols_, arg_index++, sizeof(cl_uint), (void*)&pitch);
-  err |= clSetKernelArg(kernel_cols_, arg_index++, sizeof(cl_uint), (void*)&k_h);
+  size_t localWorkSize[2] = { (size_t)tile_config_.cols_block_x,
+                              (size_t)tile_config_.cols_block_y };
+  size_t globalWorkSize[2] = { RoundUp(width, localWorkSize[0]),
+                               RoundUp(height, localWorkSize[1]) };
+  cl_int err = clEnqueueNDRangeKernel(queue, kernel_cols_tiled_, 2, nullptr,
+    globalWorkSize, localWorkSize, 0, nullptr, ProfileEvent());
   if (err != CL_SUCCESS) {
-    std::cerr << "RunKernel failed" << std::endl;
+    std::cerr << "clEnqueueNDRangeKernel failed return " << err << std::endl;
+    return false;
+  }
+  Profile("cols", PassBytes(pitch, height));
+
+  return true;
+}
+
+inline bool
+OpenCLSeperableConv::RunConvolutionFused(cl_command_queue queue,
+  cl_mem input_buffer, cl_mem output_buffer,
+  cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
+  cl_uint pitch, cl_uint k) {
+  if (!SetConvolutionArgs(kernel_fused_, input_buffer, output_buffer,
+        gaussian_kernel_1d, width, height, pitch, k)) {
+    return false;
+  }
+
+  // every work-group covers fused_block_y * fused_steps output rows
+  const size_t tile_h = (size_t)tile_config_.fused_block_y * tile_config_.fused_steps;
+  size_t localWorkSize[2] = { (size_t)tile_config_.fused_block_x,
+                              (size_t)tile_config_.fused_block_y };
+  size_t globalWorkSize[2] = { RoundUp(width, localWorkSize[0]),
+                               (height + tile_h - 1) / tile_h * localWorkSize[1] };
+  cl_int err = clEnqueueNDRangeKernel(queue, kernel_fused_, 2, nullptr,
+    globalWorkSize, localWorkSize, 0, nullptr, ProfileEvent());
+  if (err != CL_SUCCESS) {
+    std::cerr << "clEnqueueNDRangeKernel failed return " << err << std::endl;
+    return false;
+  }
+  Profile("fused", 2 * (size_t)pitch * height);
+
+  return true;
+}
+
+inline bool
+OpenCLSeperableConv::RunConvolutionRowsRGBA(cl_command_queue queue,
+  cl_mem input_buffer, cl_mem temp_buffer,
+  cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
+  cl_uint pitch, cl_uint k_w) {
+  if (!SetConvolutionArgs(kernel_rows_rgba_, input_buffer, temp_buffer,
+        gaussian_kernel_1d, width, height, pitch, k_w)) {
     return false;
   }
 
-  size_t globalWorkSize[2] = { (size_t)height, (size_t)width};
-  err = clEnqueueNDRangeKernel(queue, kernel_cols_, 2, nullptr, globalWorkSize, nullptr, 0, nullptr, nullptr);
+  return EnqueueSimple(queue, kernel_rows_rgba_, width, height,
+    "rows", PassBytes(pitch, height));
+}
+
+inline bool
+OpenCLSeperableConv::RunConvolutionColsRGBA(cl_command_queue queue,
+  cl_mem temp_buffer, cl_mem output_buffer,
+  cl_mem gaussian_kernel_1d, cl_uint width, cl_uint height,
+  cl_uint pitch, cl_uint k_h) {
+  if (!SetConvolutionArgs(kernel_cols_rgba_, temp_buffer, output_buffer,
+        gaussian_kernel_1d, width, height, pitch, k_h)) {
+    return false;
+  }
+
+  // four pixels per work-item
+  return EnqueueSimple(queue, kernel_cols_rgba_, ((size_t)width + 3) / 4, height,
+    "cols", PassBytes(pitch, height));
+}
+
+inline bool OpenCLSeperableConv::EnqueueSimple(cl_command_queue queue,
+  cl_kernel kernel, size_t global_x, size_t global_y, const char* stage, size_t bytes,
+  size_t offset_x, size_t offset_y) {
+  // the kernels bounds-check, a fixed local size only rounds the grid up
+  const bool fixed_local = local_size_[0] && local_size_[1];
+  size_t globalWorkSize[2] = { global_x, global_y };
+  if (fixed_local) {
+    globalWorkSize[0] = RoundUp(global_x, local_size_[0]);
+    globalWorkSize[1] = RoundUp(global_y, local_size_[1]);
+  }
+  size_t globalWorkOffset[2] = { offset_x, offset_y };
+  cl_int err = clEnqueueNDRangeKernel(queue, kernel, 2,
+    offset_x || offset_y ? globalWorkOffset : nullptr, globalWorkSize,
+    fixed_local ? local_size_ : nullptr, 0, nullptr, ProfileEvent());
   if (err != CL_SUCCESS) {
     std::cerr << "clEnqueueNDRangeKernel failed return " << err << std::endl;
+    return false;
+  }
+  Profile(stage, bytes);
+  return true;
+}
+
+inline bool OpenCLSeperableConv::EnqueueBorder(cl_command_queue queue,
+  cl_kernel kernel, cl_uint border_arg, float border_value, const char* stage,
+  size_t item_bytes, cl_uint width, cl_uint height,
+  cl_uint x0, cl_uint x1, cl_uint y0, cl_uint y1) {
+  const cl_int border = static_cast<cl_int>(border_mode_);
+  cl_int err = clSetKernelArg(kernel, border_arg, sizeof(cl_int), &border);
+  err |= clSetKernelArg(kernel, border_arg + 1, sizeof(float), &border_value);
+  if (err != CL_SUCCESS) {
+    std::cerr << "clSetKernelArg border failed return " << err << std::endl;
+    return false;
   }
 
+  // top and bottom span the full width, left and right the rows between.
+  // The strips are exact, the driver picks the local size of a few pixel
+  // wide launch better than a tuned 2D shape would.
+  const size_t strips[4][4] = {
+    {0, 0, width, y0},
+    {0, y1, width, height - y1},
+    {0, y0, x0, y1 - y0},
+    {x1, y0, width - x1, y1 - y0},
+  };
+  for (const auto& strip : strips) {
+    if (strip[2] == 0 || strip[3] == 0) continue;
+    size_t globalWorkOffset[2] = { strip[0], strip[1] };
+    size_t globalWorkSize[2] = { strip[2], strip[3] };
+    err = clEnqueueNDRangeKernel(queue, kernel, 2, globalWorkOffset, globalWorkSize,
+      nullptr, 0, nullptr, ProfileEvent());
+    if (err != CL_SUCCESS) {
+      std::cerr << "clEnqueueNDRangeKernel border failed return " << err << std::endl;
+      return false;
+    }
+    Profile(stage, strip[2] * strip[3] * item_bytes);
+  }
   return true;
 }
 
+inline cl_event* OpenCLSeperableConv::ProfileEvent() {
+  profile_event_ = nullptr;
+  // the profiler drops commands of queues without CL_QUEUE_PROFILING_ENABLE
+  return profiler_ ? &profile_event_ : nullptr;
+}
+
+inline void OpenCLSeperableConv::Profile(const char* stage, size_t bytes) {
+  if (!profile_event_) return;
+  profiler_->record(stage, profile_event_, bytes);
+  profile_event_ = nullptr;
+}
+
+inline size_t OpenCLSeperableConv::PassBytes(cl_uint pitch, cl_uint height) const {
+  return (size_t)pitch * height * (sizeof(uchar) + IntermediateElementSize());
+}
+
+inline void OpenCLSeperableConv::SetBorderMode(BorderMode mode, float value) {
+  border_mode_ = mode;
+  border_value_ = value;
+}
+
+inline BorderMode OpenCLSeperableConv::GetBorderMode() const { return border_mode_; }
+
+inline void OpenCLSeperableConv::SetProfiler(std::shared_ptr<Profiler> profiler) {
+  profiler_ = std::move(profiler);
+}
+
+inline const std::shared_ptr<Profiler>& OpenCLSeperableConv::GetProfiler() const {
+  return profiler_;
+}
+
+inline bool OpenCLSeperableConv::NeedsTempBuffer(int channels, int kernel_size) const {
+  return channels == 4 || variant_ != KernelVariant::kFused || !kernel_fused_ ||
+         border_mode_ != BorderMode::kReplicate ||
+         kernel_size / 2 > tile_config_.max_radius;
+}
+
+inline bool OpenCLSeperableConv::EnqueueBlur(cl_command_queue queue,
+  cl_mem input_buf, cl_mem temp_buf, cl_mem output_buf, cl_mem kernel_buf,
+  int width, int height, int channels, cl_uint k,
+  cl_uint num_wait_events, const cl_event* wait_events, cl_event* done) {
+  cl_int err = CL_SUCCESS;
+  if (num_wait_events > 0) {
+    // on an in-order queue the barrier holds back every following command
+    err = clEnqueueBarrierWithWaitList(queue, num_wait_events, wait_events, nullptr);
+    if (err != CL_SUCCESS) {
+      std::cerr << "clEnqueueBarrierWithWaitList failed return " << err << std::endl;
+      return false;
+    }
+  }
+
+  // the specialized pair handles 3 and 4 channels, otherwise four channel
+  // input always goes through the vector kernels and the variants only
+  // apply to the three channel layout. Only the naive passes know other
+  // border modes than replicate, they take any channel count.
+  const bool replicate = border_mode_ == BorderMode::kReplicate;
+  const bool specialized = replicate && variant_ == KernelVariant::kSpecialized &&
+    kernel_rows_fixed_ && fixed_taps_ == (int)k && fixed_channels_ == channels;
+  // the folded passes take any channel count, like the specialized pair
+  const bool fixed_point = replicate && variant_ == KernelVariant::kFixedPoint &&
+    kernel_rows_q16_ && kernel_cols_q16_ && q16_taps_ == (int)k;
+  const bool folded = replicate && !fixed_point &&
+    (variant_ == KernelVariant::kFolded || variant_ == KernelVariant::kFixedPoint) &&
+    kernel_rows_folded_ && kernel_cols_folded_ && folded_taps_ == (int)k;
+  const bool rgba = replicate && !specialized && !fixed_point && !folded && channels == 4;
+  const bool fits_tile = (int)k / 2 <= tile_config_.max_radius;
+  const bool fused = replicate && !rgba && variant_ == KernelVariant::kFused &&
+    kernel_fused_ && fits_tile;
+  const bool tiled = replicate && !rgba && variant_ == KernelVariant::kTiled &&
+    kernel_rows_tiled_ && kernel_cols_tiled_ && fits_tile;
+  const cl_uint pitch = width * channels;
+
+  bool ok = true;
+  if (fixed_point) {
+    ok = RunConvolutionElements(queue, kernel_rows_q16_, "rows", input_buf, temp_buf,
+                                q16_weights_, width, height, pitch, k) &&
+         RunConvolutionElements(queue, kernel_cols_q16_, "cols", temp_buf, output_buf,
+                                q16_weights_, width, height, pitch, k);
+  } else if (folded) {
+    ok = RunConvolutionElements(queue, kernel_rows_folded_, "rows", input_buf, temp_buf,
+                                kernel_buf, width, height, pitch, k) &&
+         RunConvolutionElements(queue, kernel_cols_folded_, "cols", temp_buf, output_buf,
+                                kernel_buf, width, height, pitch, k);
+  } else if (specialized) {
+    ok = RunConvolutionFixed(queue, kernel_rows_fixed_, input_buf, temp_buf,
+                             kernel_buf, width, height, pitch, k) &&
+         RunConvolutionFixed(queue, kernel_cols_fixed_, temp_buf, output_buf,
+                             kernel_buf, width, height, pitch, k);
+  } else if (rgba) {
+    ok = RunConvolutionRowsRGBA(queue, input_buf, temp_buf, kernel_buf,
+                                width, height, pitch, k) &&
+         RunConvolutionColsRGBA(queue, temp_buf, output_buf, kernel_buf,
+                                width, height, pitch, k);
+  } else if (fused) {
+    ok = RunConvolutionFused(queue, input_buf, output_buf, kernel_buf,
+                             width, height, pitch, k);
+  } else if (tiled) {
+    ok = RunConvolutionRowsTiled(queue, input_buf, temp_buf, kernel_buf,
+                                 width, height, pitch, k) &&
+         RunConvolutionColsTiled(queue, temp_buf, output_buf, kernel_buf,
+                                 width, height, pitch, k);
+  } else {
+    ok = RunConvolutionRows(queue, input_buf, temp_buf, kernel_buf,
+                            width, height, pitch, k) &&
+         RunConvolutionCols(queue, temp_buf, output_buf, kernel_buf,
+                            width, height, pitch, k);
+  }
+  if (!ok) return false;
+
+  if (done) {
+    // completes once both passes are done
+    err = clEnqueueMarkerWithWaitList(queue, 0, nullptr, done);
+    if (err != CL_SUCCESS) {
+      std::cerr << "clEnqueueMarkerWithWaitList failed return " << err << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
 
 inline bool OpenCLSeperableConv::Run(const cv::Mat& input, const std::vector<float>& kernel, cv::Mat& output) {
+  if (tuning_db_ && !tuning_) {
+    ApplyTuning(input.cols, input.rows, input.channels(), (int)kernel.size() / 2);
+  }
+  // without image support kImage runs the naive buffer passes, as does
+  // any border mode the clamp-to-edge sampler cannot express
+  if (variant_ == KernelVariant::kImage && kernel_rows_image_ && kernel_cols_image_ &&
+      border_mode_ == BorderMode::kReplicate) {
+    return RunImage(input, kernel, output);
+  }
+  if (!pack_rgba_ || input.channels() != 3) {
+    return RunOnDevice(input, kernel, output);
+  }
+
+  // pad BGR to BGRA so the vector kernels see one uchar4 per pixel
+  if (memory_mode_ == MemoryMode::kZeroCopy && packed_input_.size() != input.size()) {
+    packed_input_ = AllocatePageAligned(input.rows, input.cols, CV_8UC4);
+  }
+  cv::cvtColor(input, packed_input_, cv::COLOR_BGR2BGRA);
+  if (!RunOnDevice(packed_input_, kernel, packed_output_)) {
+    return false;
+  }
+  // a Mat left over from zero-copy mode wraps memory it does not own
+  if (!output.u) output.release();
+  cv::cvtColor(packed_output_, output, cv::COLOR_BGRA2BGR);
+  return true;
+}
+
+inline bool OpenCLSeperableConv::Specialize(const std::vector<float>& kernel, int channels) {
+  kernel_rows_fixed_ = nullptr;
+  kernel_cols_fixed_ = nullptr;
+  fixed_taps_ = 0;
+  fixed_channels_ = 0;
+  if (kernel.size() % 2 == 0 || !runtime_) return false;
+
+  // scientific keeps a decimal point, every literal stays a valid float
+  std::ostringstream options;
+  options << build_options_ << " -DRADIUS=" << kernel.size() / 2
+          << " -DCHANNELS=" << channels << " -DCOEFFS=";
+  options << std::scientific << std::setprecision(8);
+  for (size_t i = 0; i < kernel.size(); i++) {
+    options << (i ? "," : "") << kernel[i] << "f";
+  }
+  const std::string key = options.str();
+
+  auto it = specialized_.begin();
+  while (it != specialized_.end() && it->options != key) ++it;
+  if (it != specialized_.end()) {
+    specialized_.splice(specialized_.begin(), specialized_, it);
+  } else {
+    SpecializedVariant variant{key, std::string(), nullptr, nullptr, nullptr,
+                               (int)kernel.size(), channels};
+    // counted, another conv on the same runtime may hold the same variant
+    variant.program = runtime_->programCache().acquireProgramFromFile(
+      kSeperableKernelPath, key, &variant.program_key);
+    if (!variant.program) {
+      std::cerr << "Build specialized variant failed" << std::endl;
+      return false;
+    }
+    cl_int err_rows = CL_SUCCESS;
+    cl_int err_cols = CL_SUCCESS;
+    variant.rows = clCreateKernel(variant.program, "gaussian_blur_rows_fixed", &err_rows);
+    variant.cols = clCreateKernel(variant.program, "gaussian_blur_cols_fixed", &err_cols);
+    if (err_rows != CL_SUCCESS || err_cols != CL_SUCCESS) {
+      std::cerr << "clCreateKernel fixed error return " << err_rows << " " << err_cols << std::endl;
+      if (variant.rows) clReleaseKernel(variant.rows);
+      if (variant.cols) clReleaseKernel(variant.cols);
+      runtime_->programCache().releaseProgram(variant.program_key);
+      return false;
+    }
+    specialized_.push_front(variant);
+    // drops the least recently used variants
+    SetSpecializedCacheSize(specialized_capacity_);
+  }
+
+  kernel_rows_fixed_ = specialized_.front().rows;
+  kernel_cols_fixed_ = specialized_.front().cols;
+  fixed_taps_ = specialized_.front().taps;
+  fixed_channels_ = specialized_.front().channels;
+  return true;
+}
+
+inline void OpenCLSeperableConv::ReleaseSpecialized() {
+  for (SpecializedVariant& variant : specialized_) {
+    clReleaseKernel(variant.rows);
+    clReleaseKernel(variant.cols);
+    if (runtime_) runtime_->programCache().releaseProgram(variant.program_key);
+  }
+  specialized_.clear();
+  kernel_rows_fixed_ = nullptr;
+  kernel_cols_fixed_ = nullptr;
+  fixed_taps_ = 0;
+  fixed_channels_ = 0;
+}
+
+inline void OpenCLSeperableConv::SetSpecializedCacheSize(size_t size) {
+  // the active variant always stays cached
+  specialized_capacity_ = size < 1 ? 1 : size;
+  while (specialized_.size() > specialized_capacity_) {
+    SpecializedVariant& oldest = specialized_.back();
+    clReleaseKernel(oldest.rows);
+    clReleaseKernel(oldest.cols);
+    runtime_->programCache().releaseProgram(oldest.program_key);
+    specialized_.pop_back();
+  }
+}
+
+inline size_t OpenCLSeperableConv::SpecializedVariantCount() const {
+  return specialized_.size();
+}
+
+inline bool OpenCLSeperableConv::RunConvolutionFixed(cl_command_queue queue,
+  cl_kernel kernel, cl_mem src, cl_mem dst, cl_mem gaussian_kernel_1d,
+  cl_uint width, cl_uint height, cl_uint pitch, cl_uint k) {
+  if (!SetConvolutionArgs(kernel, src, dst, gaussian_kernel_1d, width, height, pitch, k)) {
+    return false;
+  }
+
+  // x runs along get_global_id(0)
+  size_t globalWorkSize[2] = { (size_t)width, (size_t)height };
+  cl_int err = clEnqueueNDRangeKernel(queue, kernel, 2, nullptr, globalWorkSize, nullptr, 0, nullptr,
+    ProfileEvent());
+  if (err != CL_SUCCESS) {
+    std::cerr << "clEnqueueNDRangeKernel failed return " << err << std::endl;
+    return false;
+  }
+  Profile(kernel == kernel_rows_fixed_ ? "rows" : "cols", PassBytes(pitch, height));
+  return true;
+}
+
+inline bool OpenCLSeperableConv::RunConvolutionElements(cl_command_queue queue,
+  cl_kernel kernel, const char* stage, cl_mem src, cl_mem dst, cl_mem weights,
+  cl_uint width, cl_uint height, cl_uint pitch, cl_uint k) {
+  if (!SetConvolutionArgs(kernel, src, dst, weights, width, height, pitch, k)) {
+    return false;
+  }
+  return EnqueueSimple(queue, kernel, pitch, height, stage, PassBytes(pitch, height));
+}
+
+inline bool OpenCLSeperableConv::Fold(const std::vector<float>& kernel) {
+  // Run calls this every frame, the kernel seen last time keeps its weights
+  const bool uploaded = variant_ != KernelVariant::kFixedPoint || q16_taps_;
+  if (kernel == folded_kernel_ && (!folded_taps_ || uploaded)) return folded_taps_ != 0;
+
+  folded_kernel_ = kernel;
+  folded_taps_ = isSymmetric(kernel) ? (int)kernel.size() : 0;
+  q16_taps_ = 0;
+  if (!folded_taps_) return false;
+  if (variant_ != KernelVariant::kFixedPoint) return true;
+
+  const std::vector<uint16_t> weights = quantizeKernelQ16(kernel);
+  if (weights.empty() || !context_) return false;
+  const size_t size = weights.size() * sizeof(cl_ushort);
+  // a buffer of its own, EnqueueBlur callers keep it across ReleaseBuffers
+  if (q16_weights_) clReleaseMemObject(q16_weights_);
+  cl_int err = CL_SUCCESS;
+  q16_weights_ = clCreateBuffer(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+    size, (void*)weights.data(), &err);
+  if (err != CL_SUCCESS) {
+    std::cerr << "clCreateBuffer q16 weights failed return " << err << std::endl;
+    q16_weights_ = nullptr;
+    return false;
+  }
+  q16_taps_ = (int)kernel.size();
+  return true;
+}
+
+inline bool OpenCLSeperableConv::AcquireImages(int width, int height) {
+  // half keeps the fraction between the passes and stays filterable
+  const cl_channel_type temp_type =
+    temp_format_ == IntermediateFormat::kUChar ? CL_UNORM_INT8 : CL_HALF_FLOAT;
+  if (image_input_ && image_width_ == width && image_height_ == height &&
+      image_temp_type_ == temp_type) {
+    return true;
+  }
+  ReleaseImages();
+
+  cl_image_desc desc;
+  std::memset(&desc, 0, sizeof(desc));
+  desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+  desc.image_width = width;
+  desc.image_height = height;
+  cl_image_format rgba8 = {CL_RGBA, CL_UNORM_INT8};
+  cl_image_format temp_format = {CL_RGBA, temp_type};
+
+  cl_int err = CL_SUCCESS;
+  image_input_ = clCreateImage(context_, CL_MEM_READ_ONLY, &rgba8, &desc, nullptr, &err);
+  if (err == CL_SUCCESS) {
+    image_temp_ = clCreateImage(context_, CL_MEM_READ_WRITE, &temp_format, &desc, nullptr, &err);
+  }
+  if (err == CL_SUCCESS) {
+    image_output_ = clCreateImage(context_, CL_MEM_WRITE_ONLY, &rgba8, &desc, nullptr, &err);
+  }
+  if (err != CL_SUCCESS) {
+    std::cerr << "clCreateImage failed return " << err << std::endl;
+    ReleaseImages();
+    return false;
+  }
+  image_width_ = width;
+  image_height_ = height;
+  image_temp_type_ = temp_type;
+  return true;
+}
+
+inline void OpenCLSeperableConv::ReleaseImages() {
+  if (image_input_) clReleaseMemObject(image_input_);
+  if (image_temp_) clReleaseMemObject(image_temp_);
+  if (image_output_) clReleaseMemObject(image_output_);
+  image_input_ = nullptr;
+  image_temp_ = nullptr;
+  image_output_ = nullptr;
+  image_width_ = 0;
+  image_height_ = 0;
+  image_temp_type_ = 0;
+}
+
+inline bool OpenCLSeperableConv::RunImage(const cv::Mat& input,
+  const std::vector<float>& kernel, cv::Mat& output) {
+  const int width = input.cols;
+  const int height = input.rows;
+  const int channels = input.channels();
+  CV_Assert(input.depth() == CV_8U);
+  CV_Assert(channels == 3 || channels == 4);
+
+  // CL_RGB is rarely supported, images are always four channel
+  const cv::Mat* rgba = &input;
+  if (channels == 3) {
+    cv::cvtColor(input, image_host_input_, cv::COLOR_BGR2BGRA);
+    rgba = &image_host_input_;
+  }
+  if (!AcquireImages(width, height)) return false;
+
+  const std::vector<cl_float2> taps = BilinearTaps(kernel);
+  cl_mem taps_buf = buffer_pool_.acquire("image_taps",
+    taps.size() * sizeof(cl_float2), CL_MEM_READ_ONLY);
+  if (!taps_buf) {
+    std::cerr << "acquire image taps failed" << std::endl;
+    return false;
+  }
+
+  const size_t origin[3] = {0, 0, 0};
+  const size_t region[3] = {(size_t)width, (size_t)height, 1};
+  cl_int err = clEnqueueWriteBuffer(queue_, taps_buf, CL_FALSE, 0,
+    taps.size() * sizeof(cl_float2), taps.data(), 0, nullptr, ProfileEvent());
+  Profile("weights", taps.size() * sizeof(cl_float2));
+  err |= clEnqueueWriteImage(queue_, image_input_, CL_FALSE, origin, region,
+    rgba->step, 0, rgba->data, 0, nullptr, ProfileEvent());
+  if (err != CL_SUCCESS) {
+    std::cerr << "clEnqueueWriteImage failed return " << err << std::endl;
+    return false;
+  }
+  const size_t rgba_size = (size_t)width * height * 4;
+  Profile("upload", rgba_size);
+
+  const cl_int num_taps = (cl_int)taps.size();
+  const size_t global[2] = {(size_t)width, (size_t)height};
+  cl_mem passes[2][2] = {{image_input_, image_temp_}, {image_temp_, image_output_}};
+  cl_kernel kernels[2] = {kernel_rows_image_, kernel_cols_image_};
+  const char* stages[2] = {"rows", "cols"};
+  const size_t pass_bytes = rgba_size * (image_temp_type_ == CL_UNORM_INT8 ? 2 : 3);
+  for (int pass = 0; pass < 2; pass++) {
+    int arg_index = 0;
+    err  = clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_mem), &passes[pass][0]);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_mem), &passes[pass][1]);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_mem), &taps_buf);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_int), &num_taps);
+    if (err != CL_SUCCESS) {
+      std::cerr << "RunKernel failed" << std::endl;
+      return false;
+    }
+    err = clEnqueueNDRangeKernel(queue_, kernels[pass], 2, nullptr, global, nullptr,
+                                 0, nullptr, ProfileEvent());
+    if (err != CL_SUCCESS) {
+      std::cerr << "clEnqueueNDRangeKernel failed return " << err << std::endl;
+      return false;
+    }
+    Profile(stages[pass], pass_bytes);
+  }
+
+  image_host_output_.create(height, width, CV_8UC4);
+  err = clEnqueueReadImage(queue_, image_output_, CL_TRUE, origin, region,
+    image_host_output_.step, 0, image_host_output_.data, 0, nullptr, ProfileEvent());
+  if (err != CL_SUCCESS) {
+    std::cerr << "clEnqueueReadImage failed return " << err << std::endl;
+    return false;
+  }
+  Profile("download", rgba_size);
+
+  // a Mat left over from zero-copy mode wraps memory it does not own
+  if (!output.u) output.release();
+  if (channels == 3) {
+    cv::cvtColor(image_host_output_, output, cv::COLOR_BGRA2BGR);
+  } else {
+    image_host_output_.copyTo(output);
+  }
+  return true;
+}
+
+inline bool OpenCLSeperableConv::RunRecursive(const cv::Mat& input, float sigma,
+  cv::Mat& output) {
   const int width = input.cols;
   const int height = input.rows;
   const int channels = input.channels();
   const size_t image_size = width * height * channels;
 
   CV_Assert(input.depth() == CV_8U);
+  if (!kernel_rows_iir_ || !kernel_cols_iir_) {
+    std::cerr << "recursive kernels are not built" << std::endl;
+    return false;
+  }
 
-  cl_int err = CL_SUCCESS;
-  cl_mem input_buf = clCreateBuffer(context_,
-    CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-    image_size * sizeof(uchar),
-    (void*)input.data, &err
-  );
+  UnmapOutput();
+
+  cl_mem input_buf = nullptr;
+  if (!UploadInput(input, image_size, &input_buf)) {
+    return false;
+  }
+  // the recursion accumulates, the intermediate is always float
+  cl_mem temp_buf = buffer_pool_.acquire("temp_iir",
+    image_size * sizeof(float), CL_MEM_READ_WRITE);
+  cl_mem output_buf = memory_mode_ == MemoryMode::kZeroCopy
+    ? buffer_pool_.acquire("output", image_size * sizeof(uchar),
+        CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR)
+    : buffer_pool_.acquire("output", image_size * sizeof(uchar),
+        CL_MEM_WRITE_ONLY);
+  if (!temp_buf || !output_buf) {
+    std::cerr << "acquire device buffers failed" << std::endl;
+    return false;
+  }
+
+  const RecursiveGaussian g = RecursiveGaussian::fromSigma(sigma);
+  cl_float4 coeffs;
+  coeffs.s[0] = g.b;
+  coeffs.s[1] = g.a1;
+  coeffs.s[2] = g.a2;
+  coeffs.s[3] = g.a3;
+  cl_float16 boundary = {};
+  std::copy(g.boundary, g.boundary + 9, boundary.s);
+
+  const cl_int w = width, h = height, c = channels;
+  const size_t lines[2] = {RoundUp((size_t)height * channels, 64),
+                           RoundUp((size_t)width * channels, 64)};
+  cl_mem passes[2][2] = {{input_buf, temp_buf}, {temp_buf, output_buf}};
+  cl_kernel kernels[2] = {kernel_rows_iir_, kernel_cols_iir_};
+  const char* stages[2] = {"rows", "cols"};
+  for (int pass = 0; pass < 2; pass++) {
+    int arg_index = 0;
+    cl_int err = clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_mem), &passes[pass][0]);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_mem), &passes[pass][1]);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_int), &w);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_int), &h);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_int), &c);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_float4), &coeffs);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_float16), &boundary);
+    if (err != CL_SUCCESS) {
+      std::cerr << "RunKernel failed" << std::endl;
+      return false;
+    }
+    err = clEnqueueNDRangeKernel(queue_, kernels[pass], 1, nullptr, &lines[pass], nullptr,
+                                 0, nullptr, ProfileEvent());
+    if (err != CL_SUCCESS) {
+      std::cerr << "clEnqueueNDRangeKernel failed return " << err << std::endl;
+      return false;
+    }
+    Profile(stages[pass], image_size * (sizeof(uchar) + sizeof(float)));
+  }
+
+  clFinish(queue_);
+
+  return DownloadOutput(output_buf, width, height, input.type(), image_size, output);
+}
+
+inline bool OpenCLSeperableConv::RunGaussian(const cv::Mat& input, float sigma,
+  cv::Mat& output) {
+  if (preferRecursive(sigma, recursive_threshold_) && kernel_rows_iir_ && kernel_cols_iir_) {
+    return RunRecursive(input, sigma, output);
+  }
+  return Run(input, gaussianKernel1D(sigma), output);
+}
+
+inline void OpenCLSeperableConv::SetRecursiveSigmaThreshold(float sigma) {
+  recursive_threshold_ = sigma;
+}
+
+inline float OpenCLSeperableConv::GetRecursiveSigmaThreshold() const {
+  return recursive_threshold_;
+}
+
+inline bool OpenCLSeperableConv::Run2D(const cv::Mat& input, const cv::Mat& kernel,
+  cv::Mat& output) {
+  CV_Assert(input.depth() == CV_8U);
+  CV_Assert(kernel.type() == CV_32FC1 && !kernel.empty());
+  // set again once a path has run
+  last_rank_ = 0;
+  if (!kernel_2d_ || !kernel_2d_border_ || !kernel_lowrank_rows_ || !kernel_lowrank_cols_) {
+    std::cerr << "2D kernels are not built" << std::endl;
+    return false;
+  }
+
+  const cv::Mat coeffs = kernel.isContinuous() ? kernel : kernel.clone();
+  const int k_w = coeffs.cols;
+  const int k_h = coeffs.rows;
+  const float* data = coeffs.ptr<float>();
+  const size_t taps = (size_t)k_w * k_h;
+  if (lowrank_source_.size() != coeffs.size() ||
+      !std::equal(data, data + taps, lowrank_source_.ptr<float>())) {
+    lowrank_source_ = coeffs.clone();
+    lowrank_ = decomposeKernel2D(std::vector<float>(data, data + taps), k_h, k_w,
+                                 lowrank_max_rank_, lowrank_tolerance_);
+  }
+  // a term costs k_w + k_h taps and two launches, a near full rank kernel
+  // is cheaper direct
+  const int rank = (int)lowrank_.terms.size();
+  const bool separable = rank > 0 && (size_t)rank * (k_w + k_h) < taps;
+
+  const int width = input.cols;
+  const int height = input.rows;
+  const int channels = input.channels();
+  const size_t image_size = (size_t)width * height * channels;
+
+  // the previous zero-copy result is about to be overwritten
+  UnmapOutput();
+
+  cl_mem input_buf = nullptr;
+  if (!UploadInput(input, image_size, &input_buf)) {
+    return false;
+  }
+  cl_mem output_buf = memory_mode_ == MemoryMode::kZeroCopy
+    ? buffer_pool_.acquire("output", image_size * sizeof(uchar),
+        CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR)
+    : buffer_pool_.acquire("output", image_size * sizeof(uchar),
+        CL_MEM_WRITE_ONLY);
+
+  // every term as its row vector followed by its column vector
+  std::vector<float> weights;
+  if (separable) {
+    for (const SeparableTerm& term : lowrank_.terms) {
+      weights.insert(weights.end(), term.row.begin(), term.row.end());
+      weights.insert(weights.end(), term.column.begin(), term.column.end());
+    }
+  } else {
+    weights.assign(data, data + taps);
+  }
+  cl_mem weights_buf = buffer_pool_.acquire("kernel2d",
+    weights.size() * sizeof(float), CL_MEM_READ_ONLY);
+  if (!output_buf || !weights_buf) {
+    std::cerr << "acquire device buffers failed" << std::endl;
+    return false;
+  }
+  cl_int err = clEnqueueWriteBuffer(queue_, weights_buf, CL_FALSE, 0,
+    weights.size() * sizeof(float), weights.data(), 0, nullptr, ProfileEvent());
   if (err != CL_SUCCESS) {
-    std::cerr << "clCreateBuffer input_buf failed return " << err << std::endl;
+    std::cerr << "clEnqueueWriteBuffer failed return " << err << std::endl;
+    return false;
+  }
+  Profile("weights", weights.size() * sizeof(float));
+
+  const bool ok = separable
+    ? RunLowRank(input_buf, output_buf, weights_buf, width, height, channels, k_w, k_h)
+    : RunDirect2D(input_buf, output_buf, weights_buf, width, height, channels, k_w, k_h);
+  if (!ok) {
+    // the weights write above still reads from the local vector
+    clFinish(queue_);
+    return false;
+  }
+  last_rank_ = separable ? rank : 0;
+
+  clFinish(queue_);
+
+  return DownloadOutput(output_buf, width, height, input.type(), image_size, output);
+}
+
+inline bool OpenCLSeperableConv::RunLowRank(cl_mem input_buf, cl_mem output_buf,
+  cl_mem weights_buf, int width, int height, int channels, int k_w, int k_h) {
+  const size_t image_size = (size_t)width * height * channels;
+  const int rank = (int)lowrank_.terms.size();
+  cl_mem temp_buf = buffer_pool_.acquire("lowrank_temp",
+    image_size * sizeof(float), CL_MEM_READ_WRITE);
+  // a single term writes output directly, the kernel never reads accum
+  cl_mem accum_buf = rank == 1 ? temp_buf : buffer_pool_.acquire("lowrank_accum",
+    image_size * sizeof(float), CL_MEM_READ_WRITE);
+  if (!temp_buf || !accum_buf) {
+    std::cerr << "acquire device buffers failed" << std::endl;
+    return false;
+  }
+
+  // one work-item per element, the interior in elements
+  const cl_int pitch = width * channels;
+  const cl_int x0 = std::min(k_w / 2, width) * channels;
+  const cl_int x1 = std::max(width - (k_w - 1 - k_w / 2), x0 / channels) * channels;
+  const cl_int y0 = std::min(k_h / 2, height);
+  const cl_int y1 = std::max(height - (k_h - 1 - k_h / 2), y0);
+  const cl_int none = -1;  // BORDER_NONE, the interior launch
+  const size_t rows_bytes = sizeof(uchar) + sizeof(float);
+  const size_t cols_bytes = rank == 1 ? sizeof(float) + sizeof(uchar) : 3 * sizeof(float);
+
+  for (cl_int term = 0; term < rank; ++term) {
+    const std::vector<float>& row = lowrank_.terms[term].row;
+    const cl_int first = term == 0;
+    const cl_int last = term == rank - 1;
+    // a constant padding comes out of the row pass scaled by the row sum
+    const float cols_border_value =
+      border_value_ * std::accumulate(row.begin(), row.end(), 0.0f);
+
+    cl_int err;
+    int arg_index = 0;
+    err  = clSetKernelArg(kernel_lowrank_rows_, arg_index++, sizeof(cl_mem), &input_buf);
+    err |= clSetKernelArg(kernel_lowrank_rows_, arg_index++, sizeof(cl_mem), &temp_buf);
+    err |= clSetKernelArg(kernel_lowrank_rows_, arg_index++, sizeof(cl_mem), &weights_buf);
+    err |= clSetKernelArg(kernel_lowrank_rows_, arg_index++, sizeof(cl_int), &width);
+    err |= clSetKernelArg(kernel_lowrank_rows_, arg_index++, sizeof(cl_int), &height);
+    err |= clSetKernelArg(kernel_lowrank_rows_, arg_index++, sizeof(cl_int), &pitch);
+    err |= clSetKernelArg(kernel_lowrank_rows_, arg_index++, sizeof(cl_int), &k_w);
+    err |= clSetKernelArg(kernel_lowrank_rows_, arg_index++, sizeof(cl_int), &none);
+    err |= clSetKernelArg(kernel_lowrank_rows_, arg_index++, sizeof(float), &border_value_);
+    err |= clSetKernelArg(kernel_lowrank_rows_, arg_index++, sizeof(cl_int), &k_h);
+    err |= clSetKernelArg(kernel_lowrank_rows_, arg_index++, sizeof(cl_int), &term);
+    if (err != CL_SUCCESS) {
+      std::cerr << "clSetKernelArg lowrank_rows failed return " << err << std::endl;
+      return false;
+    }
+    if (x1 > x0 && !EnqueueSimple(queue_, kernel_lowrank_rows_, x1 - x0, height,
+          "rows", (size_t)(x1 - x0) * height * rows_bytes, x0, 0)) {
+      return false;
+    }
+    if (!EnqueueBorder(queue_, kernel_lowrank_rows_, 7, border_value_, "rows_border",
+          rows_bytes, pitch, height, x0, x1, 0, height)) {
+      return false;
+    }
+
+    arg_index = 0;
+    err  = clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(cl_mem), &temp_buf);
+    err |= clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(cl_mem), &output_buf);
+    err |= clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(cl_mem), &weights_buf);
+    err |= clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(cl_int), &width);
+    err |= clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(cl_int), &height);
+    err |= clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(cl_int), &pitch);
+    err |= clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(cl_int), &k_h);
+    err |= clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(cl_int), &none);
+    err |= clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(float), &cols_border_value);
+    err |= clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(cl_mem), &accum_buf);
+    err |= clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(cl_int), &k_w);
+    err |= clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(cl_int), &term);
+    err |= clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(cl_int), &first);
+    err |= clSetKernelArg(kernel_lowrank_cols_, arg_index++, sizeof(cl_int), &last);
+    if (err != CL_SUCCESS) {
+      std::cerr << "clSetKernelArg lowrank_cols failed return " << err << std::endl;
+      return false;
+    }
+    if (y1 > y0 && !EnqueueSimple(queue_, kernel_lowrank_cols_, pitch, y1 - y0,
+          "cols", (size_t)pitch * (y1 - y0) * cols_bytes, 0, y0)) {
+      return false;
+    }
+    if (!EnqueueBorder(queue_, kernel_lowrank_cols_, 7, cols_border_value, "cols_border",
+          cols_bytes, pitch, height, 0, pitch, y0, y1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline bool OpenCLSeperableConv::RunDirect2D(cl_mem input_buf, cl_mem output_buf,
+  cl_mem weights_buf, int width, int height, int channels, int k_w, int k_h) {
+  const cl_int pitch = width * channels;
+  const cl_int x0 = std::min(k_w / 2, width);
+  const cl_int x1 = std::max(width - (k_w - 1 - k_w / 2), x0);
+  const cl_int y0 = std::min(k_h / 2, height);
+  const cl_int y1 = std::max(height - (k_h - 1 - k_h / 2), y0);
+  const size_t pixel_bytes = 2 * sizeof(uchar) * channels;
+
+  // the interior and the border kernel share the first eight arguments
+  for (cl_kernel kernel : {kernel_2d_, kernel_2d_border_}) {
+    cl_int err;
+    int arg_index = 0;
+    err  = clSetKernelArg(kernel, arg_index++, sizeof(cl_mem), &input_buf);
+    err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_mem), &output_buf);
+    err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_mem), &weights_buf);
+    err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_int), &width);
+    err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_int), &height);
+    err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_int), &pitch);
+    err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_int), &k_w);
+    err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_int), &k_h);
+    if (err != CL_SUCCESS) {
+      std::cerr << "clSetKernelArg conv2d failed return " << err << std::endl;
+      return false;
+    }
+  }
+
+  if (x1 > x0 && y1 > y0 && !EnqueueSimple(queue_, kernel_2d_, x1 - x0, y1 - y0,
+        "conv2d", (size_t)(x1 - x0) * (y1 - y0) * pixel_bytes, x0, y0)) {
+    return false;
+  }
+  return EnqueueBorder(queue_, kernel_2d_border_, 8, border_value_, "conv2d_border",
+    pixel_bytes, width, height, x0, x1, y0, y1);
+}
+
+inline void OpenCLSeperableConv::SetLowRankLimits(int max_rank, float tolerance) {
+  lowrank_max_rank_ = max_rank;
+  lowrank_tolerance_ = tolerance;
+  // decompose again on the next Run2D
+  lowrank_source_.release();
+}
+
+inline int OpenCLSeperableConv::LastRank() const { return last_rank_; }
+
+inline void OpenCLSeperableConv::SetLocalWorkSize(size_t x, size_t y) {
+  local_size_[0] = x;
+  local_size_[1] = y;
+}
+
+inline void OpenCLSeperableConv::SetTuningDatabase(std::shared_ptr<TuningDatabase> database) {
+  tuning_db_ = std::move(database);
+  tuned_key_[0] = tuned_key_[1] = tuned_key_[2] = tuned_key_[3] = 0;
+}
+
+inline TuningKey OpenCLSeperableConv::MakeTuningKey(int width, int height,
+  int channels, int radius) const {
+  TuningKey key;
+  const DeviceInfo& info = runtime_->deviceInfo();
+  key.device = info.name + "|" + info.driver_version;
+  key.kernel = "gaussian_blur_seperate";
+  key.width = width;
+  key.height = height;
+  key.radius = radius;
+  key.channels = channels;
+  return key;
+}
+
+inline void OpenCLSeperableConv::ApplyTuning(int width, int height, int channels, int radius) {
+  const int key[4] = {width, height, channels, radius};
+  if (std::memcmp(key, tuned_key_, sizeof(key)) == 0) return;
+  std::memcpy(tuned_key_, key, sizeof(key));
+
+  TuningResult result;
+  if (tuning_db_->find(MakeTuningKey(width, height, channels, radius), &result) &&
+      ApplyTuningParams(result.params)) {
+    return;
+  }
+  Autotune(width, height, channels, radius);
+}
+
+// params: variant, local x, local y, pack rgba, rows block x, rows block y,
+// cols block x, cols block y
+inline bool OpenCLSeperableConv::ApplyTuningParams(const std::vector<int>& params) {
+  if (params.size() != 8) return false;
+  variant_ = static_cast<KernelVariant>(params[0]);
+  SetLocalWorkSize(params[1], params[2]);
+  pack_rgba_ = params[3] != 0;
+  if (tile_config_.rows_block_x != params[4] || tile_config_.rows_block_y != params[5] ||
+      tile_config_.cols_block_x != params[6] || tile_config_.cols_block_y != params[7]) {
+    TileConfig config = tile_config_;
+    config.rows_block_x = params[4];
+    config.rows_block_y = params[5];
+    config.cols_block_x = params[6];
+    config.cols_block_y = params[7];
+    return SetTileConfig(config);
+  }
+  return true;
+}
+
+inline bool OpenCLSeperableConv::Autotune(int width, int height, int channels, int radius) {
+  if (!valid_) return false;
+  const DeviceInfo& info = runtime_->deviceInfo();
+  const TileConfig base = tile_config_;
+
+  std::vector<std::vector<int>> candidates;
+  auto add = [&](KernelVariant variant, int lx, int ly, bool pack, int rbx, int rby,
+                 int cbx, int cby) {
+    const size_t max_wg = info.max_work_group_size;
+    if (max_wg && (size_t)lx * ly > max_wg) return;
+    // the tiled work-groups are the tile shapes, FitTileConfig would shrink
+    // an oversized one and the database would record a shape that never ran
+    if (max_wg && variant == KernelVariant::kTiled &&
+        ((size_t)rbx * rby > max_wg || (size_t)cbx * cby > max_wg)) return;
+    candidates.push_back({(int)variant, lx, ly, pack ? 1 : 0, rbx, rby, cbx, cby});
+  };
+
+  // naive passes under every local shape, scalar and uchar4 loads for 3
+  // channel input
+  const int local_shapes[][2] = {{0, 0}, {16, 4}, {32, 4}, {32, 8}, {64, 2},
+                                 {64, 4}, {16, 16}, {128, 1}, {256, 1}};
+  for (int pack = 0; pack <= (channels == 3 ? 1 : 0); ++pack) {
+    for (const auto& local : local_shapes) {
+      add(KernelVariant::kNaive, local[0], local[1], pack != 0, base.rows_block_x,
+          base.rows_block_y, base.cols_block_x, base.cols_block_y);
+    }
+  }
+  // tiled shapes, each one is a rebuild with other -D options
+  if (radius <= base.max_radius && channels == 3) {
+    const int tile_shapes[][4] = {{16, 4, 16, 8}, {32, 4, 32, 8}, {32, 8, 32, 8},
+                                  {64, 4, 64, 4}, {16, 16, 16, 16}, {8, 8, 8, 8}};
+    for (const auto& tile : tile_shapes) {
+      add(KernelVariant::kTiled, 0, 0, false, tile[0], tile[1], tile[2], tile[3]);
+    }
+    add(KernelVariant::kFused, 0, 0, false, base.rows_block_x, base.rows_block_y,
+        base.cols_block_x, base.cols_block_y);
+  }
+
+  cv::Mat input(height, width, CV_8UC(channels));
+  cv::randu(input, cv::Scalar::all(0), cv::Scalar::all(255));
+  const std::vector<float> kernel = gaussianKernel1D(std::max(radius / 3.0f, 0.5f), radius);
+
+  tuning_ = true;
+  // the candidates would otherwise show up in the profile
+  std::shared_ptr<Profiler> profiler = std::move(profiler_);
+  std::vector<int> best;
+  double best_ms = 0.0;
+  cv::Mat output;
+  for (const std::vector<int>& candidate : candidates) {
+    if (!ApplyTuningParams(candidate)) continue;
+    // shrunk to fit local memory, this is not the candidate any more
+    if (tile_config_.rows_block_x != candidate[4] || tile_config_.rows_block_y != candidate[5] ||
+        tile_config_.cols_block_x != candidate[6] || tile_config_.cols_block_y != candidate[7]) {
+      continue;
+    }
+    if (!Run(input, kernel, output)) continue;
+    // fastest of a few runs, the first one above absorbed any warm-up
+    double ms = 0.0;
+    bool ok = true;
+    for (int i = 0; i < 3 && ok; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      ok = Run(input, kernel, output);
+      const double run_ms = std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start).count();
+      ms = i == 0 ? run_ms : std::min(ms, run_ms);
+    }
+    if (ok && (best.empty() || ms < best_ms)) {
+      best = candidate;
+      best_ms = ms;
+    }
+  }
+  tuning_ = false;
+  profiler_ = std::move(profiler);
+
+  if (best.empty()) {
+    std::cerr << "Autotune found no working configuration" << std::endl;
+    ApplyTuningParams({(int)KernelVariant::kNaive, 0, 0, 0, base.rows_block_x,
+                       base.rows_block_y, base.cols_block_x, base.cols_block_y});
+    return false;
+  }
+  ApplyTuningParams(best);
+  if (tuning_db_) {
+    TuningResult result;
+    result.params = best;
+    result.ms = best_ms;
+    tuning_db_->store(MakeTuningKey(width, height, channels, radius), result);
+    tuning_db_->save();
+  }
+  return true;
+}
+
+inline bool OpenCLSeperableConv::RunBatch(const std::vector<cv::Mat>& inputs,
+  const std::vector<float>& kernel, std::vector<cv::Mat>& outputs) {
+  outputs.resize(inputs.size());
+  if (inputs.empty()) return true;
+  if (!kernel_rows_batch_ || !kernel_cols_batch_) {
+    std::cerr << "batch kernels are not built" << std::endl;
+    return false;
+  }
+
+  // (element offset, width, height, first pixel index) per image, the
+  // kernels binary search the last column
+  std::vector<cl_int4> table(inputs.size());
+  size_t total_bytes = 0;
+  size_t total_pixels = 0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    CV_Assert(inputs[i].type() == CV_8UC3);
+    table[i].s[0] = (cl_int)total_bytes;
+    table[i].s[1] = inputs[i].cols;
+    table[i].s[2] = inputs[i].rows;
+    table[i].s[3] = (cl_int)total_pixels;
+    total_bytes += inputs[i].total() * inputs[i].elemSize();
+    total_pixels += inputs[i].total();
+  }
+
+  cl_mem input_buf = buffer_pool_.acquire("batch_input", total_bytes, CL_MEM_READ_ONLY);
+  cl_mem temp_buf = buffer_pool_.acquire("batch_temp",
+    total_bytes * IntermediateElementSize(), CL_MEM_READ_WRITE);
+  cl_mem output_buf = buffer_pool_.acquire("batch_output", total_bytes, CL_MEM_WRITE_ONLY);
+  cl_mem table_buf = buffer_pool_.acquire("batch_table",
+    table.size() * sizeof(cl_int4), CL_MEM_READ_ONLY);
+  cl_mem kernel_buf = buffer_pool_.acquire("kernel",
+    kernel.size() * sizeof(float), CL_MEM_READ_ONLY);
+  if (!input_buf || !temp_buf || !output_buf || !table_buf || !kernel_buf) {
+    std::cerr << "acquire batch buffers failed" << std::endl;
     return false;
   }
 
-  cl_mem temp_buf = clCreateBuffer(context_, 
-    CL_MEM_READ_WRITE, image_size * sizeof(uchar), nullptr, &err);
+  // pack straight into the mapped upload buffer
+  cl_int err = CL_SUCCESS;
+  uchar* staging = (uchar*)clEnqueueMapBuffer(queue_, input_buf, CL_TRUE,
+    CL_MAP_WRITE_INVALIDATE_REGION, 0, total_bytes, 0, nullptr, nullptr, &err);
   if (err != CL_SUCCESS) {
-    std::cerr << "clCreateBuffer temp buffer failed return " << err << std::endl;
+    std::cerr << "clEnqueueMapBuffer batch input failed return " << err << std::endl;
     return false;
   }
+  for (size_t i = 0; i < inputs.size(); i++) {
+    cv::Mat packed(inputs[i].rows, inputs[i].cols, CV_8UC3, staging + table[i].s[0]);
+    inputs[i].copyTo(packed);
+  }
+  clEnqueueUnmapMemObject(queue_, input_buf, staging, 0, nullptr, ProfileEvent());
+  Profile("upload", total_bytes);
 
-  cl_mem output_buf = clCreateBuffer(context_,
-    CL_MEM_WRITE_ONLY,
-    image_size * sizeof(uchar),
-    nullptr, &err
-  );
+  err = clEnqueueWriteBuffer(queue_, table_buf, CL_FALSE, 0,
+    table.size() * sizeof(cl_int4), table.data(), 0, nullptr, nullptr);
+  err |= clEnqueueWriteBuffer(queue_, kernel_buf, CL_FALSE, 0,
+    kernel.size() * sizeof(float), kernel.data(), 0, nullptr, ProfileEvent());
+  Profile("weights", kernel.size() * sizeof(float));
   if (err != CL_SUCCESS) {
-    std::cerr << "clCreateBuffer output_buf failed return " << err << std::endl;
+    std::cerr << "clEnqueueWriteBuffer batch table failed return " << err << std::endl;
     return false;
   }
 
-  cl_mem kernel_buf = clCreateBuffer(
-    context_,
-    CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-    kernel.size() * sizeof(float),
-    (void*)kernel.data(), &err
-  );
+  const cl_int num_images = (cl_int)inputs.size();
+  const cl_int pixels = (cl_int)total_pixels;
+  const cl_int k = (cl_int)kernel.size();
+  const size_t global = RoundUp(total_pixels, 64);
+  cl_mem passes[2][2] = {{input_buf, temp_buf}, {temp_buf, output_buf}};
+  cl_kernel kernels[2] = {kernel_rows_batch_, kernel_cols_batch_};
+  const char* stages[2] = {"rows", "cols"};
+  for (int pass = 0; pass < 2; pass++) {
+    int arg_index = 0;
+    err  = clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_mem), &passes[pass][0]);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_mem), &passes[pass][1]);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_mem), &kernel_buf);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_mem), &table_buf);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_int), &num_images);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_int), &pixels);
+    err |= clSetKernelArg(kernels[pass], arg_index++, sizeof(cl_int), &k);
+    if (err != CL_SUCCESS) {
+      std::cerr << "RunKernel failed" << std::endl;
+      return false;
+    }
+    err = clEnqueueNDRangeKernel(queue_, kernels[pass], 1, nullptr, &global, nullptr,
+                                 0, nullptr, ProfileEvent());
+    if (err != CL_SUCCESS) {
+      std::cerr << "clEnqueueNDRangeKernel failed return " << err << std::endl;
+      return false;
+    }
+    Profile(stages[pass], total_bytes * (sizeof(uchar) + IntermediateElementSize()));
+  }
+
+  const uchar* result = (const uchar*)clEnqueueMapBuffer(queue_, output_buf, CL_TRUE,
+    CL_MAP_READ, 0, total_bytes, 0, nullptr, ProfileEvent(), &err);
   if (err != CL_SUCCESS) {
-    std::cerr << "clCreateBuffer kernel_buf failed return " << err << std::endl;
+    std::cerr << "clEnqueueMapBuffer batch output failed return " << err << std::endl;
     return false;
   }
+  Profile("download", total_bytes);
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (!outputs[i].u) outputs[i].release();
+    cv::Mat packed(inputs[i].rows, inputs[i].cols, CV_8UC3,
+                   (void*)(result + table[i].s[0]));
+    packed.copyTo(outputs[i]);
+  }
+  clEnqueueUnmapMemObject(queue_, output_buf, (void*)result, 0, nullptr, nullptr);
+  clFinish(queue_);
+  return true;
+}
+
+inline bool OpenCLSeperableConv::RunOnDevice(const cv::Mat& input, const std::vector<float>& kernel, cv::Mat& output) {
+  const int width = input.cols;
+  const int height = input.rows;
+  const int channels = input.channels();
+  const size_t image_size = width * height * channels;
 
-  uchar k_w = kernel.size();
-  uchar k_h = kernel.size();
+  CV_Assert(input.depth() == CV_8U);
+  CV_Assert(channels == 3 || channels == 4);
 
-  RunConvolutionRows(
-    queue_,
-    input_buf, temp_buf, kernel_buf,
-    width, height, width * channels,
-    k_w
-  );
+  // the previous zero-copy result is about to be overwritten
+  UnmapOutput();
 
-  RunConvolutionCols(
-    queue_,
-    temp_buf, output_buf, kernel_buf,
-    width, height, width * channels,
-    k_h
-  );
+  // a failed build leaves the generic passes in charge
+  if (variant_ == KernelVariant::kSpecialized) Specialize(kernel, channels);
+  if (variant_ == KernelVariant::kFolded || variant_ == KernelVariant::kFixedPoint) {
+    Fold(kernel);
+  }
+
+  // buffers are reused across frames of the same geometry, only a
+  // resolution change reallocates them
+  cl_mem input_buf = nullptr;
+  if (!UploadInput(input, image_size, &input_buf)) {
+    return false;
+  }
+  // the fused kernel keeps the intermediate rows in local memory
+  const bool needs_temp = NeedsTempBuffer(channels, (int)kernel.size());
+  cl_mem temp_buf = !needs_temp ? nullptr : buffer_pool_.acquire("temp",
+    image_size * IntermediateElementSize(), CL_MEM_READ_WRITE);
+  cl_mem output_buf = memory_mode_ == MemoryMode::kZeroCopy
+    ? buffer_pool_.acquire("output", image_size * sizeof(uchar),
+        CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR)
+    : buffer_pool_.acquire("output", image_size * sizeof(uchar),
+        CL_MEM_WRITE_ONLY);
+  cl_mem kernel_buf = buffer_pool_.acquire("kernel",
+    kernel.size() * sizeof(float), CL_MEM_READ_ONLY);
+  if ((!temp_buf && needs_temp) || !output_buf || !kernel_buf) {
+    std::cerr << "acquire device buffers failed" << std::endl;
+    return false;
+  }
+
+  cl_int err = clEnqueueWriteBuffer(queue_, kernel_buf, CL_FALSE, 0,
+    kernel.size() * sizeof(float), kernel.data(), 0, nullptr, ProfileEvent());
+  if (err != CL_SUCCESS) {
+    std::cerr << "clEnqueueWriteBuffer failed return " << err << std::endl;
+    return false;
+  }
+  Profile("weights", kernel.size() * sizeof(float));
+
+  if (!EnqueueBlur(queue_, input_buf, temp_buf, output_buf, kernel_buf,
+                   width, height, channels, (cl_uint)kernel.size())) {
+    return false;
+  }
 
   clFinish(queue_);
 
-  std::vector<uchar> output_host(image_size);
+  return DownloadOutput(output_buf, width, height, input.type(), image_size, output);
+}
+
+inline bool OpenCLSeperableConv::UploadInput(const cv::Mat& input,
+  size_t image_size, cl_mem* input_buf) {
+  cl_int err = CL_SUCCESS;
+  if (memory_mode_ == MemoryMode::kCopy) {
+    *input_buf = buffer_pool_.acquire("input",
+      image_size * sizeof(uchar), CL_MEM_READ_ONLY);
+    if (!*input_buf) return false;
+    err = clEnqueueWriteBuffer(queue_, *input_buf, CL_FALSE, 0,
+      image_size * sizeof(uchar), input.data, 0, nullptr, ProfileEvent());
+    if (err != CL_SUCCESS) {
+      std::cerr << "clEnqueueWriteBuffer input failed return " << err << std::endl;
+      return false;
+    }
+    Profile("upload", image_size * sizeof(uchar));
+    return true;
+  }
+
+  // page aligned and continuous storage can be handed to the device as is
+  if (input.isContinuous() &&
+      reinterpret_cast<uintptr_t>(input.data) % kPageSize == 0) {
+    *input_buf = buffer_pool_.acquire("input",
+      image_size * sizeof(uchar), CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+      (void*)input.data);
+    if (!*input_buf) return false;
+    // the pooled buffer outlives the frame, the caller may have written new
+    // pixels into the same storage. A map/unmap pair hands ownership back to
+    // the device so a copy cached in device memory gets refreshed, invalidate
+    // keeps the map from copying the stale one over the new frame
+    void* mapped = clEnqueueMapBuffer(queue_, *input_buf, CL_FALSE,
+      CL_MAP_WRITE_INVALIDATE_REGION, 0, image_size * sizeof(uchar),
+      0, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS) {
+      std::cerr << "clEnqueueMapBuffer input failed return " << err << std::endl;
+      return false;
+    }
+    err = clEnqueueUnmapMemObject(queue_, *input_buf, mapped, 0, nullptr, nullptr);
+    if (err != CL_SUCCESS) {
+      std::cerr << "clEnqueueUnmapMemObject input failed return " << err << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // otherwise stage through host-visible device memory, one copy instead of two
+  *input_buf = buffer_pool_.acquire("input",
+    image_size * sizeof(uchar), CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR);
+  if (!*input_buf) return false;
+  void* staging = clEnqueueMapBuffer(queue_, *input_buf, CL_TRUE,
+    CL_MAP_WRITE_INVALIDATE_REGION, 0, image_size * sizeof(uchar),
+    0, nullptr, nullptr, &err);
+  if (err != CL_SUCCESS) {
+    std::cerr << "clEnqueueMapBuffer input failed return " << err << std::endl;
+    return false;
+  }
+  const size_t row_bytes = input.cols * input.elemSize();
+  for (int y = 0; y < input.rows; ++y) {
+    std::memcpy(static_cast<uchar*>(staging) + y * row_bytes, input.ptr(y), row_bytes);
+  }
+  err = clEnqueueUnmapMemObject(queue_, *input_buf, staging, 0, nullptr, ProfileEvent());
+  if (err != CL_SUCCESS) {
+    std::cerr << "clEnqueueUnmapMemObject input failed return " << err << std::endl;
+    return false;
+  }
+  Profile("upload", image_size * sizeof(uchar));
+  return true;
+}
+
+inline bool OpenCLSeperableConv::DownloadOutput(cl_mem output_buf,
+  int width, int height, int type, size_t image_size, cv::Mat& output) {
+  cl_int err = CL_SUCCESS;
+  if (memory_mode_ == MemoryMode::kZeroCopy) {
+    void* mapped = clEnqueueMapBuffer(queue_, output_buf, CL_TRUE, CL_MAP_READ,
+      0, image_size * sizeof(uchar), 0, nullptr, ProfileEvent(), &err);
+    if (err != CL_SUCCESS) {
+      std::cerr << "clEnqueueMapBuffer output failed return " << err << std::endl;
+      return false;
+    }
+    Profile("download", image_size * sizeof(uchar));
+    mapped_output_buf_ = output_buf;
+    mapped_output_ = mapped;
+    output = cv::Mat(height, width, type, mapped);
+    return true;
+  }
+
+  // a Mat left over from zero-copy mode wraps memory it does not own
+  if (!output.u) output.release();
+  output.create(height, width, type);
   err = clEnqueueReadBuffer(
     queue_,
     output_buf,
     CL_TRUE,
     0,
-    image_size * sizeof(uchar), output_host.data(),
-    0, nullptr, nullptr
+    image_size * sizeof(uchar), output.data,
+    0, nullptr, ProfileEvent()
   );
 
   if (err != CL_SUCCESS) {
-    clReleaseMemObject(input_buf);
-    clReleaseMemObject(temp_buf);
-    clReleaseMemObject(output_buf);
-    clReleaseMemObject(kernel_buf);
     std::cerr << "clEnqueueReadBuffer failed return " << err << std::endl;
+    return false;
   }
-
-  output = cv::Mat(height, width, CV_8UC3, output_host.data()).clone();
-  clReleaseMemObject(input_buf);
-  clReleaseMemObject(temp_buf);
-  clReleaseMemObject(output_buf);
-  clReleaseMemObject(kernel_buf);
+  Profile("download", image_size * sizeof(uchar));
   return true;
 }
 
+inline void OpenCLSeperableConv::UnmapOutput() {
+  if (!mapped_output_) return;
+  clEnqueueUnmapMemObject(queue_, mapped_output_buf_, mapped_output_, 0, nullptr, nullptr);
+  clFinish(queue_);
+  mapped_output_buf_ = nullptr;
+  mapped_output_ = nullptr;
+}
+
+inline void OpenCLSeperableConv::SetMemoryMode(MemoryMode mode) {
+  if (mode == memory_mode_) return;
+  // pooled buffers were created with flags of the previous mode
+  ReleaseBuffers();
+  memory_mode_ = mode;
+}
+
+inline MemoryMode OpenCLSeperableConv::GetMemoryMode() const { return memory_mode_; }
+
+inline void OpenCLSeperableConv::SetKernelVariant(KernelVariant variant) {
+  variant_ = variant;
+}
+
+inline KernelVariant OpenCLSeperableConv::GetKernelVariant() const { return variant_; }
+
+inline bool OpenCLSeperableConv::SetTileConfig(const TileConfig& config) {
+  tile_config_ = config;
+  if (!context_) return true;  // picked up by Init
+  return BuildKernels();
+}
+
+inline void OpenCLSeperableConv::SetPackRGBA(bool enable) { pack_rgba_ = enable; }
+
+inline bool OpenCLSeperableConv::GetPackRGBA() const { return pack_rgba_; }
+
+inline bool OpenCLSeperableConv::SetIntermediateFormat(IntermediateFormat format) {
+  if (format == temp_format_) return true;
+  temp_format_ = format;
+  if (!context_) return true;
+  return BuildKernels();
+}
+
+inline IntermediateFormat OpenCLSeperableConv::GetIntermediateFormat() const {
+  return temp_format_;
+}
+
+inline size_t OpenCLSeperableConv::IntermediateElementSize() const {
+  // the Q8.8 intermediate of kFixedPoint, big enough for its fallback too
+  const size_t fixed_point = variant_ == KernelVariant::kFixedPoint ? sizeof(cl_ushort) : 0;
+  switch (temp_format_) {
+    case IntermediateFormat::kHalf: return std::max(sizeof(cl_half), fixed_point);
+    case IntermediateFormat::kFloat: return sizeof(cl_float);
+    default: return std::max(sizeof(uchar), fixed_point);
+  }
+}
+
+inline cv::Mat OpenCLSeperableConv::AllocatePageAligned(int rows, int cols, int type) {
+  const size_t bytes = (size_t)rows * cols * CV_ELEM_SIZE(type);
+  // over-allocate and take an aligned view, the view shares the refcount
+  cv::Mat raw(1, (int)(bytes + kPageSize), CV_8U);
+  size_t offset = (kPageSize - reinterpret_cast<uintptr_t>(raw.data) % kPageSize) % kPageSize;
+  return raw.colRange((int)offset, (int)(offset + bytes)).reshape(CV_MAT_CN(type), rows);
+}
+
+inline void OpenCLSeperableConv::ReleaseBuffers() {
+  UnmapOutput();
+  buffer_pool_.clear();
+  ReleaseImages();
+}
+
+inline size_t OpenCLSeperableConv::BufferAllocationCount() const {
+  return buffer_pool_.allocationCount();
+}
+
+inline std::shared_ptr<OpenCLRuntime> OpenCLSeperableConv::Runtime() const { return runtime_; }
+
 inline bool OpenCLSeperableConv::IsValid() const { return valid_; }
 
+inline cl_context OpenCLSeperableConv::Context() const { return context_; }
+
+inline cl_device_id OpenCLSeperableConv::Device() const { return device_; }
+
 } // namespace kumo
\ No newline at end of file
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "OpenCLConvolution.hpp"
+#include "OpenCLEvent.h"
+#include <CL/cl.h>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace kumo {
+
+// Streams video frames through OpenCLSeperableConv with up to depth frames
+// in flight. Upload, blur and download go to three in-order queues and are
+// chained with events, so frame k+1 uploads while frame k blurs and frame
+// k-1 downloads. Every slot owns its device buffers and a page-aligned host
+// output, nothing is allocated per frame once Init has run.
+//
+//   stream.Init(1920, 1080, CV_8UC3, kernel);
+//   for each frame:
+//     if (stream.InFlight() == stream.Depth()) stream.Pop(out);
+//     stream.Push(frame);
+//   while (stream.InFlight()) stream.Pop(out);
+class OpenCLFrameStream {
+public:
+  explicit OpenCLFrameStream(OpenCLSeperableConv& conv, int depth = 3);
+  ~OpenCLFrameStream();
+
+  bool Init(int width, int height, int type, const std::vector<float>& kernel);
+  void UnInit();
+
+  // Enqueues the frame and returns without waiting. The frame is uploaded
+  // asynchronously, its pixels must stay untouched until it is popped.
+  // Fails when all slots are in flight.
+  bool Push(const cv::Mat& frame);
+  // Blocks until the oldest frame is blurred. The result is swapped into
+  // output, the Mat passed in becomes the download target of a later frame.
+  bool Pop(cv::Mat& output);
+
+  int InFlight() const;
+  int Depth() const;
+
+private:
+  struct Slot {
+    cl_mem input = nullptr;
+    cl_mem temp = nullptr;
+    cl_mem output = nullptr;
+    cv::Mat host_input;
+    cv::Mat host_output;
+    Event downloaded;
+  };
+
+  bool CreateQueue(cl_command_queue* queue);
+
+  OpenCLSeperableConv& conv_;
+  int depth_;
+  int width_ = 0;
+  int height_ = 0;
+  int type_ = 0;
+  size_t image_size_ = 0;
+  cl_uint kernel_size_ = 0;
+  cl_command_queue upload_queue_ = nullptr;
+  cl_command_queue compute_queue_ = nullptr;
+  cl_command_queue download_queue_ = nullptr;
+  cl_mem kernel_buf_ = nullptr;
+  std::vector<Slot> slots_;
+  int head_ = 0;
+  int tail_ = 0;
+  int in_flight_ = 0;
+};
+
+inline OpenCLFrameStream::OpenCLFrameStream(OpenCLSeperableConv& conv, int depth)
+  : conv_(conv), depth_(depth < 1 ? 1 : depth) {}
+
+inline OpenCLFrameStream::~OpenCLFrameStream() { UnInit(); }
+
+inline bool OpenCLFrameStream::CreateQueue(cl_command_queue* queue) {
+  cl_int err = CL_SUCCESS;
+  // profiling enabled like the runtime queue, a profiler set on the conv
+  // sees the stream's commands too
+#if CL_TARGET_OPENCL_VERSION >= 200
+  cl_queue_properties props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+  *queue = clCreateCommandQueueWithProperties(conv_.Context(), conv_.Device(), props, &err);
+#else
+  *queue = clCreateCommandQueue(conv_.Context(), conv_.Device(),
+                                CL_QUEUE_PROFILING_ENABLE, &err);
+#endif
+  if (!*queue || err != CL_SUCCESS) {
+    std::cerr << "clCreateCommandQueue failed error return " << err << std::endl;
+    *queue = nullptr;
+    return false;
+  }
+  return true;
+}
+
+inline bool OpenCLFrameStream::Init(int width, int height, int type,
+                                    const std::vector<float>& kernel) {
+  UnInit();
+  if (!conv_.IsValid()) {
+    std::cerr << "OpenCLSeperableConv is not initialized" << std::endl;
+    return false;
+  }
+  CV_Assert(CV_MAT_DEPTH(type) == CV_8U);
+  CV_Assert(CV_MAT_CN(type) == 3 || CV_MAT_CN(type) == 4);
+
+  width_ = width;
+  height_ = height;
+  type_ = type;
+  image_size_ = (size_t)width * height * CV_MAT_CN(type);
+  kernel_size_ = (cl_uint)kernel.size();
+
+  if (!CreateQueue(&upload_queue_) || !CreateQueue(&compute_queue_) ||
+      !CreateQueue(&download_queue_)) {
+    UnInit();
+    return false;
+  }
+
+  cl_int err = CL_SUCCESS;
+  kernel_buf_ = clCreateBuffer(conv_.Context(), CL_MEM_READ_ONLY,
+    kernel.size() * sizeof(float), nullptr, &err);
+  if (err != CL_SUCCESS) {
+    std::cerr << "clCreateBuffer kernel failed error return " << err << std::endl;
+    UnInit();
+    return false;
+  }
+  err = clEnqueueWriteBuffer(upload_queue_, kernel_buf_, CL_TRUE, 0,
+    kernel.size() * sizeof(float), kernel.data(), 0, nullptr, nullptr);
+  if (err != CL_SUCCESS) {
+    std::cerr << "clEnqueueWriteBuffer kernel failed error return " << err << std::endl;
+    UnInit();
+    return false;
+  }
+
+  const KernelVariant variant = conv_.GetKernelVariant();
+  if (variant == KernelVariant::kSpecialized) {
+    conv_.Specialize(kernel, CV_MAT_CN(type));
+  } else if (variant == KernelVariant::kFolded || variant == KernelVariant::kFixedPoint) {
+    conv_.Fold(kernel);
+  }
+
+  const bool needs_temp = conv_.NeedsTempBuffer(CV_MAT_CN(type), (int)kernel.size());
+  slots_.resize(depth_);
+  for (Slot& slot : slots_) {
+    slot.input = clCreateBuffer(conv_.Context(), CL_MEM_READ_ONLY,
+      image_size_, nullptr, &err);
+    if (err == CL_SUCCESS && needs_temp) {
+      slot.temp = clCreateBuffer(conv_.Context(), CL_MEM_READ_WRITE,
+        image_size_ * conv_.IntermediateElementSize(), nullptr, &err);
+    }
+    if (err == CL_SUCCESS) {
+      slot.output = clCreateBuffer(conv_.Context(), CL_MEM_WRITE_ONLY,
+        image_size_, nullptr, &err);
+    }
+    if (err != CL_SUCCESS) {
+      std::cerr << "clCreateBuffer slot failed error return " << err << std::endl;
+      UnInit();
+      return false;
+    }
+    slot.host_output = OpenCLSeperableConv::AllocatePageAligned(height, width, type);
+  }
+  return true;
+}
+
+inline void OpenCLFrameStream::UnInit() {
+  // finish whatever is still in flight before the buffers go away
+  for (Slot& slot : slots_) {
+    slot.downloaded.wait();
+    if (slot.input) clReleaseMemObject(slot.input);
+    if (slot.temp) clReleaseMemObject(slot.temp);
+    if (slot.output) clReleaseMemObject(slot.output);
+  }
+  slots_.clear();
+  head_ = tail_ = in_flight_ = 0;
+
+  if (kernel_buf_) clReleaseMemObject(kernel_buf_);
+  if (upload_queue_) clReleaseCommandQueue(upload_queue_);
+  if (compute_queue_) clReleaseCommandQueue(compute_queue_);
+  if (download_queue_) clReleaseCommandQueue(download_queue_);
+  kernel_buf_ = nullptr;
+  upload_queue_ = nullptr;
+  compute_queue_ = nullptr;
+  download_queue_ = nullptr;
+}
+
+inline bool OpenCLFrameStream::Push(const cv::Mat& frame) {
+  if (slots_.empty() || in_flight_ == depth_) return false;
+  CV_Assert(frame.rows == height_ && frame.cols == width_ && frame.type() == type_);
+
+  Slot& slot = slots_[head_];
+  // the previous frame of this slot was popped, its buffers are free again
+  slot.host_input = frame.isContinuous() ? frame : frame.clone();
+  slot.host_output.create(height_, width_, type_);
+
+  cl_event uploaded = nullptr;
+  cl_int err = clEnqueueWriteBuffer(upload_queue_, slot.input, CL_FALSE, 0,
+    image_size_, slot.host_input.data, 0, nullptr, &uploaded);
+  if (err != CL_SUCCESS) {
+    std::cerr << "clEnqueueWriteBuffer frame failed error return " << err << std::endl;
+    return false;
+  }
+  Event upload_done(uploaded);
+  const std::shared_ptr<Profiler>& profiler = conv_.GetProfiler();
+  if (profiler) {
+    // the profiler takes a reference of its own
+    clRetainEvent(uploaded);
+    profiler->record("upload", uploaded, image_size_);
+  }
+
+  cl_event blurred = nullptr;
+  if (!conv_.EnqueueBlur(compute_queue_, slot.input, slot.temp, slot.output,
+                         kernel_buf_, width_, height_, CV_MAT_CN(type_),
+                         kernel_size_, 1, &uploaded, &blurred)) {
+    return false;
+  }
+  Event blur_done(blurred);
+
+  cl_event downloaded = nullptr;
+  err = clEnqueueReadBuffer(download_queue_, slot.output, CL_FALSE, 0,
+    image_size_, slot.host_output.data, 1, &blurred, &downloaded);
+  if (err != CL_SUCCESS) {
+    std::cerr << "clEnqueueReadBuffer frame failed error return " << err << std::endl;
+    return false;
+  }
+  slot.downloaded = Event(downloaded);
+  if (profiler) {
+    clRetainEvent(downloaded);
+    profiler->record("download", downloaded, image_size_);
+  }
+
+  // submit now, the stages of different frames overlap on the device
+  clFlush(upload_queue_);
+  clFlush(compute_queue_);
+  clFlush(download_queue_);
+
+  head_ = (head_ + 1) % depth_;
+  ++in_flight_;
+  return true;
+}
+
+inline bool OpenCLFrameStream::Pop(cv::Mat& output) {
+  if (in_flight_ == 0) return false;
+
+  Slot& slot = slots_[tail_];
+  tail_ = (tail_ + 1) % depth_;
+  --in_flight_;
+  if (!slot.downloaded.wait()) {
+    std::cerr << "frame download failed" << std::endl;
+    return false;
+  }
+  slot.host_input.release();
+  // a Mat left over from zero-copy mode wraps memory it does not own
+  if (!output.u) output.release();
+  cv::swap(slot.host_output, output);
+  return true;
+}
+
+inline int OpenCLFrameStream::InFlight() const { return in_flight_; }
+
+inline int OpenCLFrameStream::Depth() const { return depth_; }
+
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include "DeviceSelector.h"
+#include "OpenCLConvolution.hpp"
+#include "OpenCLRuntime.h"
+#include "ThreadPool.h"
+#include <CL/cl.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace kumo {
+
+// Splits an image into horizontal bands and blurs each band on its own
+// device and queue. Every band carries radius apron rows from its
+// neighbours, so the stitched result matches a single-device run. Band
+// heights follow the rows per millisecond each device achieved on earlier
+// frames; before the first frame the split is by compute units, and a
+// device that has not run a band yet keeps its compute unit share, scaled
+// to the rate per compute unit of the timed devices.
+class OpenCLMultiDeviceConv {
+public:
+  OpenCLMultiDeviceConv() = default;
+  ~OpenCLMultiDeviceConv() { UnInit(); }
+
+  // Opens every device matching selector. With sub_device_units > 0 each
+  // device that supports it is partitioned into sub-devices of that many
+  // compute units first, e.g. one per socket of a POCL CPU device.
+  bool Init(const DeviceSelector& selector, cl_uint sub_device_units = 0);
+  void UnInit();
+
+  bool Run(const cv::Mat& input, const std::vector<float>& kernel, cv::Mat& output);
+
+  size_t DeviceCount() const;
+  const DeviceInfo& GetDeviceInfo(size_t index) const;
+  // Fraction of the last frame's rows assigned to each device.
+  std::vector<double> GetSplit() const;
+  void SetKernelVariant(KernelVariant variant);
+
+private:
+  struct Band {
+    int y0;      // first output row
+    int rows;    // output rows
+    int apron_top;
+    int apron_bottom;
+  };
+
+  std::vector<Band> SplitRows(int height, int radius) const;
+  // compute unit share of a device that has not been timed yet
+  double UntimedRate(size_t index, double rate_per_unit) const;
+
+  std::vector<std::shared_ptr<OpenCLRuntime>> runtimes_;
+  std::vector<std::unique_ptr<OpenCLSeperableConv>> convs_;
+  std::vector<cl_device_id> sub_devices_;
+  std::vector<double> rows_per_ms_;
+  std::vector<char> timed_;  // rows_per_ms_ holds a measured rate
+  std::vector<double> last_split_;
+  std::unique_ptr<ThreadPool> pool_;
+  std::vector<cv::Mat> band_outputs_;
+};
+
+inline bool OpenCLMultiDeviceConv::Init(const DeviceSelector& selector,
+                                        cl_uint sub_device_units) {
+  UnInit();
+
+  std::vector<DeviceHandle> devices;
+  for (const DeviceHandle& handle : listDevices(selector)) {
+    std::vector<cl_device_id> parts = partitionDevice(handle.device, sub_device_units);
+    if (parts.empty()) {
+      devices.push_back(handle);
+      continue;
+    }
+    for (cl_device_id part : parts) {
+      sub_devices_.push_back(part);
+      devices.push_back({handle.platform, part});
+    }
+  }
+  if (devices.empty()) {
+    std::cerr << "no OpenCL device matches the selector" << std::endl;
+    return false;
+  }
+
+  for (const DeviceHandle& handle : devices) {
+    auto runtime = std::make_shared<OpenCLRuntime>();
+    if (!runtime->init(handle.platform, handle.device)) {
+      std::cerr << "OpenCLRuntime init failed, skipping device" << std::endl;
+      continue;
+    }
+    auto conv = std::make_unique<OpenCLSeperableConv>(runtime);
+    if (!conv->Init()) {
+      std::cerr << "OpenCLSeperableConv init failed, skipping device" << std::endl;
+      continue;
+    }
+    // compute units are the only hint until a frame has been timed
+    rows_per_ms_.push_back(std::max<cl_uint>(1, runtime->deviceInfo().compute_units));
+    timed_.push_back(0);
+    runtimes_.push_back(runtime);
+    convs_.push_back(std::move(conv));
+  }
+  if (convs_.empty()) {
+    UnInit();
+    return false;
+  }
+
+  pool_ = std::make_unique<ThreadPool>(convs_.size());
+  band_outputs_.resize(convs_.size());
+  return true;
+}
+
+inline void OpenCLMultiDeviceConv::UnInit() {
+  pool_.reset();
+  band_outputs_.clear();
+  convs_.clear();
+  runtimes_.clear();
+  // sub-devices outlive the contexts created on them
+  for (cl_device_id device : sub_devices_) {
+    clReleaseDevice(device);
+  }
+  sub_devices_.clear();
+  rows_per_ms_.clear();
+  timed_.clear();
+  last_split_.clear();
+}
+
+inline std::vector<OpenCLMultiDeviceConv::Band>
+OpenCLMultiDeviceConv::SplitRows(int height, int radius) const {
+  double total = 0.0;
+  for (double rate : rows_per_ms_) total += rate;
+
+  std::vector<Band> bands;
+  int y = 0;
+  double acc = 0.0;
+  for (size_t i = 0; i < rows_per_ms_.size(); i++) {
+    acc += rows_per_ms_[i];
+    int end = i + 1 == rows_per_ms_.size()
+      ? height : static_cast<int>(height * acc / total + 0.5);
+    end = std::min(std::max(end, y), height);
+    Band band;
+    band.y0 = y;
+    band.rows = end - y;
+    band.apron_top = std::min(radius, y);
+    band.apron_bottom = std::min(radius, height - end);
+    bands.push_back(band);
+    y = end;
+  }
+  return bands;
+}
+
+inline bool OpenCLMultiDeviceConv::Run(const cv::Mat& input,
+                                       const std::vector<float>& kernel,
+                                       cv::Mat& output) {
+  if (convs_.empty()) return false;
+  CV_Assert(input.isContinuous());
+
+  const int radius = static_cast<int>(kernel.size()) / 2;
+  const std::vector<Band> bands = SplitRows(input.rows, radius);
+  output.create(input.rows, input.cols, input.type());
+
+  std::vector<double> band_ms(bands.size(), 0.0);
+  std::vector<char> ok(bands.size(), 1);
+  pool_->parallelFor(0, bands.size(), [&](size_t i) {
+    const Band& band = bands[i];
+    if (band.rows == 0) return;
+    auto start = std::chrono::steady_clock::now();
+
+    // full rows of a continuous Mat stay continuous
+    cv::Mat src = input.rowRange(band.y0 - band.apron_top,
+                                 band.y0 + band.rows + band.apron_bottom);
+    if (!convs_[i]->Run(src, kernel, band_outputs_[i])) {
+      ok[i] = 0;
+      return;
+    }
+    // drop the apron rows, they belong to the neighbouring bands
+    cv::Mat dst = output.rowRange(band.y0, band.y0 + band.rows);
+    band_outputs_[i].rowRange(band.apron_top, band.apron_top + band.rows).copyTo(dst);
+
+    band_ms[i] = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+  });
+
+  last_split_.assign(bands.size(), 0.0);
+  for (size_t i = 0; i < bands.size(); i++) {
+    if (!ok[i]) {
+      std::cerr << "band " << i << " failed" << std::endl;
+      return false;
+    }
+    last_split_[i] = static_cast<double>(bands[i].rows) / input.rows;
+    // an idle device keeps its last measured rate
+    if (band_ms[i] <= 0.0) continue;
+    // smoothed, one slow frame should not swing the split. The first timed
+    // frame replaces the compute unit guess outright.
+    const double rate = bands[i].rows / band_ms[i];
+    rows_per_ms_[i] = timed_[i] ? 0.5 * rows_per_ms_[i] + 0.5 * rate : rate;
+    timed_[i] = 1;
+  }
+
+  // compute units are no rows per ms, devices that got no rows yet are
+  // brought to the unit of the others
+  double timed_rate = 0.0;
+  double timed_units = 0.0;
+  for (size_t i = 0; i < rows_per_ms_.size(); i++) {
+    if (!timed_[i]) continue;
+    timed_rate += rows_per_ms_[i];
+    timed_units += UntimedRate(i, 1.0);
+  }
+  if (timed_units > 0.0) {
+    for (size_t i = 0; i < rows_per_ms_.size(); i++) {
+      if (!timed_[i]) rows_per_ms_[i] = UntimedRate(i, timed_rate / timed_units);
+    }
+  }
+  return true;
+}
+
+inline double OpenCLMultiDeviceConv::UntimedRate(size_t index, double rate_per_unit) const {
+  return std::max<cl_uint>(1, runtimes_[index]->deviceInfo().compute_units) * rate_per_unit;
+}
+
+inline size_t OpenCLMultiDeviceConv::DeviceCount() const { return convs_.size(); }
+
+inline const DeviceInfo& OpenCLMultiDeviceConv::GetDeviceInfo(size_t index) const {
+  return runtimes_.at(index)->deviceInfo();
+}
+
+inline std::vector<double> OpenCLMultiDeviceConv::GetSplit() const { return last_split_; }
+
+inline void OpenCLMultiDeviceConv::SetKernelVariant(KernelVariant variant) {
+  for (auto& conv : convs_) conv->SetKernelVariant(variant);
+}
+
+}
@@ -1,8 +1,15 @@
 #include <benchmark/benchmark.h>
 #include <cstring>
 #include <glog/logging.h>
+#include "CpuSeperableConv.h"
+#include "GaussianKernel.h"
+#include "KernelDecomposition.h"
+#include "OpenCLBoxBlur.hpp"
 #include "OpenCLConvolution.hpp"
+#include "OpenCLFrameStream.hpp"
+#include "OpenCLMultiDeviceConv.hpp"
 #include "OpenCLRuntime.h"
+#include "Profiler.h"
 #include <opencv2/core/mat.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgcodecs.hpp>
@@ -12,25 +19,17 @@
 #include <vector>
 #include <numeric>
 #include <filesystem>
+#include <chrono>
+#include <algorithm>
+#include <random>
 
 std::string g_input_path;
 std::string g_output_path;
+// Chrome trace prefix, empty to skip writing traces
+std::string g_trace_path;
 
 std::vector<float> createGaussianKernel1D(int radius, float sigma) {
-  int size = 2 * radius + 1;
-  std::vector<float> kernel(size);
-  float sum = 0.0f;
-  for (int i = -radius; i < radius; ++i) {
-    float value = std::exp( -(i * i) / (2.0f * sigma * sigma) );
-    kernel[i + radius] = value;
-    sum += value;
-  }
-
-  for (auto &v : kernel) {
-    v /= sum;
-  }
-
-  return kernel;
+  return kumo::gaussianKernel1D(sigma, radius);
 }
 
 std::vector<float> createGaussianKernel2D(int radius, float sigma) {
@@ -56,6 +55,52 @@ std::vector<float> createGaussianKernel2D(int radius, float sigma) {
   return kernel;
 }
 
+// Linear motion blur of length 2 * radius + 1 along angle_deg, every tap
+// weighted by its distance to the line so the kernel stays smooth at any
+// angle.
+std::vector<float> createMotionKernel2D(int radius, float angle_deg) {
+  int ksize = 2 * radius + 1;
+  std::vector<float> kernel(ksize * ksize);
+  const float angle = angle_deg * static_cast<float>(CV_PI) / 180.0f;
+  const float dx = std::cos(angle);
+  const float dy = std::sin(angle);
+
+  float sum = 0.0f;
+  for (int y = -radius; y <= radius; ++y) {
+    for (int x = -radius; x <= radius; ++x) {
+      const float along = x * dx + y * dy;
+      const float across = std::abs(-x * dy + y * dx);
+      const float value = std::abs(along) <= radius ? std::max(0.0f, 1.0f - across) : 0.0f;
+      kernel[(y + radius) * ksize + (x + radius)] = value;
+      sum += value;
+    }
+  }
+  for (auto& v : kernel) {
+    v /= sum;
+  }
+  return kernel;
+}
+
+// Lens (bokeh) disc of the given radius with a one pixel soft edge.
+std::vector<float> createDiscKernel2D(int radius) {
+  int ksize = 2 * radius + 1;
+  std::vector<float> kernel(ksize * ksize);
+
+  float sum = 0.0f;
+  for (int y = -radius; y <= radius; ++y) {
+    for (int x = -radius; x <= radius; ++x) {
+      const float dist = std::sqrt(static_cast<float>(x * x + y * y));
+      const float value = std::clamp(radius + 0.5f - dist, 0.0f, 1.0f);
+      kernel[(y + radius) * ksize + (x + radius)] = value;
+      sum += value;
+    }
+  }
+  for (auto& v : kernel) {
+    v /= sum;
+  }
+  return kernel;
+}
+
 void gaussianBlur1D(const cv::Mat& src, cv::Mat& dst, const std::vector<float>& kernel, bool horizontal) {
   CV_Assert(src.channels() == 1 || src.channels() == 3);
   dst = cv::Mat::zeros(src.size(), src.type());
@@ -111,31 +156,639 @@ static void BM_GaussianBlur1D(benchmark::State& state) {
   cv::imwrite(output_path + filename, output);
 }
 
+// indexed by kumo::KernelVariant
+// label suffix of a kumo::KernelVariant, none for kNaive
+static std::string VariantSuffix(int64_t variant) {
+  const auto kernel_variant = static_cast<kumo::KernelVariant>(variant);
+  if (kernel_variant == kumo::KernelVariant::kNaive) return std::string();
+  return std::string("_") + kumo::KernelVariantName(kernel_variant);
+}
+
+// Per-command device time of every stage and the bandwidth of the copies
+// and of the kernels, to tell PCIe from compute bound runs apart.
+static void SetProfileCounters(benchmark::State& state, kumo::Profiler& profiler) {
+  profiler.collect();
+  const kumo::StageStats upload = profiler.stage("upload");
+  const kumo::StageStats download = profiler.stage("download");
+  state.counters["upload_ms"] = upload.averageMs();
+  state.counters["download_ms"] = download.averageMs();
+  double kernel_ms = 0.0;
+  size_t kernel_bytes = 0;
+  for (const char* name : {"rows", "cols", "fused", "rows_border", "cols_border"}) {
+    const kumo::StageStats stats = profiler.stage(name);
+    if (stats.count == 0) continue;
+    state.counters[std::string(name) + "_ms"] = stats.averageMs();
+    kernel_ms += stats.total_ms;
+    kernel_bytes += stats.bytes;
+  }
+  const double transfer_ms = upload.total_ms + download.total_ms;
+  state.counters["transfer_GB/s"] =
+      transfer_ms > 0.0 ? (upload.bytes + download.bytes) / (transfer_ms * 1e6) : 0.0;
+  state.counters["kernel_GB/s"] = kernel_ms > 0.0 ? kernel_bytes / (kernel_ms * 1e6) : 0.0;
+}
+
 static void BM_GaussianBlur2dGPU(benchmark::State& state) {
   cv::Mat input = cv::imread(g_input_path, cv::IMREAD_COLOR);
   CHECK(!input.empty()) << "Failed to load image!";
 
   int radius = static_cast<int>(state.range(0));
   float sigma = static_cast<float>(state.range(1)) / 10.0f;
+  auto variant = static_cast<kumo::KernelVariant>(state.range(2));
   auto kernel = createGaussianKernel1D(radius, sigma);
 
   kumo::OpenCLSeperableConv opencl_conv;
 
   opencl_conv.Init();
+  opencl_conv.SetKernelVariant(variant);
 
+  // the first frame pays for allocating the pooled device buffers
   cv::Mat output;
+  auto cold_start = std::chrono::steady_clock::now();
+  opencl_conv.Run(input, kernel, output);
+  double cold_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - cold_start).count();
+
+  // warm frames only, the cold one is above
+  auto profiler = std::make_shared<kumo::Profiler>();
+  opencl_conv.SetProfiler(profiler);
+
+  double warm_ms = 0.0;
   for (auto _ : state) {
+    auto start = std::chrono::steady_clock::now();
     opencl_conv.Run(input, kernel, output);
     benchmark::DoNotOptimize(output.data);
+    warm_ms += std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
   }
 
+  state.counters["cold_pool_ms"] = cold_ms;
+  state.counters["warm_pool_ms"] = warm_ms / state.iterations();
+  state.counters["buffer_allocs"] = opencl_conv.BufferAllocationCount();
+  SetProfileCounters(state, *profiler);
   state.SetItemsProcessed(state.iterations() * input.total());
-  state.SetLabel("GaussianBlur2D_GPU_" + std::to_string(radius) + "_sigma_" + std::to_string(sigma));
+  state.SetLabel("GaussianBlur2D_GPU_" + std::to_string(radius) + "_sigma_" + std::to_string(sigma) +
+                 VariantSuffix(state.range(2)));
 
   std::string output_path = g_output_path;
-  std::string filename = "_opencl_blurred_radius" + std::to_string(radius) +
+  std::string variant_name = std::string("_opencl") + VariantSuffix(state.range(2));
+  std::string filename = variant_name + "_blurred_radius" + std::to_string(radius) +
                          "_sigma" + std::to_string(sigma) + ".png";
   cv::imwrite(output_path + filename, output);
+  if (!g_trace_path.empty()) {
+    profiler->writeChromeTrace(g_trace_path + variant_name + "_radius" + std::to_string(radius) +
+                               "_sigma" + std::to_string(sigma) + ".json");
+  }
+  opencl_conv.UnInit();
+}
+
+// Fused single-pass kernel against the two-pass paths, state.range(1)
+// selects kumo::KernelVariant. Sigma follows the radius.
+static void BM_GaussianBlurFusedSweep(benchmark::State& state) {
+  cv::Mat input = cv::imread(g_input_path, cv::IMREAD_COLOR);
+  CHECK(!input.empty()) << "Failed to load image!";
+
+  int radius = static_cast<int>(state.range(0));
+  auto variant = static_cast<kumo::KernelVariant>(state.range(1));
+  float sigma = radius / 3.0f;
+  auto kernel = createGaussianKernel1D(radius, sigma);
+
+  kumo::OpenCLSeperableConv opencl_conv;
+  opencl_conv.Init();
+  opencl_conv.SetKernelVariant(variant);
+
+  cv::Mat output;
+  for (auto _ : state) {
+    opencl_conv.Run(input, kernel, output);
+    benchmark::DoNotOptimize(output.data);
+  }
+
+  state.SetItemsProcessed(state.iterations() * input.total());
+  state.SetLabel("radius_" + std::to_string(radius) + VariantSuffix(state.range(1)));
+  opencl_conv.UnInit();
+}
+
+// Scalar 3 channel kernels against host-side BGRA packing with the uchar4 /
+// vload16 kernels, state.range(2) toggles the packing.
+static void BM_GaussianBlurPackRGBA(benchmark::State& state) {
+  cv::Mat input = cv::imread(g_input_path, cv::IMREAD_COLOR);
+  CHECK(!input.empty()) << "Failed to load image!";
+
+  int radius = static_cast<int>(state.range(0));
+  float sigma = static_cast<float>(state.range(1)) / 10.0f;
+  bool pack = state.range(2) != 0;
+  auto kernel = createGaussianKernel1D(radius, sigma);
+
+  kumo::OpenCLSeperableConv opencl_conv;
+  opencl_conv.Init();
+  opencl_conv.SetPackRGBA(pack);
+
+  cv::Mat output;
+  for (auto _ : state) {
+    opencl_conv.Run(input, kernel, output);
+    benchmark::DoNotOptimize(output.data);
+  }
+
+  state.SetItemsProcessed(state.iterations() * input.total());
+  state.SetLabel(std::string(pack ? "rgba_vector" : "bgr_scalar") +
+                 "_radius_" + std::to_string(radius));
+  opencl_conv.UnInit();
+}
+
+// Library CPU fallback, state.range(2) is the thread count and
+// state.range(3) selects kumo::CpuArithmetic (0 float, 1 folded, 2 fixed).
+static void BM_GaussianBlurCPU(benchmark::State& state) {
+  cv::Mat input = cv::imread(g_input_path, cv::IMREAD_COLOR);
+  CHECK(!input.empty()) << "Failed to load image!";
+
+  int radius = static_cast<int>(state.range(0));
+  float sigma = static_cast<float>(state.range(1)) / 10.0f;
+  auto kernel = createGaussianKernel1D(radius, sigma);
+  static const char* kArithmeticSuffix[] = {"", "_folded", "_q16"};
+
+  kumo::CpuSeperableConv cpu_conv(state.range(2));
+  cpu_conv.setArithmetic(static_cast<kumo::CpuArithmetic>(state.range(3)));
+  cv::Mat output(input.size(), input.type());
+  for (auto _ : state) {
+    cpu_conv.run(input.data, input.step, output.data, output.step,
+                 input.cols, input.rows, input.channels(), kernel);
+    benchmark::DoNotOptimize(output.data);
+  }
+
+  state.SetItemsProcessed(state.iterations() * input.total());
+  state.SetLabel(std::string("cpu_") + kumo::CpuSeperableConv::simdPath() +
+                 "_threads_" + std::to_string(cpu_conv.threadCount()) +
+                 "_radius_" + std::to_string(radius) + kArithmeticSuffix[state.range(3)]);
+}
+
+// FIR against the recursive Gaussian over sigma, state.range(1) picks the
+// path (0 OpenCL FIR, 1 OpenCL IIR, 2 CPU FIR, 3 CPU IIR). The IIR paths
+// report their error against the CPU FIR result with a 3 sigma kernel.
+static void BM_GaussianBlurRecursive(benchmark::State& state) {
+  cv::Mat input = cv::imread(g_input_path, cv::IMREAD_COLOR);
+  CHECK(!input.empty()) << "Failed to load image!";
+
+  const float sigma = static_cast<float>(state.range(0));
+  const int path = static_cast<int>(state.range(1));
+  const bool recursive = path == 1 || path == 3;
+  const bool on_cpu = path >= 2;
+  auto kernel = kumo::gaussianKernel1D(sigma);
+
+  kumo::OpenCLSeperableConv opencl_conv;
+  kumo::CpuSeperableConv cpu_conv;
+  if (!on_cpu) CHECK(opencl_conv.Init()) << "OpenCL init failed";
+
+  cv::Mat output(input.size(), input.type());
+  auto run = [&] {
+    if (on_cpu && recursive) {
+      return cpu_conv.runRecursive(input.data, input.step, output.data, output.step,
+                                   input.cols, input.rows, input.channels(), sigma);
+    }
+    if (on_cpu) {
+      return cpu_conv.run(input.data, input.step, output.data, output.step,
+                          input.cols, input.rows, input.channels(), kernel);
+    }
+    return recursive ? opencl_conv.RunRecursive(input, sigma, output)
+                     : opencl_conv.Run(input, kernel, output);
+  };
+
+  for (auto _ : state) {
+    run();
+    benchmark::DoNotOptimize(output.data);
+  }
+
+  if (recursive) {
+    cv::Mat reference(input.size(), input.type());
+    cpu_conv.run(input.data, input.step, reference.data, reference.step,
+                 input.cols, input.rows, input.channels(), kernel);
+    cv::Mat diff;
+    cv::absdiff(output, reference, diff);
+    state.counters["max_err"] = cv::norm(diff, cv::NORM_INF);
+    state.counters["mean_err"] = cv::norm(diff, cv::NORM_L1) / diff.total() / diff.channels();
+    // the frame within 3 sigma of an edge, where the boundary state matters
+    const int margin = std::min({(int)std::ceil(3.0f * sigma), diff.cols / 2, diff.rows / 2});
+    cv::Mat border = diff.clone();
+    border(cv::Rect(margin, margin, diff.cols - 2 * margin, diff.rows - 2 * margin))
+        .setTo(cv::Scalar::all(0));
+    state.counters["border_max_err"] = cv::norm(border, cv::NORM_INF);
+  }
+
+  static const char* kPathName[] = {"opencl_fir", "opencl_iir", "cpu_fir", "cpu_iir"};
+  state.SetItemsProcessed(state.iterations() * input.total());
+  state.SetLabel(std::string(kPathName[path]) + "_sigma_" + std::to_string(state.range(0)) +
+                 "_taps_" + std::to_string(kernel.size()));
+  if (!on_cpu) opencl_conv.UnInit();
+}
+
+// Three box passes on scanned lines, the cost should stay flat over sigma.
+// Reports the error against the CPU FIR result with a 3 sigma kernel.
+static void BM_GaussianBlurBoxCascade(benchmark::State& state) {
+  cv::Mat input = cv::imread(g_input_path, cv::IMREAD_COLOR);
+  CHECK(!input.empty()) << "Failed to load image!";
+
+  const float sigma = static_cast<float>(state.range(0));
+  kumo::OpenCLBoxBlur box_blur;
+  CHECK(box_blur.Init()) << "OpenCL init failed";
+
+  cv::Mat output;
+  for (auto _ : state) {
+    box_blur.Run(input, sigma, output);
+    benchmark::DoNotOptimize(output.data);
+  }
+
+  kumo::CpuSeperableConv cpu_conv;
+  cv::Mat reference(input.size(), input.type());
+  cpu_conv.run(input.data, input.step, reference.data, reference.step,
+               input.cols, input.rows, input.channels(), kumo::gaussianKernel1D(sigma));
+  cv::Mat diff;
+  cv::absdiff(output, reference, diff);
+  state.counters["max_err"] = cv::norm(diff, cv::NORM_INF);
+  state.counters["mean_err"] = cv::norm(diff, cv::NORM_L1) / diff.total() / diff.channels();
+
+  std::string radii;
+  for (int r : kumo::boxBlurRadii(sigma, 3)) radii += "_" + std::to_string(r);
+  state.SetItemsProcessed(state.iterations() * input.total());
+  state.SetLabel("sigma_" + std::to_string(state.range(0)) + "_box" + radii);
+  box_blur.UnInit();
+}
+
+// Launch configuration from the tuning database, the first run sweeps and
+// stores it when the database has no entry for this device and geometry.
+static void BM_GaussianBlurTuned(benchmark::State& state) {
+  cv::Mat input = cv::imread(g_input_path, cv::IMREAD_COLOR);
+  CHECK(!input.empty()) << "Failed to load image!";
+
+  int radius = static_cast<int>(state.range(0));
+  auto kernel = kumo::gaussianKernel1D(std::max(radius / 3.0f, 0.5f), radius);
+
+  auto database = std::make_shared<kumo::TuningDatabase>();
+  database->load();
+  kumo::OpenCLSeperableConv opencl_conv;
+  opencl_conv.Init();
+  opencl_conv.SetTuningDatabase(database);
+
+  cv::Mat output;
+  opencl_conv.Run(input, kernel, output);  // tunes or applies outside the timing
+  for (auto _ : state) {
+    opencl_conv.Run(input, kernel, output);
+    benchmark::DoNotOptimize(output.data);
+  }
+
+  state.SetItemsProcessed(state.iterations() * input.total());
+  state.SetLabel("radius_" + std::to_string(radius) +
+                 VariantSuffix(static_cast<int>(opencl_conv.GetKernelVariant())) +
+                 (opencl_conv.GetPackRGBA() ? "_rgba" : ""));
+  opencl_conv.UnInit();
+}
+
+// Synthetic 4K frames, state.range(2) selects kumo::MemoryMode (0 copy, 1 zero-copy)
+static void BM_GaussianBlur2dGPU4K(benchmark::State& state) {
+  int radius = static_cast<int>(state.range(0));
+  float sigma = static_cast<float>(state.range(1)) / 10.0f;
+  auto mode = static_cast<kumo::MemoryMode>(state.range(2));
+  auto kernel = createGaussianKernel1D(radius, sigma);
+
+  cv::Mat input = kumo::OpenCLSeperableConv::AllocatePageAligned(2160, 3840, CV_8UC3);
+  cv::randu(input, cv::Scalar::all(0), cv::Scalar::all(255));
+
+  kumo::OpenCLSeperableConv opencl_conv;
+  opencl_conv.Init();
+  opencl_conv.SetMemoryMode(mode);
+
+  cv::Mat output;
+  for (auto _ : state) {
+    opencl_conv.Run(input, kernel, output);
+    benchmark::DoNotOptimize(output.data);
+  }
+
+  state.SetItemsProcessed(state.iterations() * input.total());
+  state.SetBytesProcessed(state.iterations() * input.total() * input.elemSize() * 2);
+  state.SetLabel(std::string(mode == kumo::MemoryMode::kZeroCopy ? "zero_copy" : "copy") +
+                 "_4K_radius_" + std::to_string(radius));
+  opencl_conv.UnInit();
+}
+
+// Thumbnail workload: state.range(0) images with sides in [128, 512].
+// state.range(1) == 0 loops over Run, 1 sends the whole batch to RunBatch.
+static void BM_GaussianBlurBatch(benchmark::State& state) {
+  const int count = static_cast<int>(state.range(0));
+  const bool batched = state.range(1) != 0;
+  auto kernel = createGaussianKernel1D(3, 1.5f);
+
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> side(128, 512);
+  std::vector<cv::Mat> inputs;
+  size_t pixels = 0;
+  for (int i = 0; i < count; i++) {
+    inputs.emplace_back(side(gen), side(gen), CV_8UC3);
+    cv::randu(inputs.back(), cv::Scalar::all(0), cv::Scalar::all(255));
+    pixels += inputs.back().total();
+  }
+
+  kumo::OpenCLSeperableConv opencl_conv;
+  opencl_conv.Init();
+
+  std::vector<cv::Mat> outputs(count);
+  for (auto _ : state) {
+    if (batched) {
+      opencl_conv.RunBatch(inputs, kernel, outputs);
+    } else {
+      for (int i = 0; i < count; i++) {
+        opencl_conv.Run(inputs[i], kernel, outputs[i]);
+      }
+    }
+    benchmark::DoNotOptimize(outputs.back().data);
+  }
+
+  state.counters["images_per_s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * count), benchmark::Counter::kIsRate);
+  state.SetItemsProcessed(state.iterations() * pixels);
+  state.SetLabel(std::string(batched ? "batch" : "loop") + "_" + std::to_string(count));
+  opencl_conv.UnInit();
+}
+
+// Splits a 4K frame across every OpenCL device. state.range(0) > 0
+// partitions each device into sub-devices of that many compute units.
+static void BM_GaussianBlurMultiDevice(benchmark::State& state) {
+  const cl_uint sub_device_units = static_cast<cl_uint>(state.range(0));
+  auto kernel = createGaussianKernel1D(7, 2.5f);
+
+  cv::Mat input = kumo::OpenCLSeperableConv::AllocatePageAligned(2160, 3840, CV_8UC3);
+  cv::randu(input, cv::Scalar::all(0), cv::Scalar::all(255));
+
+  kumo::DeviceSelector selector;
+  selector.type = CL_DEVICE_TYPE_ALL;
+  kumo::OpenCLMultiDeviceConv multi_conv;
+  CHECK(multi_conv.Init(selector, sub_device_units)) << "Failed to init devices!";
+
+  cv::Mat output;
+  // a few frames to settle the throughput-weighted split
+  for (int i = 0; i < 3; i++) multi_conv.Run(input, kernel, output);
+
+  for (auto _ : state) {
+    multi_conv.Run(input, kernel, output);
+    benchmark::DoNotOptimize(output.data);
+  }
+
+  state.SetItemsProcessed(state.iterations() * input.total());
+  state.counters["devices"] = static_cast<double>(multi_conv.DeviceCount());
+  std::vector<double> split = multi_conv.GetSplit();
+  for (size_t i = 0; i < split.size(); i++) {
+    state.counters["split_" + std::to_string(i)] = split[i];
+  }
+  state.SetLabel("sub_device_units_" + std::to_string(sub_device_units));
+  multi_conv.UnInit();
+}
+
+// Init cost of a fresh runtime plus OpenCLSeperableConv with an empty (state.range(0) == 0) or a
+// populated (1) on-disk program cache. Cold builds every program from source,
+// warm loads the binaries written by the previous run.
+static void BM_SeperableConvInit(benchmark::State& state) {
+  const bool warm = state.range(0) != 0;
+  const std::filesystem::path cache_dir =
+      std::filesystem::temp_directory_path() / "kumo_cl_bench_cache";
+  std::filesystem::remove_all(cache_dir);
+  if (warm) {
+    auto runtime = std::make_shared<kumo::OpenCLRuntime>();
+    runtime->programCache().setCacheDir(cache_dir.string());
+    kumo::OpenCLSeperableConv opencl_conv(runtime);
+    opencl_conv.Init();
+    opencl_conv.UnInit();
+  }
+
+  size_t compiles = 0;
+  size_t binary_loads = 0;
+  for (auto _ : state) {
+    if (!warm) {
+      state.PauseTiming();
+      std::filesystem::remove_all(cache_dir);
+      state.ResumeTiming();
+    }
+    auto runtime = std::make_shared<kumo::OpenCLRuntime>();
+    runtime->programCache().setCacheDir(cache_dir.string());
+    kumo::OpenCLSeperableConv opencl_conv(runtime);
+    opencl_conv.Init();
+    compiles += runtime->programCache().compileCount();
+    binary_loads += runtime->programCache().binaryLoadCount();
+    opencl_conv.UnInit();
+  }
+
+  state.counters["compiles"] = benchmark::Counter(
+      static_cast<double>(compiles), benchmark::Counter::kAvgIterations);
+  state.counters["binary_loads"] = benchmark::Counter(
+      static_cast<double>(binary_loads), benchmark::Counter::kAvgIterations);
+  state.SetLabel(warm ? "warm" : "cold");
+  std::filesystem::remove_all(cache_dir);
+}
+
+// Feeds a synthetic frame sequence through OpenCLFrameStream.
+// state.range(0/1) is the frame size, state.range(2) the number of frames in
+// flight; depth 1 serializes upload, blur and download like Run does.
+static void BM_GaussianBlurStream(benchmark::State& state) {
+  const int width = static_cast<int>(state.range(0));
+  const int height = static_cast<int>(state.range(1));
+  const int depth = static_cast<int>(state.range(2));
+  const int kFrames = 60;
+  const int kSourceFrames = 4;
+  auto kernel = createGaussianKernel1D(7, 2.5f);
+
+  // a few distinct frames cycled, the sequence is never copied per frame
+  std::vector<cv::Mat> frames;
+  for (int i = 0; i < kSourceFrames; i++) {
+    frames.push_back(kumo::OpenCLSeperableConv::AllocatePageAligned(height, width, CV_8UC3));
+    cv::randu(frames.back(), cv::Scalar::all(0), cv::Scalar::all(255));
+  }
+
+  kumo::OpenCLSeperableConv opencl_conv;
+  opencl_conv.Init();
+  kumo::OpenCLFrameStream stream(opencl_conv, depth);
+  CHECK(stream.Init(width, height, CV_8UC3, kernel)) << "Failed to init frame stream!";
+
+  using Clock = std::chrono::steady_clock;
+  std::vector<Clock::time_point> pushed(kFrames);
+  std::vector<double> latency_ms;
+  latency_ms.reserve(state.max_iterations * kFrames);
+  cv::Mat output;
+  for (auto _ : state) {
+    int popped = 0;
+    for (int i = 0; i < kFrames; i++) {
+      if (stream.InFlight() == stream.Depth()) {
+        stream.Pop(output);
+        latency_ms.push_back(std::chrono::duration<double, std::milli>(
+            Clock::now() - pushed[popped++]).count());
+      }
+      pushed[i] = Clock::now();
+      stream.Push(frames[i % kSourceFrames]);
+    }
+    while (stream.InFlight() > 0) {
+      stream.Pop(output);
+      latency_ms.push_back(std::chrono::duration<double, std::milli>(
+          Clock::now() - pushed[popped++]).count());
+    }
+    benchmark::DoNotOptimize(output.data);
+  }
+
+  std::sort(latency_ms.begin(), latency_ms.end());
+  auto percentile = [&](double p) {
+    if (latency_ms.empty()) return 0.0;
+    return latency_ms[static_cast<size_t>(p * (latency_ms.size() - 1))];
+  };
+  state.counters["fps"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * kFrames), benchmark::Counter::kIsRate);
+  state.counters["p50_ms"] = percentile(0.50);
+  state.counters["p90_ms"] = percentile(0.90);
+  state.counters["p99_ms"] = percentile(0.99);
+  state.SetItemsProcessed(state.iterations() * kFrames * width * height);
+  state.SetLabel(std::to_string(width) + "x" + std::to_string(height) +
+                 "_depth_" + std::to_string(depth));
+  stream.UnInit();
+  opencl_conv.UnInit();
+}
+
+// state.range(2) selects kumo::IntermediateFormat (0 uchar, 1 half, 2 float).
+// Quality is the PSNR against a float reference of the same separable filter.
+static void BM_GaussianBlurIntermediate(benchmark::State& state) {
+  cv::Mat input = cv::imread(g_input_path, cv::IMREAD_COLOR);
+  CHECK(!input.empty()) << "Failed to load image!";
+
+  int radius = static_cast<int>(state.range(0));
+  float sigma = static_cast<float>(state.range(1)) / 10.0f;
+  auto format = static_cast<kumo::IntermediateFormat>(state.range(2));
+  auto kernel = createGaussianKernel1D(radius, sigma);
+
+  kumo::OpenCLSeperableConv opencl_conv;
+  opencl_conv.Init();
+  opencl_conv.SetIntermediateFormat(format);
+
+  cv::Mat output;
+  double total_ms = 0.0;
+  for (auto _ : state) {
+    auto start = std::chrono::steady_clock::now();
+    opencl_conv.Run(input, kernel, output);
+    benchmark::DoNotOptimize(output.data);
+    total_ms += std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+  }
+
+  cv::Mat reference, output_f;
+  cv::sepFilter2D(input, reference, CV_32F, cv::Mat(kernel), cv::Mat(kernel),
+                  cv::Point(-1, -1), 0, cv::BORDER_REPLICATE);
+  output.convertTo(output_f, CV_32F);
+
+  // input read, temp write + read, output write
+  const size_t image_bytes = input.total() * input.elemSize();
+  const size_t frame_bytes = image_bytes * 2 +
+      image_bytes * opencl_conv.IntermediateElementSize() * 2;
+  state.SetBytesProcessed(state.iterations() * frame_bytes);
+  state.SetItemsProcessed(state.iterations() * input.total());
+  state.counters["latency_ms"] = total_ms / state.iterations();
+  state.counters["psnr_db"] = cv::PSNR(reference, output_f, 255.0);
+
+  const char* format_names[] = {"uchar", "half", "float"};
+  state.SetLabel(std::string("temp_") + format_names[state.range(2)] +
+                 "_radius_" + std::to_string(radius));
+  opencl_conv.UnInit();
+}
+
+// 4K frame through the split naive passes, state.range(2) is the
+// kumo::BorderMode, which is also the cv::BorderTypes value of the
+// sepFilter2D reference the PSNR is taken against (wrap is padded with
+// copyMakeBorder first). border_ms is the share
+// of the device time spent in the strips.
+static void BM_GaussianBlurBorder(benchmark::State& state) {
+  int radius = static_cast<int>(state.range(0));
+  float sigma = static_cast<float>(state.range(1)) / 10.0f;
+  auto mode = static_cast<kumo::BorderMode>(state.range(2));
+  auto kernel = createGaussianKernel1D(radius, sigma);
+
+  cv::Mat input(2160, 3840, CV_8UC3);
+  cv::randu(input, cv::Scalar::all(0), cv::Scalar::all(255));
+
+  kumo::OpenCLSeperableConv opencl_conv;
+  opencl_conv.Init();
+  opencl_conv.SetBorderMode(mode);
+
+  cv::Mat output;
+  opencl_conv.Run(input, kernel, output);
+  auto profiler = std::make_shared<kumo::Profiler>();
+  opencl_conv.SetProfiler(profiler);
+  for (auto _ : state) {
+    opencl_conv.Run(input, kernel, output);
+    benchmark::DoNotOptimize(output.data);
+  }
+
+  cv::Mat reference, output_f;
+  if (mode == kumo::BorderMode::kWrap) {
+    // the linear filters reject BORDER_WRAP, pad by hand and crop
+    const int pad = static_cast<int>(kernel.size()) / 2;
+    cv::Mat padded;
+    cv::copyMakeBorder(input, padded, pad, pad, pad, pad, cv::BORDER_WRAP);
+    cv::sepFilter2D(padded, reference, CV_32F, cv::Mat(kernel), cv::Mat(kernel),
+                    cv::Point(-1, -1), 0, cv::BORDER_ISOLATED);
+    reference = reference(cv::Rect(pad, pad, input.cols, input.rows)).clone();
+  } else {
+    cv::sepFilter2D(input, reference, CV_32F, cv::Mat(kernel), cv::Mat(kernel),
+                    cv::Point(-1, -1), 0, static_cast<int>(mode));
+  }
+  output.convertTo(output_f, CV_32F);
+
+  SetProfileCounters(state, *profiler);
+  const kumo::StageStats rows_border = profiler->stage("rows_border");
+  const kumo::StageStats cols_border = profiler->stage("cols_border");
+  state.counters["border_ms"] =
+      (rows_border.total_ms + cols_border.total_ms) / state.iterations();
+  state.counters["psnr_db"] = cv::PSNR(reference, output_f, 255.0);
+  state.SetItemsProcessed(state.iterations() * input.total());
+
+  const char* mode_names[] = {"constant", "replicate", "", "wrap", "reflect101"};
+  state.SetLabel(std::string("border_") + mode_names[state.range(2)] +
+                 "_4K_radius_" + std::to_string(radius));
+  opencl_conv.UnInit();
+}
+
+// Run2D with state.range(0) selecting the kernel (0 Gaussian, 1 motion
+// blur at 30 degrees, 2 disc) of radius state.range(1). state.range(2) is
+// the max rank, 0 forces the direct kernel, state.range(3) the residual
+// tolerance in thousandths. PSNR is against cv::filter2D.
+static void BM_Convolution2D(benchmark::State& state) {
+  cv::Mat input = cv::imread(g_input_path, cv::IMREAD_COLOR);
+  CHECK(!input.empty()) << "Failed to load image!";
+
+  const int kind = static_cast<int>(state.range(0));
+  const int radius = static_cast<int>(state.range(1));
+  const int max_rank = static_cast<int>(state.range(2));
+  const float tolerance = static_cast<float>(state.range(3)) / 1000.0f;
+  std::vector<float> coeffs = kind == 0 ? createGaussianKernel2D(radius, radius / 3.0f)
+                            : kind == 1 ? createMotionKernel2D(radius, 30.0f)
+                                        : createDiscKernel2D(radius);
+  const int ksize = 2 * radius + 1;
+  cv::Mat kernel = cv::Mat(coeffs, true).reshape(1, ksize);
+
+  kumo::OpenCLSeperableConv opencl_conv;
+  opencl_conv.Init();
+  opencl_conv.SetLowRankLimits(max_rank, tolerance);
+
+  cv::Mat output;
+  for (auto _ : state) {
+    opencl_conv.Run2D(input, kernel, output);
+    benchmark::DoNotOptimize(output.data);
+  }
+
+  cv::Mat reference, output_f;
+  cv::filter2D(input, reference, CV_32F, kernel, cv::Point(-1, -1), 0, cv::BORDER_REPLICATE);
+  output.convertTo(output_f, CV_32F);
+
+  const kumo::LowRankKernel decomposition =
+      kumo::decomposeKernel2D(coeffs, ksize, ksize, max_rank, tolerance);
+  const int rank = opencl_conv.LastRank();
+  state.counters["rank"] = rank;
+  state.counters["residual"] = decomposition.residual;
+  state.counters["taps"] = rank > 0 ? 2 * rank * ksize : ksize * ksize;
+  state.counters["psnr_db"] = cv::PSNR(reference, output_f, 255.0);
+  state.SetItemsProcessed(state.iterations() * input.total());
+
+  const char* kind_names[] = {"gaussian", "motion", "disc"};
+  state.SetLabel(std::string("conv2d_") + kind_names[kind] + "_radius_" +
+                 std::to_string(radius) + (rank > 0 ? "_rank_" + std::to_string(rank) : "_direct"));
   opencl_conv.UnInit();
 }
 
@@ -144,10 +797,117 @@ BENCHMARK(BM_GaussianBlur1D)
   ->Args({5, 20})
   ->Args({7,25});
 
+// third argument selects kumo::KernelVariant (0 naive, 1 tiled, 3 specialized,
+// 4 image, 5 folded, 6 fixed-point)
 BENCHMARK(BM_GaussianBlur2dGPU)
-  ->Args({3, 15})
-  ->Args({5, 20})
-  ->Args({7,25});
+  ->Args({3, 15, 0})
+  ->Args({5, 20, 0})
+  ->Args({7, 25, 0})
+  ->Args({15, 50, 0})
+  ->Args({3, 15, 1})
+  ->Args({5, 20, 1})
+  ->Args({7, 25, 1})
+  ->Args({15, 50, 1})
+  ->Args({3, 15, 3})
+  ->Args({5, 20, 3})
+  ->Args({7, 25, 3})
+  ->Args({3, 15, 4})
+  ->Args({5, 20, 4})
+  ->Args({7, 25, 4})
+  ->Args({15, 50, 4})
+  ->Args({3, 15, 5})
+  ->Args({7, 25, 5})
+  ->Args({15, 50, 5})
+  ->Args({3, 15, 6})
+  ->Args({7, 25, 6})
+  ->Args({15, 50, 6});
+
+BENCHMARK(BM_GaussianBlurFusedSweep)
+  ->ArgsProduct({{3, 5, 7, 9, 11, 13, 15}, {0, 1, 2, 3}});
+
+// third argument is the kumo::BorderMode (0 constant, 1 replicate, 3 wrap,
+// 4 reflect-101)
+BENCHMARK(BM_GaussianBlurBorder)
+  ->Args({3, 15, 0})
+  ->Args({3, 15, 1})
+  ->Args({3, 15, 3})
+  ->Args({3, 15, 4})
+  ->Args({15, 50, 0})
+  ->Args({15, 50, 1})
+  ->Args({15, 50, 3})
+  ->Args({15, 50, 4});
+
+BENCHMARK(BM_Convolution2D)
+  ->ArgsProduct({{0, 1, 2}, {3, 7, 15}, {0, 4}, {10}})
+  ->ArgsProduct({{1, 2}, {7, 15}, {8}, {10, 50}});
+
+BENCHMARK(BM_GaussianBlurPackRGBA)
+  ->Args({3, 15, 0})
+  ->Args({3, 15, 1})
+  ->Args({7, 25, 0})
+  ->Args({7, 25, 1});
+
+BENCHMARK(BM_GaussianBlurIntermediate)
+  ->Args({3, 15, 0})
+  ->Args({3, 15, 1})
+  ->Args({3, 15, 2})
+  ->Args({7, 25, 0})
+  ->Args({7, 25, 1})
+  ->Args({7, 25, 2});
+
+static void CpuBlurArgs(benchmark::internal::Benchmark* b) {
+  const int radius_sigma[][2] = {{3, 15}, {7, 25}, {15, 50}};
+  for (const auto& rs : radius_sigma) {
+    for (int threads : {1, 2, 4, 8, 16}) {
+      b->Args({rs[0], rs[1], threads, 0});
+    }
+    for (int arithmetic : {1, 2}) {
+      b->Args({rs[0], rs[1], 1, arithmetic});
+      b->Args({rs[0], rs[1], 16, arithmetic});
+    }
+  }
+}
+
+BENCHMARK(BM_GaussianBlurCPU)->Apply(CpuBlurArgs)->UseRealTime();
+
+BENCHMARK(BM_GaussianBlurRecursive)
+  ->ArgsProduct({{2, 5, 10, 20, 35, 50}, {0, 1, 2, 3}})
+  ->UseRealTime();
+
+BENCHMARK(BM_GaussianBlurBoxCascade)
+  ->Arg(2)->Arg(5)->Arg(10)->Arg(20)->Arg(35)->Arg(50)->Arg(100)
+  ->UseRealTime();
+
+BENCHMARK(BM_GaussianBlurTuned)->Arg(3)->Arg(7)->Arg(15);
+
+BENCHMARK(BM_GaussianBlur2dGPU4K)
+  ->Args({3, 15, 0})
+  ->Args({3, 15, 1})
+  ->Args({7, 25, 0})
+  ->Args({7, 25, 1});
+
+BENCHMARK(BM_GaussianBlurBatch)
+  ->ArgsProduct({{64, 256, 1024}, {0, 1}})
+  ->UseRealTime();
+
+BENCHMARK(BM_GaussianBlurMultiDevice)
+  ->Arg(0)
+  ->Arg(4)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_SeperableConvInit)
+  ->Arg(0)
+  ->Arg(1)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_GaussianBlurStream)
+  ->ArgsProduct({{1920}, {1080}, {1, 2, 3}})
+  ->Args({3840, 2160, 1})
+  ->Args({3840, 2160, 2})
+  ->Args({3840, 2160, 3})
+  ->UseRealTime();
 
 int main(int argc, char** argv) {
   // 先初始化Google Benchmark，解析它的参数
@@ -160,6 +920,8 @@ int main(int argc, char** argv) {
       g_input_path = arg.substr(strlen("--input="));
     } else if (arg.find("--output=") == 0) {
       g_output_path = arg.substr(strlen("--output="));
+    } else if (arg.find("--trace=") == 0) {
+      g_trace_path = arg.substr(strlen("--trace="));
     } else {
       std::cout << "Unknown param: " << arg << std::endl;
     }
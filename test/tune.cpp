@@ -0,0 +1,72 @@
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <glog/logging.h>
+#include "OpenCLConvolution.hpp"
+#include "TuningDatabase.h"
+#include <memory>
+#include <string>
+
+// Sweeps the launch configurations of OpenCLSeperableConv for common frame
+// sizes and radii and writes the winners to the tuning database, which
+// later runs with SetTuningDatabase pick up without sweeping again.
+
+std::string g_tuning_path = kumo::TuningDatabase::defaultPath();
+
+static void BM_AutotuneSeperableConv(benchmark::State& state) {
+  const int width = static_cast<int>(state.range(0));
+  const int height = static_cast<int>(state.range(1));
+  const int radius = static_cast<int>(state.range(2));
+  const int channels = static_cast<int>(state.range(3));
+
+  auto database = std::make_shared<kumo::TuningDatabase>(g_tuning_path);
+  database->load();
+
+  kumo::OpenCLSeperableConv opencl_conv;
+  CHECK(opencl_conv.Init()) << "OpenCL init failed";
+  opencl_conv.SetTuningDatabase(database);
+
+  for (auto _ : state) {
+    opencl_conv.Autotune(width, height, channels, radius);
+  }
+
+  const kumo::TuningKey key = opencl_conv.MakeTuningKey(width, height, channels, radius);
+  kumo::TuningResult result;
+  if (database->find(key, &result)) {
+    const auto& p = result.params;
+    state.counters["best_ms"] = result.ms;
+    const auto variant = static_cast<kumo::KernelVariant>(p[0]);
+    state.SetLabel(std::string(kumo::KernelVariantName(variant)) + "_local_" +
+                   std::to_string(p[1]) + "x" + std::to_string(p[2]) +
+                   (p[3] ? "_rgba" : "") + "_rows_" +
+                   std::to_string(p[4]) + "x" + std::to_string(p[5]) + "_cols_" +
+                   std::to_string(p[6]) + "x" + std::to_string(p[7]));
+  }
+  opencl_conv.UnInit();
+}
+
+// width, height, radius, channels
+BENCHMARK(BM_AutotuneSeperableConv)
+  ->ArgsProduct({{1920}, {1080}, {3, 7, 15}, {3, 4}})
+  ->Args({3840, 2160, 7, 3})
+  ->Args({1280, 720, 7, 3})
+  ->Iterations(1)
+  ->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv) {
+  // the library reports OpenCL failures through glog
+  google::InitGoogleLogging(argv[0]);
+  benchmark::Initialize(&argc, argv);
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.find("--tuning_file=") == 0) {
+      g_tuning_path = arg.substr(strlen("--tuning_file="));
+    } else {
+      std::cout << "Unknown param: " << arg << std::endl;
+    }
+  }
+  std::cout << "tuning file: " << g_tuning_path << std::endl;
+
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
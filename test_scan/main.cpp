@@ -52,6 +52,8 @@ static void BM_PrefixSumGPU(benchmark::State& state) {
 
   kumo::ScanCL scan_runtime;
   scan_runtime.Init();
+  auto profiler = std::make_shared<kumo::Profiler>();
+  scan_runtime.SetProfiler(profiler);
   
   for (auto _ : state) {
     scan_runtime.Run(input, output, tile_size);
@@ -65,11 +67,70 @@ static void BM_PrefixSumGPU(benchmark::State& state) {
 
   scan_runtime.UnInit();
 
+  // device time per iteration, every level adds a scan and a uniform_add
+  profiler->collect();
+  for (const char* name : {"upload", "scan", "uniform_add", "download"}) {
+    state.counters[std::string(name) + "_ms"] =
+        profiler->stage(name).total_ms / state.iterations();
+  }
+
   state.SetItemsProcessed(state.iterations() * array_length); // Processed 'array_length' elements in each iteration
   state.SetLabel("BM_PrefixSumHost" + std::string("_arraylength_") + std::to_string(array_length));
 }
 
 
+// Scan of a device-resident buffer, transfers are not timed. GB/s counts one
+// read and one write per element, the least any scan has to move.
+// state.range(2) selects kumo::ScanVariant (0 Blelloch, 1 blocked).
+static void BM_PrefixSumDevice(benchmark::State& state) {
+  const int array_length = state.range(0);
+  const int tile_size = state.range(1);
+  const auto variant = static_cast<kumo::ScanVariant>(state.range(2));
+
+  kumo::ScanCL scan_runtime;
+  CHECK(scan_runtime.Init()) << "OpenCL init failed";
+  // the 1 GiB end of the range does not fit every device
+  const size_t bytes = (size_t)array_length * sizeof(int);
+  cl_ulong max_alloc = 0;
+  clGetDeviceInfo(scan_runtime.Device(), CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+                  sizeof(max_alloc), &max_alloc, nullptr);
+  if (max_alloc && bytes > max_alloc) {
+    state.SkipWithError("array exceeds CL_DEVICE_MAX_MEM_ALLOC_SIZE");
+    return;
+  }
+  // at most 7 per element keeps the sum of 256M elements below INT_MAX
+  std::vector<int> data = generate_input(array_length, 0, 7);
+
+  scan_runtime.SetVariant(variant);
+  cl_int err = CL_SUCCESS;
+  cl_mem buffer = clCreateBuffer(scan_runtime.Context(),
+    CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bytes, data.data(), &err);
+  if (!buffer || err != CL_SUCCESS) {
+    state.SkipWithError("clCreateBuffer failed");
+    return;
+  }
+
+  for (auto _ : state) {
+    // scanning the previous result moves the same bytes, the values just wrap
+    scan_runtime.RunOnDevice(buffer, array_length, tile_size);
+  }
+  clReleaseMemObject(buffer);
+
+  std::vector<int> result;
+  if (!scan_runtime.Run(data, result, tile_size) || !is_result_correct(data, result)) {
+    std::cout << "result incorrect!\n";
+  }
+  std::string variant_name = variant == kumo::ScanVariant::kBlocked
+    ? (scan_runtime.UsesWorkGroupScan() ? "_blocked_wgscan" : "_blocked") : "_blelloch";
+  scan_runtime.UnInit();
+
+  state.SetItemsProcessed(state.iterations() * array_length);
+  state.counters["GB/s"] = benchmark::Counter(
+    static_cast<double>(state.iterations()) * array_length * 2 * sizeof(int) / 1e9,
+    benchmark::Counter::kIsRate);
+  state.SetLabel("BM_PrefixSumDevice_arraylength_" + std::to_string(array_length) + variant_name);
+}
+
 // static void BM_PrefixSumHost(benchmark::State& state) {
 //   size_t array_length = state.range(0);
 //   auto input = generate_input(array_length, 0, 255);
@@ -96,7 +157,14 @@ static void BM_PrefixSumGPU(benchmark::State& state) {
 //   ->Args({4096});
 
 BENCHMARK(BM_PrefixSumGPU)
-  ->Args({12, 4})->Iterations(1);
+  ->Args({12, 4})
+  ->Args({1000, 256})
+  ->Args({(1 << 20) + 7, 256})->Iterations(1);
+
+BENCHMARK(BM_PrefixSumDevice)
+  ->RangeMultiplier(4)
+  ->Ranges({{1 << 10, 1 << 28}, {256, 256}, {0, 1}})
+  ->UseRealTime();
 
 int main(int argc, char** argv) {
   // 先初始化Google Benchmark，解析它的参数
@@ -20,11 +20,10 @@ __kernel void scan(
     int group = get_group_id(0);   // Which work-group this is
     int lsize = get_local_size(0); // The size of this work-group
 
-    // Out-of-bounds check: do not process data beyond the end
-    if (gid >= N) return;
-
     // Phase 1: Load data into the shared local memory
-    temp[lid] = data[gid];
+    // Items past the end of a tail tile must not return here, every item of
+    // the group has to reach the barriers below. They scan zeros instead.
+    temp[lid] = gid < N ? data[gid] : 0;
     barrier(CLK_LOCAL_MEM_FENCE);  // Wait for all threads to complete load
 
     // Phase 2: Up-sweep (Reduction)
@@ -127,7 +126,9 @@ __kernel void scan(
         barrier(CLK_LOCAL_MEM_FENCE);
     }
 
-    data[gid] = temp[lid];
+    if (gid < N) {
+        data[gid] = temp[lid];
+    }
 }
 
 
@@ -138,6 +139,122 @@ __kernel void uniform_add(
     int TILE_SIZE
 ) {
     int gid = get_global_id(0);
+    if (gid >= N) return;
     int tile_id = gid / TILE_SIZE;
     data[gid] += tile_sums[tile_id];
-}
\ No newline at end of file
+}
+
+// ------------------------------------------------------------------
+// Register-blocked variant of `scan`, one tile is
+// get_local_size(0) * ITEMS_PER_THREAD elements.
+//
+//   1. The tile is loaded coalesced into local memory.
+//   2. Each work-item scans its ITEMS_PER_THREAD consecutive elements in
+//      registers and keeps their total.
+//   3. The totals are scanned across the work-group, with
+//      work_group_scan_exclusive_add where the device has it and a padded
+//      Blelloch tree otherwise.
+//   4. Each work-item adds its offset and the tile is stored coalesced.
+//
+// Only step 3 needs log2(local size) barriers, and it runs on
+// 1 / ITEMS_PER_THREAD of the data, so the kernel ends up bound by memory
+// instead of by barriers.
+//
+// Local memory is indexed through PAD: one spare word every NUM_BANKS
+// words, so the strided accesses of the tree and of step 2 fall into
+// different banks.
+// ------------------------------------------------------------------
+
+#ifndef ITEMS_PER_THREAD
+#define ITEMS_PER_THREAD 8
+#endif
+
+#define LOG_NUM_BANKS 5
+#define PAD(i) ((i) + ((i) >> LOG_NUM_BANKS))
+
+// OpenCL C 3.0 made the work-group collectives optional
+#if defined(USE_WORK_GROUP_SCAN) && defined(__OPENCL_C_VERSION__) && \
+    ((__OPENCL_C_VERSION__ >= 200 && __OPENCL_C_VERSION__ < 300) || \
+     defined(__opencl_c_work_group_collective_functions))
+#define HAS_WORK_GROUP_SCAN 1
+#endif
+
+__kernel void scan_blocked(
+    __global int* data,        // Input/output array in global memory
+    __global int* tile_sums,   // Optional output of per-tile total sums
+    __local int* temp,         // PAD(local size * ITEMS_PER_THREAD) ints
+    __local int* group_sums,   // PAD(local size) ints, unused with HAS_WORK_GROUP_SCAN
+    const int N                // Total number of elemenets
+){
+    const int lid = get_local_id(0);
+    const int lsize = get_local_size(0);
+    const int tile = lsize * ITEMS_PER_THREAD;
+    const size_t base = (size_t)get_group_id(0) * tile;
+
+    // Step 1: coalesced load, the tail of the last tile reads zeros
+    for (int i = 0; i < ITEMS_PER_THREAD; i++) {
+        const int index = i * lsize + lid;
+        temp[PAD(index)] = base + index < (size_t)N ? data[base + index] : 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Step 2: serial exclusive scan of this work-item's run
+    int items[ITEMS_PER_THREAD];
+    int total = 0;
+    for (int i = 0; i < ITEMS_PER_THREAD; i++) {
+        const int value = temp[PAD(lid * ITEMS_PER_THREAD + i)];
+        items[i] = total;
+        total += value;
+    }
+
+    // Step 3: exclusive scan of the run totals
+#ifdef HAS_WORK_GROUP_SCAN
+    const int offset = work_group_scan_exclusive_add(total);
+    if (tile_sums != NULL && lid == lsize - 1) {
+        tile_sums[get_group_id(0)] = offset + total;
+    }
+#else
+    group_sums[PAD(lid)] = total;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // same up-sweep / down-sweep as `scan`, through padded indices
+    for (int stride = 1; stride < lsize; stride <<= 1) {
+        int index = (lid + 1) * stride * 2 - 1;
+        if (index < lsize) {
+            group_sums[PAD(index)] += group_sums[PAD(index - stride)];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == lsize - 1) {
+        if (tile_sums != NULL) {
+            tile_sums[get_group_id(0)] = group_sums[PAD(lid)];
+        }
+        group_sums[PAD(lid)] = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int stride = lsize >> 1; stride > 0; stride >>= 1) {
+        int index = (lid + 1) * stride * 2 - 1;
+        if (index < lsize) {
+            int t = group_sums[PAD(index - stride)];
+            group_sums[PAD(index - stride)] = group_sums[PAD(index)];
+            group_sums[PAD(index)] += t;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    const int offset = group_sums[PAD(lid)];
+#endif
+
+    // Step 4: offset the run, then the coalesced store. The barrier keeps
+    // the step 2 reads of other work-items ahead of these writes.
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int i = 0; i < ITEMS_PER_THREAD; i++) {
+        temp[PAD(lid * ITEMS_PER_THREAD + i)] = items[i] + offset;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int i = 0; i < ITEMS_PER_THREAD; i++) {
+        const int index = i * lsize + lid;
+        if (base + index < (size_t)N) {
+            data[base + index] = temp[PAD(index)];
+        }
+    }
+}
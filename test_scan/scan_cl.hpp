@@ -1,47 +1,83 @@
 #pragma once
 
+#include "BufferPool.h"
+#include "OpenCLRuntime.h"
+#include "Profiler.h"
 #include <CL/cl.h>
 #include <CL/cl_platform.h>
 #include <benchmark/benchmark.h>
 #include <cstdint>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 namespace kumo {
 
+// kBlelloch scans one element per work-item in local memory. kBlocked
+// scans ITEMS_PER_THREAD elements per work-item in registers, pads the
+// local arrays against bank conflicts and uses
+// work_group_scan_exclusive_add where the device has it.
+enum class ScanVariant { kBlelloch, kBlocked };
+
+// Shares context and queue with the other stages when constructed with
+// their OpenCLRuntime, otherwise Init creates a private one.
+//
+// Exclusive prefix sum of any length. Every level scans tiles of tile_size
+// elements and writes one sum per tile, the tile sums are scanned by the
+// next level the same way until a single tile is left, then uniform_add
+// pushes the offsets back down level by level. 256M elements with 256
+// element tiles take four levels, kBlocked tiles hold tile_size *
+// items_per_thread elements and need fewer.
 class ScanCL {
 public:
-  ScanCL()
-      : platform_(nullptr), context_(nullptr), device_(nullptr),
-        queue_(nullptr), kernel_(nullptr), kernel_uniform_add_(nullptr), program_(nullptr) {};
+  explicit ScanCL(std::shared_ptr<OpenCLRuntime> runtime = nullptr)
+      : runtime_(std::move(runtime)), own_runtime_(false), platform_(nullptr), context_(nullptr), device_(nullptr),
+        queue_(nullptr), kernel_(nullptr), kernel_uniform_add_(nullptr), program_(nullptr),
+        tile_size_(0), kernel_blocked_(nullptr), variant_(ScanVariant::kBlocked),
+        items_per_thread_(8), work_group_scan_(false), profile_event_(nullptr) {};
   ~ScanCL() { UnInit(); };
 
   bool Init();
   void UnInit();
 
+  // tile_size is the work-group size, a power of two up to the device's
+  // max work-group size
   bool Run(const std::vector<int> &input, std::vector<int> &output, const int tile_size);
+  // Scans n ints of data in place and blocks until done.
+  bool RunOnDevice(cl_mem data, int n, int tile_size);
+
+  cl_context Context() const;
+  cl_device_id Device() const;
+
+  void SetVariant(ScanVariant variant);
+  ScanVariant GetVariant() const;
+  // Rebuilds scan_blocked, a power of two keeps the runs bank aligned.
+  bool SetItemsPerThread(int items);
+  // true when scan_blocked was built with work_group_scan_exclusive_add
+  bool UsesWorkGroupScan() const;
+
+  // Records upload, every level's "scan" and "uniform_add" and download.
+  void SetProfiler(std::shared_ptr<Profiler> profiler);
 
 private:
   bool BuildKernel(const std::string &source_path, const char *kernel_func_name,
-                   cl_kernel *out_kernel, cl_program *out_program);
-
-  bool ExclusiveScan(cl_command_queue queue, cl_mem data, cl_mem tile_sum, int N, int TILE_SIZE);
-  size_t nextPowerOfTwo(size_t n) {
-    if (n == 0) return 1;
-    --n;
-    n |= n >> 1;
-    n |= n >> 2;
-    n |= n >> 4;
-    n |= n >> 8;
-    n |= n >> 16;
-  #if SIZE_MAX > 0xFFFFFFFF
-    n |= n >> 32;  // Only for 64-bit size_t
-  #endif
-    return n + 1;
-  }
+                   cl_kernel *out_kernel, cl_program *out_program,
+                   const std::string &options = "");
+  bool BuildBlocked();
+  int TileElements() const;
+
+  bool CheckTileSize(int tile_size) const;
+  bool ExclusiveScan(cl_command_queue queue, cl_mem data, int N, int level);
+  cl_event* ProfileEvent();
+  void Profile(const char* stage, size_t bytes);
 private:
+  std::shared_ptr<OpenCLRuntime> runtime_;
+  bool own_runtime_;
+  // borrowed from runtime_
   cl_platform_id platform_;
   cl_context context_;
   cl_device_id device_;
@@ -49,50 +85,35 @@ private:
   cl_program program_;
   cl_kernel kernel_;
   cl_kernel kernel_uniform_add_;
+  int tile_size_;
+  cl_kernel kernel_blocked_;
+  ScanVariant variant_;
+  int items_per_thread_;
+  bool work_group_scan_;
+  std::shared_ptr<Profiler> profiler_;
+  cl_event profile_event_;
+  // "data" and one "sums_<level>" slot per level
+  BufferPool buffer_pool_;
 };
 
 inline bool ScanCL::Init() {
-  cl_int err;
-
-  // Discover avaliable OpenCL platform
-  cl_uint num_platforms = 0;
-  err = clGetPlatformIDs(1, &platform_, &num_platforms);
-  if (err != CL_SUCCESS || num_platforms == 0) {
-    std::cerr << "clGetPlatformIDs error return " << err << std::endl;
-    return false;
+  if (!runtime_) {
+    runtime_ = std::make_shared<OpenCLRuntime>();
+    own_runtime_ = true;
   }
-
-  cl_uint num_devices = 0;
-  err =
-      clGetDeviceIDs(platform_, CL_DEVICE_TYPE_GPU, 1, &device_, &num_devices);
-  if (err != CL_SUCCESS || num_devices == 0) {
-    std::cerr << "clGetDeviceIDs error return " << err << std::endl;
+  if (!runtime_->isInitialized() && !runtime_->init()) {
+    std::cerr << "OpenCLRuntime init failed" << std::endl;
+    if (own_runtime_)
+      runtime_.reset();
+    own_runtime_ = false;
     return false;
   }
 
-  context_ = clCreateContext(nullptr, 1, &device_, nullptr, nullptr, &err);
-  if (err != CL_SUCCESS) {
-    std::cerr << "clCreateContext error return " << err << std::endl;
-    return false;
-  }
-
-#if CL_TARGET_OPENCL_VERSION >= 200
-  cl_queue_properties props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE,
-                                 0};
-  queue_ = clCreateCommandQueueWithProperties(context_, device_, props, &err);
-#else
-  queue_ =
-      clCreateCommandQueue(context_, device_, CL_QUEUE_PROFILING_ENABLE, &err);
-#endif
-  if (err != CL_SUCCESS) {
-#if CL_TARGET_OPENCL_VERSION >= 200
-    std::cerr << "clCreateCommandQueueWithProperties error return " << err
-              << std::endl;
-#else
-    std::cerr << "clCreateCommandQueue error return " << err << std::endl;
-#endif
-    return false;
-  }
+  platform_ = runtime_->platform();
+  context_ = runtime_->context();
+  device_ = runtime_->device();
+  queue_ = runtime_->queue();
+  buffer_pool_.setContext(context_);
 
   BuildKernel(
       "/home/kumo/dev/hello_ocl_runtime/test_scan/scan.cl",
@@ -100,69 +121,67 @@ inline bool ScanCL::Init() {
 
   BuildKernel(
       "/home/kumo/dev/hello_ocl_runtime/test_scan/scan.cl",
-      "uniform_add", &kernel_uniform_add_, &program_);
+      "uniform_add", &kernel_uniform_add_, nullptr);
+
+  // kBlelloch still works when the blocked build fails
+  BuildBlocked();
   return true;
 }
 
-inline bool ScanCL::BuildKernel(const std::string &source_path,
-                                const char *kernel_func_name,
-                                cl_kernel *out_kernel,
-                                cl_program *out_program) {
-  // read .cl file
-  std::ifstream file(source_path);
-  if (!file.is_open()) {
-    std::cerr << "Failed to open OpenCL source file: " << source_path
-              << std::endl;
-    return false;
+inline bool ScanCL::BuildBlocked() {
+  const std::string path = "/home/kumo/dev/hello_ocl_runtime/test_scan/scan.cl";
+  if (kernel_blocked_) clReleaseKernel(kernel_blocked_);
+  kernel_blocked_ = nullptr;
+  work_group_scan_ = false;
+
+  const std::string options = "-DITEMS_PER_THREAD=" + std::to_string(items_per_thread_);
+  // work-group collectives are core in OpenCL C 2.0 and optional in 3.0.
+  // A 3.0 build without them still succeeds with the fallback scan, so the
+  // device has to be asked rather than the build
+  int major = 0, minor = 0;
+  std::sscanf(runtime_->deviceInfo().version.c_str(), "OpenCL %d.%d", &major, &minor);
+  bool collectives = major == 2;
+#ifdef CL_DEVICE_WORK_GROUP_COLLECTIVE_FUNCTIONS_SUPPORT
+  if (major >= 3) {
+    cl_bool supported = CL_FALSE;
+    collectives = clGetDeviceInfo(device_, CL_DEVICE_WORK_GROUP_COLLECTIVE_FUNCTIONS_SUPPORT,
+                                  sizeof(supported), &supported, nullptr) == CL_SUCCESS &&
+                  supported == CL_TRUE;
   }
-
-  std::ostringstream oss;
-  oss << file.rdbuf();
-  std::string source_code = oss.str();
-  const char *source_ptr = source_code.c_str();
-
-  // create program
-  cl_int err = 0;
-  cl_program program =
-      clCreateProgramWithSource(context_, 1, &source_ptr, nullptr, &err);
-  if (err != CL_SUCCESS) {
-    std::cerr << "clCreateProgramWithSource error return " << err << std::endl;
-
-    clReleaseProgram(program);
-    program_ = nullptr;
-    return false;
-  }
-
-  err = clBuildProgram(program, 1, &device_, nullptr, nullptr, nullptr);
-  if (err != CL_SUCCESS) {
-    size_t log_size;
-    clGetProgramBuildInfo(program, device_, CL_PROGRAM_BUILD_LOG, 0, nullptr,
-                          &log_size);
-
-    std::vector<char> build_log(log_size);
-    clGetProgramBuildInfo(program, device_, CL_PROGRAM_BUILD_LOG, log_size,
-                          build_log.data(), nullptr);
-
-    std::cerr << "Build failed with error code " << err << ":\n"
-              << build_log.data() << std::endl;
-    return false;
+#endif
+  if (collectives) {
+    const std::string std_option = major == 2 ? " -cl-std=CL2.0" : " -cl-std=CL3.0";
+    if (BuildKernel(path, "scan_blocked", &kernel_blocked_, nullptr,
+                    options + std_option + " -DUSE_WORK_GROUP_SCAN")) {
+      work_group_scan_ = true;
+      return true;
+    }
+    std::cerr << "scan_blocked without work-group functions" << std::endl;
   }
+  return BuildKernel(path, "scan_blocked", &kernel_blocked_, nullptr, options);
+}
 
-  cl_kernel kernel = clCreateKernel(program, kernel_func_name, &err);
-  if (err != CL_SUCCESS) {
-    std::cerr << "clCreateKernel " << kernel_func_name << " error return "
-              << err << std::endl;
-
-    clReleaseProgram(program);
-    program_ = nullptr;
+inline bool ScanCL::BuildKernel(const std::string &source_path,
+                                const char *kernel_func_name,
+                                cl_kernel *out_kernel,
+                                cl_program *out_program,
+                                const std::string &options) {
+  // scan and uniform_add come from one cached program
+  if (!runtime_->buildKernelFromFile(source_path, kernel_func_name, options)) {
+    std::cerr << "Build " << kernel_func_name << " failed from "
+              << source_path << std::endl;
     return false;
   }
 
+  // the runtime may replace its kernel later, keep a reference of our own
+  cl_kernel kernel = runtime_->getKernel(kernel_func_name);
+  clRetainKernel(kernel);
   *out_kernel = kernel;
-  if (out_program)
+  if (out_program) {
+    cl_program program = runtime_->programCache().getProgramFromFile(source_path, options);
+    clRetainProgram(program);
     *out_program = program;
-  else
-    clReleaseProgram(program);
+  }
 
   // std::cout << "Kernel '" << kernel_func_name << "' built successfully from"
   // << source_path << std::endl;
@@ -171,19 +190,23 @@ inline bool ScanCL::BuildKernel(const std::string &source_path,
 }
 
 inline void ScanCL::UnInit() {
+  buffer_pool_.clear();
   if (kernel_)
     clReleaseKernel(kernel_);
   if (kernel_uniform_add_)
     clReleaseKernel(kernel_uniform_add_);
+  if (kernel_blocked_)
+    clReleaseKernel(kernel_blocked_);
   if (program_)
     clReleaseProgram(program_);
-  if (queue_)
-    clReleaseCommandQueue(queue_);
-  if (context_)
-    clReleaseContext(context_);
-  // device_ 和 platform_ 不需要释放
+  // context and queue belong to the runtime
+  if (own_runtime_)
+    runtime_.reset();
+  own_runtime_ = false;
   kernel_ = nullptr;
   kernel_uniform_add_ = nullptr;
+  kernel_blocked_ = nullptr;
+  work_group_scan_ = false;
   program_ = nullptr;
   queue_ = nullptr;
   context_ = nullptr;
@@ -191,140 +214,185 @@ inline void ScanCL::UnInit() {
   platform_ = nullptr;
 }
 
-inline bool ScanCL::ExclusiveScan(cl_command_queue queue, cl_mem data, cl_mem tile_sum, int N, int TILE_SIZE) {
+inline bool ScanCL::ExclusiveScan(cl_command_queue queue, cl_mem data, int N, int level) {
   cl_int err;
-  std::vector<int> test_1(N, 0);
-  int tile_sum_size = (N + TILE_SIZE - 1) / TILE_SIZE;
-  std::vector<int> test_2(tile_sum_size, 0);
-  std::vector<int> test_3(tile_sum_size, 0);
-  std::vector<int> test_4(N, 0);
-  {
-    int arg_index = 0;
-    err  = clSetKernelArg(kernel_, arg_index++, sizeof(cl_mem), (void *)&data);
-    err |= clSetKernelArg(kernel_, arg_index++, sizeof(cl_mem), (void *)&tile_sum);
-    err |= clSetKernelArg(kernel_, arg_index++, TILE_SIZE * sizeof(int), nullptr);
-    err |= clSetKernelArg(kernel_, arg_index++, sizeof(int), (void *)&N);
-    if (err != CL_SUCCESS) {
-      std::cerr << "RunKernel failed" << std::endl;
+  // elements per tile, tile_size_ stays the work-group size
+  const int TILE_SIZE = TileElements();
+  const int num_tiles = (N + TILE_SIZE - 1) / TILE_SIZE;
+  const bool blocked = variant_ == ScanVariant::kBlocked && kernel_blocked_;
+  size_t localWorkSize = tile_size_;
+  size_t globalWorkSize = (size_t)num_tiles * tile_size_;
+
+  // a single tile is scanned completely, no sums to carry
+  cl_mem tile_sum = nullptr;
+  if (num_tiles > 1) {
+    tile_sum = buffer_pool_.acquire("sums_" + std::to_string(level),
+                                    num_tiles * sizeof(int), CL_MEM_READ_WRITE);
+    if (!tile_sum) {
+      std::cerr << "acquire tile sums failed" << std::endl;
       return false;
     }
-
-    size_t globalWorkSize = ((N + TILE_SIZE - 1) / TILE_SIZE) * TILE_SIZE;
-    size_t localWorkSize = TILE_SIZE;
-    err = clEnqueueNDRangeKernel(queue, kernel_, 1, nullptr, &globalWorkSize,
-                                &localWorkSize, 0, nullptr, nullptr);
-    clFinish(queue_);
-    if (err != CL_SUCCESS) {
-      std::cerr << "clEnqueueNDRangeKernel failed return " << err << std::endl;
-    }
-
-
-    err = clEnqueueReadBuffer(queue_, data, CL_TRUE, 0,
-                              test_1.size() * sizeof(int), test_1.data(), 0,
-                              nullptr, nullptr);
-    err = clEnqueueReadBuffer(queue_, tile_sum, CL_TRUE, 0,
-                              test_2.size() * sizeof(int), test_2.data(), 0,
-                              nullptr, nullptr);
-    std::cout << "finish tile scan" << std::endl;
   }
 
   {
+    cl_kernel kernel = blocked ? kernel_blocked_ : kernel_;
     int arg_index = 0;
-    int tile_sum_size = nextPowerOfTwo((N + TILE_SIZE - 1) / TILE_SIZE);
-    err  = clSetKernelArg(kernel_, arg_index++, sizeof(cl_mem), (void*)&tile_sum);
-    err |= clSetKernelArg(kernel_, arg_index++, sizeof(cl_mem), (void*)NULL);
-    err |= clSetKernelArg(kernel_, arg_index++, sizeof(cl_mem), (void*)NULL);
-    err |= clSetKernelArg(kernel_, arg_index++, sizeof(int), (void*)&tile_sum_size);
+    err  = clSetKernelArg(kernel, arg_index++, sizeof(cl_mem), (void *)&data);
+    err |= clSetKernelArg(kernel, arg_index++, sizeof(cl_mem), (void *)&tile_sum);
+    if (blocked) {
+      // PAD(i) = i + i / 32, plus one for the last index
+      err |= clSetKernelArg(kernel, arg_index++, (TILE_SIZE + TILE_SIZE / 32 + 1) * sizeof(int), nullptr);
+      err |= clSetKernelArg(kernel, arg_index++, (tile_size_ + tile_size_ / 32 + 1) * sizeof(int), nullptr);
+    } else {
+      err |= clSetKernelArg(kernel, arg_index++, TILE_SIZE * sizeof(int), nullptr);
+    }
+    err |= clSetKernelArg(kernel, arg_index++, sizeof(int), (void *)&N);
     if (err != CL_SUCCESS) {
       std::cerr << "RunKernel failed" << std::endl;
       return false;
     }
-    
-    size_t localWorkSize = tile_sum_size;
-    size_t globalWorkSize = localWorkSize;
-    if (globalWorkSize > TILE_SIZE) {
-      std::cerr << "invalid size! globalWorkSize=" << globalWorkSize << " TILE_SIZE=" << TILE_SIZE << std::endl;
-      return false;
-    }
-    err = clEnqueueNDRangeKernel(queue, kernel_, 1, nullptr, &globalWorkSize,
-                                 &localWorkSize, 0, nullptr, nullptr);
-    clFinish(queue_);
+    err = clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &globalWorkSize,
+                                 &localWorkSize, 0, nullptr, ProfileEvent());
     if (err != CL_SUCCESS) {
       std::cerr << "clEnqueueNDRangeKernel failed return " << err << std::endl;
+      return false;
     }
-    err = clEnqueueReadBuffer(queue_, tile_sum, CL_TRUE, 0,
-      test_3.size() * sizeof(int),
-      test_3.data(), 0, nullptr, nullptr);
-    std::cout << "finish offset scan" << std::endl;
+    Profile("scan", 2 * (size_t)N * sizeof(int));
+  }
+  if (num_tiles == 1) return true;
+
+  // the tile sums are scanned in place, they become the tile offsets
+  if (!ExclusiveScan(queue, tile_sum, num_tiles, level + 1)) {
+    return false;
   }
 
+  // one element per work-item, over whole tiles
+  globalWorkSize = (size_t)num_tiles * TILE_SIZE;
   {
     int arg_index = 0;
     err  = clSetKernelArg(kernel_uniform_add_, arg_index++, sizeof(cl_mem), (void*)&data);
-    err |= clSetKernelArg(kernel_uniform_add_, arg_index++, sizeof(cl_mem), (void*)&tile_sum); 
+    err |= clSetKernelArg(kernel_uniform_add_, arg_index++, sizeof(cl_mem), (void*)&tile_sum);
     err |= clSetKernelArg(kernel_uniform_add_, arg_index++, sizeof(int), (void*)&N);
     err |= clSetKernelArg(kernel_uniform_add_, arg_index++, sizeof(int), (void*)&TILE_SIZE);
-    size_t globalWorkSize = ((N + TILE_SIZE - 1) / TILE_SIZE) * TILE_SIZE;
-    size_t localWorkSize = TILE_SIZE;
-    clEnqueueNDRangeKernel(queue, kernel_uniform_add_, 1, nullptr, &globalWorkSize, &localWorkSize, 0, nullptr, nullptr);
-    clFinish(queue_);
+    if (err != CL_SUCCESS) {
+      std::cerr << "RunKernel failed" << std::endl;
+      return false;
+    }
+    err = clEnqueueNDRangeKernel(queue, kernel_uniform_add_, 1, nullptr, &globalWorkSize,
+                                 &localWorkSize, 0, nullptr, ProfileEvent());
     if (err != CL_SUCCESS) {
       std::cerr << "clEnqueueNDRangeKernel failed return " << err << std::endl;
+      return false;
     }
-    err = clEnqueueReadBuffer(queue_, data, CL_TRUE, 0,
-      test_4.size() * sizeof(int),
-      test_4.data(), 0, nullptr, nullptr);
-    std::cout << "finish uniform add" << std::endl;
+    Profile("uniform_add", 2 * (size_t)N * sizeof(int));
   }
+  return true;
+}
 
-
+inline bool ScanCL::CheckTileSize(int tile_size) const {
+  // Blelloch's tree needs a power of two, one work-group scans one tile
+  if (tile_size <= 0 || (tile_size & (tile_size - 1)) != 0) {
+    std::cerr << "tile_size " << tile_size << " is not a power of two" << std::endl;
+    return false;
+  }
+  const size_t max_wg = runtime_->deviceInfo().max_work_group_size;
+  if (max_wg && (size_t)tile_size > max_wg) {
+    std::cerr << "tile_size " << tile_size << " exceeds max work-group size "
+              << max_wg << std::endl;
+    return false;
+  }
+  const size_t local_mem = runtime_->deviceInfo().local_mem_size;
+  const size_t blocked_local = ((size_t)tile_size * items_per_thread_ * 33 / 32 +
+                                tile_size * 33 / 32 + 2) * sizeof(int);
+  if (variant_ == ScanVariant::kBlocked && kernel_blocked_ && local_mem &&
+      blocked_local > local_mem) {
+    std::cerr << "tile_size " << tile_size << " with " << items_per_thread_
+              << " items per work-item exceeds local memory" << std::endl;
+    return false;
+  }
   return true;
 }
 
+inline int ScanCL::TileElements() const {
+  const bool blocked = variant_ == ScanVariant::kBlocked && kernel_blocked_;
+  return blocked ? tile_size_ * items_per_thread_ : tile_size_;
+}
 
+inline bool ScanCL::RunOnDevice(cl_mem data, int n, int tile_size) {
+  if (!kernel_ || !kernel_uniform_add_ || !CheckTileSize(tile_size)) return false;
+  if (n <= 0) return true;
+  tile_size_ = tile_size;
+  if (!ExclusiveScan(queue_, data, n, 0)) return false;
+  clFinish(queue_);
+  return true;
+}
 
 inline bool ScanCL::Run(const std::vector<int> &input,
                         std::vector<int> &output,
                         const int tile_size) {
-
-  cl_int err = CL_SUCCESS;
-  
-  output = input;
-
-  cl_mem input_buf =
-      clCreateBuffer(context_, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-                     output.size() * sizeof(int), (void *)output.data(), &err);
+  if (!kernel_ || !kernel_uniform_add_ || !CheckTileSize(tile_size)) return false;
+  output.resize(input.size());
+  if (input.empty()) return true;
+
+  const size_t size = input.size() * sizeof(int);
+  cl_mem data = buffer_pool_.acquire("data", size, CL_MEM_READ_WRITE);
+  if (!data) {
+    std::cerr << "acquire data buffer failed" << std::endl;
+    return false;
+  }
+  cl_int err = clEnqueueWriteBuffer(queue_, data, CL_FALSE, 0, size,
+                                    input.data(), 0, nullptr, ProfileEvent());
   if (err != CL_SUCCESS) {
-    std::cerr << "clCreateBuffer data failed return " << err << std::endl;
+    std::cerr << "clEnqueueWriteBuffer failed return " << err << std::endl;
+    return false;
+  }
+  Profile("upload", size);
+
+  tile_size_ = tile_size;
+  if (!ExclusiveScan(queue_, data, (int)input.size(), 0)) {
     return false;
   }
 
-  // need to padding to length of 2^n, because this temp_vector need to do scan later, our scan kernel only support 2^n length
-  int tile_sum_size = (input.size() + tile_size - 1) / tile_size;
-  std::vector<int> temp_vector(nextPowerOfTwo(tile_sum_size), 0);
-  cl_mem temp_buffer = 
-    clCreateBuffer(context_, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, tile_size * sizeof(int), temp_vector.data(), &err);
+  err = clEnqueueReadBuffer(queue_, data, CL_TRUE, 0, size,
+                            output.data(), 0, nullptr, ProfileEvent());
   if (err != CL_SUCCESS) {
-    std::cerr << "clCreateBuffer temp_buffer failed return " << err << std::endl;
+    std::cerr << "clEnqueueReadBuffer failed return " << err << std::endl;
     return false;
   }
+  Profile("download", size);
+  return true;
+}
 
-  ExclusiveScan(queue_, input_buf, temp_buffer, input.size(), tile_size);
+inline cl_event* ScanCL::ProfileEvent() {
+  profile_event_ = nullptr;
+  return profiler_ ? &profile_event_ : nullptr;
+}
 
+inline void ScanCL::Profile(const char* stage, size_t bytes) {
+  if (!profile_event_) return;
+  profiler_->record(stage, profile_event_, bytes);
+  profile_event_ = nullptr;
+}
 
-  err = clEnqueueReadBuffer(queue_, input_buf, CL_TRUE, 0,
-                            output.size() * sizeof(int),
-                            output.data(), 0, nullptr, nullptr);
+inline void ScanCL::SetProfiler(std::shared_ptr<Profiler> profiler) {
+  profiler_ = std::move(profiler);
+}
 
-  if (err != CL_SUCCESS) {
-    clReleaseMemObject(input_buf);
-    clReleaseMemObject(temp_buffer);
-    std::cerr << "clEnqueueReadBuffer failed return " << err << std::endl;
-  }
+inline cl_context ScanCL::Context() const { return context_; }
 
-  clReleaseMemObject(input_buf);
-  clReleaseMemObject(temp_buffer);
-  return true;
+inline cl_device_id ScanCL::Device() const { return device_; }
+
+inline void ScanCL::SetVariant(ScanVariant variant) { variant_ = variant; }
+
+inline ScanVariant ScanCL::GetVariant() const { return variant_; }
+
+inline bool ScanCL::SetItemsPerThread(int items) {
+  if (items <= 0) return false;
+  items_per_thread_ = items;
+  if (!runtime_ || !runtime_->isInitialized() || !kernel_) return true;
+  return BuildBlocked();
 }
 
+inline bool ScanCL::UsesWorkGroupScan() const { return work_group_scan_; }
+
 } // namespace kumo
\ No newline at end of file